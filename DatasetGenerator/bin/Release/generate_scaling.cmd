@@ -0,0 +1,8 @@
+DatasetGenerator 1000000 input_scaling_1M.bin 1
+DatasetGenerator 1000000 training_scaling_1M.bin 2
+DatasetGenerator 2000000 input_scaling_2M.bin 3
+DatasetGenerator 2000000 training_scaling_2M.bin 4
+DatasetGenerator 4000000 input_scaling_4M.bin 5
+DatasetGenerator 4000000 training_scaling_4M.bin 6
+DatasetGenerator 8000000 input_scaling_8M.bin 7
+DatasetGenerator 8000000 training_scaling_8M.bin 8
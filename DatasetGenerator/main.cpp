@@ -17,6 +17,7 @@ int main(int argc, char* argv[])
         std::cout << "Argument error. Please enter:\n";
         std::cout << "Argument 1: The number of points to create\n";
         std::cout << "Argument 2: The output filename\n";
+        std::cout << "Argument 3: The seed of the random generator (optional, use different seeds for the input and the training dataset)\n";
 
         return 1;
     }
@@ -25,6 +26,12 @@ int main(int argc, char* argv[])
     {
         size_t numPoints = strtoul(argv[1], nullptr, 10);
         std::string filename = argv[2];
+        unsigned long seed = std::default_random_engine::default_seed;
+
+        if (argc >= 4)
+        {
+            seed = strtoul(argv[3], nullptr, 10);
+        }
 
         std::ofstream outStream(filename, std::ios::binary | std::ios::out);
         if ( !outStream.is_open() )
@@ -34,7 +41,7 @@ int main(int argc, char* argv[])
 
         outStream.write(reinterpret_cast<const char*>(&numPoints), std::streamsize(sizeof(size_t)));
 
-        std::default_random_engine generator;
+        std::default_random_engine generator(seed);
         std::uniform_real_distribution<double> distribution(0.0,1.0);
 
         for (size_t i=0; i < numPoints; ++i)
@@ -0,0 +1,417 @@
+/* Microbenchmarks of the hot kernels of the plane sweep algorithms
+    Each kernel runs in isolation on synthetic stripes of uniformly distributed points, so kernel-level changes can be
+    evaluated without end-to-end runs. The density is the number of training points of a stripe that spans the unit width,
+    k is the number of nearest neighbors. Run with --benchmark_filter=<regex> to select kernels.
+ */
+#include <vector>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <iomanip>
+#include <omp.h>
+#include <benchmark/benchmark.h>
+#include "PlaneSweepParallel.h"
+#include "PointNeighbors.h"
+#include "AllKnnProblem.h"
+#include "AllKnnResultStripesParallel.h"
+#include "AllKnnResultStripesParallelTBB.h"
+#include "PlaneSweepStripesParallelAlgorithm.h"
+#include "CompactStripes.h"
+
+//seed of the synthetic points, every benchmark sees the same points
+const unsigned long SEED = 1;
+//height of a synthetic stripe, the stripe spans the unit width
+const double STRIPE_HEIGHT = 0.01;
+//number of input points searched in each iteration of the stripe benchmarks
+const size_t NUM_QUERIES = 256;
+//number of candidates added to a heap in each iteration of the heap benchmarks
+const size_t NUM_CANDIDATES = 4096;
+//number of stripes created by the stripe builder benchmarks
+const size_t NUM_STRIPES = 100;
+
+/** \brief Creates points uniformly distributed in a rectangle of the unit width, sorted by x like the points of a stripe
+ *
+ * \param numPoints size_t the number of points
+ * \param maxY double the upper limit of y, the lower limit is 0
+ * \param seed unsigned long the seed of the random generator
+ * \return point_vector_t
+ *
+ */
+point_vector_t CreateStripePoints(size_t numPoints, double maxY, unsigned long seed)
+{
+    std::mt19937_64 generator(seed);
+    std::uniform_real_distribution<double> distributionX(0.0, 1.0);
+    std::uniform_real_distribution<double> distributionY(0.0, maxY);
+
+    point_vector_t points(numPoints);
+    for (size_t i = 0; i < numPoints; ++i)
+        points[i] = Point{point_id_t(i + 1), distributionX(generator), distributionY(generator)};
+
+    std::sort(points.begin(), points.end(), [](const Point& point1, const Point& point2) { return point1.x < point2.x; });
+
+    return points;
+}
+
+/** \brief A single training stripe with its input points, as the algorithms see it after splitting
+ */
+struct SyntheticStripe
+{
+    point_vector_vector_t inputStripes;
+    point_vector_vector_t trainingStripes;
+    point_vector_t trainingDataset;     /**< the training points in the order of ids, like a loaded dataset */
+    std::vector<StripeBoundaries_t> boundaries;
+    BoundingBox_t boundingBox;
+
+    SyntheticStripe(size_t density)
+        : inputStripes(1, CreateStripePoints(NUM_QUERIES, STRIPE_HEIGHT, SEED)),
+          trainingStripes(1, CreateStripePoints(density, STRIPE_HEIGHT, SEED + 1)),
+          trainingDataset(trainingStripes[0]),
+          boundaries(1, StripeBoundaries_t{0.0, STRIPE_HEIGHT})
+    {
+        std::sort(trainingDataset.begin(), trainingDataset.end(), [](const Point& point1, const Point& point2) { return point1.id < point2.id; });
+        boundingBox.minX = 0.0;
+        boundingBox.minY = 0.0;
+        boundingBox.maxX = 1.0;
+        boundingBox.maxY = STRIPE_HEIGHT;
+    }
+
+    StripeData GetStripeData() const
+    {
+        return {inputStripes, trainingStripes, boundaries};
+    }
+};
+
+/** \brief Exposes the kernels of the double precision algorithm, which work on the points of a stripe (array of structures)
+ */
+class KernelAlgorithm : public PlaneSweepStripesParallelAlgorithm
+{
+    public:
+        KernelAlgorithm() : PlaneSweepStripesParallelAlgorithm(1, 1, false, false, false) {}
+
+        using PlaneSweepStripesParallelAlgorithm::PlaneSweepStripe;
+        using AbstractAllKnnAlgorithm::CalcDistanceSquared;
+};
+
+/** \brief Writes points to a binary dataset file
+ *
+ * \param filename const std::string& the file to create
+ * \param points const point_vector_t& the points
+ * \return void
+ *
+ */
+void WriteDatasetFile(const std::string& filename, const point_vector_t& points)
+{
+    std::ofstream outFile(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    size_t numPoints = points.size();
+    outFile.write(reinterpret_cast<const char*>(&numPoints), std::streamsize(sizeof(size_t)));
+
+    for (auto& point : points)
+    {
+        PointRecord record = {point.id, point.x, point.y};
+        outFile.write(reinterpret_cast<const char*>(&record), std::streamsize(sizeof(PointRecord)));
+    }
+}
+
+/** \brief Loads synthetic input and training datasets in the unit square into a problem, the stripe builders need a problem
+ *
+ * \param numPoints size_t the number of points of each dataset
+ * \return std::unique_ptr<AllKnnProblem>
+ *
+ */
+std::unique_ptr<AllKnnProblem> CreateProblem(size_t numPoints)
+{
+    std::string inputFilename = "microbenchmark_input.bin", trainingFilename = "microbenchmark_training.bin";
+    WriteDatasetFile(inputFilename, CreateStripePoints(numPoints, 1.0, SEED));
+    WriteDatasetFile(trainingFilename, CreateStripePoints(numPoints, 1.0, SEED + 1));
+
+    std::unique_ptr<AllKnnProblem> pProblem(new AllKnnProblem(inputFilename, trainingFilename, 10, true, StripeAxisMode::Y));
+
+    std::remove(inputFilename.c_str());
+    std::remove(trainingFilename.c_str());
+
+    return pProblem;
+}
+
+/** \brief Creates the squared distances of the candidates of the heap benchmarks
+ *
+ * \param descending bool true for descending distances, so each candidate replaces the top of the heap,
+ *                  false for random distances, so most candidates are rejected once the heap is full
+ * \return std::vector<double>
+ *
+ */
+std::vector<double> CreateCandidateDistances(bool descending)
+{
+    std::mt19937_64 generator(SEED);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+    std::vector<double> distances(NUM_CANDIDATES);
+    for (auto& distance : distances)
+        distance = distribution(generator);
+
+    if (descending)
+        std::sort(distances.begin(), distances.end(), [](double d1, double d2) { return d1 > d2; });
+
+    return distances;
+}
+
+//distance of a query from all points of a stripe, with the points stored as structures (the layout of the stripes)
+static void BM_CalcDistanceSquared_AoS(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    KernelAlgorithm kernel;
+    auto& training = stripe.trainingStripes[0];
+    auto query = stripe.inputStripes[0].cbegin();
+
+    for (auto _ : state)
+    {
+        double sum = 0.0;
+        for (auto pointIter = training.cbegin(); pointIter < training.cend(); ++pointIter)
+        {
+            double dx = 0.0;
+            sum += kernel.CalcDistanceSquared(query, pointIter, dx);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetItemsProcessed(state.iterations()*training.size());
+}
+BENCHMARK(BM_CalcDistanceSquared_AoS)->RangeMultiplier(16)->Range(1<<10, 1<<18);
+
+//distance of a query from all points of a stripe, with the coordinates stored in separate arrays
+static void BM_CalcDistanceSquared_SoA(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    auto& training = stripe.trainingStripes[0];
+    auto& query = stripe.inputStripes[0][0];
+
+    std::vector<double> x(training.size()), y(training.size());
+    for (size_t i = 0; i < training.size(); ++i)
+    {
+        x[i] = training[i].x;
+        y[i] = training[i].y;
+    }
+
+    for (auto _ : state)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < x.size(); ++i)
+        {
+            double dx = x[i] - query.x;
+            double dy = y[i] - query.y;
+            sum += dx*dx + dy*dy;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetItemsProcessed(state.iterations()*training.size());
+}
+BENCHMARK(BM_CalcDistanceSquared_SoA)->RangeMultiplier(16)->Range(1<<10, 1<<18);
+
+//arguments of the heap benchmarks: k and the order of the candidates (0=random, 1=descending distance)
+static void HeapArguments(benchmark::internal::Benchmark* benchmark)
+{
+    for (int k : {1, 10, 100})
+        for (int descending : {0, 1})
+            benchmark->Args({k, descending});
+}
+
+//the lazy max heap of the algorithms, candidates are checked against the top before they are added
+static void BM_PointNeighbors_CheckAdd(benchmark::State& state)
+{
+    size_t k = state.range(0);
+    auto distances = CreateCandidateDistances(state.range(1) != 0);
+    point_vector_t points(1, Point{1, 0.0, 0.0});
+
+    for (auto _ : state)
+    {
+        PointNeighbors<neighbors_priority_queue_t> neighbors(k);
+        for (auto distance : distances)
+            benchmark::DoNotOptimize(neighbors.CheckAdd(points.cbegin(), distance, 0.0));
+        benchmark::DoNotOptimize(neighbors.MaxDistanceElement());
+    }
+
+    state.SetItemsProcessed(state.iterations()*distances.size());
+}
+BENCHMARK(BM_PointNeighbors_CheckAdd)->Apply(HeapArguments);
+
+//the lazy max heap of the algorithms, candidates are added without the check of dx
+static void BM_PointNeighbors_Add(benchmark::State& state)
+{
+    size_t k = state.range(0);
+    auto distances = CreateCandidateDistances(state.range(1) != 0);
+    point_vector_t points(1, Point{1, 0.0, 0.0});
+
+    for (auto _ : state)
+    {
+        PointNeighbors<neighbors_priority_queue_t> neighbors(k);
+        for (auto distance : distances)
+            neighbors.Add(points.cbegin(), distance);
+        benchmark::DoNotOptimize(neighbors.MaxDistanceElement());
+    }
+
+    state.SetItemsProcessed(state.iterations()*distances.size());
+}
+BENCHMARK(BM_PointNeighbors_Add)->Apply(HeapArguments);
+
+//baseline of the standard priority queue, which pops and pushes to replace the top
+static void BM_StdPriorityQueue(benchmark::State& state)
+{
+    size_t k = state.range(0);
+    auto distances = CreateCandidateDistances(state.range(1) != 0);
+
+    for (auto _ : state)
+    {
+        std::priority_queue<Neighbor, std::vector<Neighbor>, NeighborComparer> heap;
+        for (auto distance : distances)
+        {
+            if (heap.size() < k)
+            {
+                heap.push(Neighbor{1, distance});
+            }
+            else if (distance < heap.top().distanceSquared)
+            {
+                heap.pop();
+                heap.push(Neighbor{1, distance});
+            }
+        }
+        benchmark::DoNotOptimize(heap.top());
+    }
+
+    state.SetItemsProcessed(state.iterations()*distances.size());
+}
+BENCHMARK(BM_StdPriorityQueue)->Apply(HeapArguments);
+
+//arguments of the stripe benchmarks: density and k
+static void StripeArguments(benchmark::internal::Benchmark* benchmark)
+{
+    for (int density : {1<<10, 1<<14, 1<<18})
+        for (int k : {1, 10, 100})
+            benchmark->Args({density, k});
+}
+
+//sweep of a stripe in double precision over the points of the stripe (array of structures)
+static void BM_PlaneSweepStripe_AoS(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    size_t k = state.range(1);
+    KernelAlgorithm kernel;
+    auto stripeData = stripe.GetStripeData();
+    auto& queries = stripe.inputStripes[0];
+
+    for (auto _ : state)
+    {
+        for (auto queryIter = queries.cbegin(); queryIter < queries.cend(); ++queryIter)
+        {
+            PointNeighbors<neighbors_priority_queue_t> neighbors(k);
+            kernel.PlaneSweepStripe(queryIter, stripeData, 0, neighbors, 0.0);
+            benchmark::DoNotOptimize(neighbors.MaxDistanceElement());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations()*queries.size());
+}
+BENCHMARK(BM_PlaneSweepStripe_AoS)->Apply(StripeArguments);
+
+//sweep of a stripe over the single precision coordinates (structure of arrays) with the recheck of the candidates
+static void BM_PlaneSweepStripe_Float(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    size_t k = state.range(1);
+    CompactStripes<float> floatStripes(stripe.trainingDataset, stripe.boundingBox, 1);
+    floatStripes.AddStripe(0, stripe.trainingStripes[0], GetPositionsById(stripe.trainingDataset));
+    CompactStripes<float>::PointSearch search(floatStripes, k);
+    auto& queries = stripe.inputStripes[0];
+
+    for (auto _ : state)
+    {
+        for (auto queryIter = queries.cbegin(); queryIter < queries.cend(); ++queryIter)
+        {
+            PointNeighbors<neighbors_priority_queue_t> neighbors(k);
+            search.Start(*queryIter);
+            search.PlaneSweepStripe(0, 0.0);
+            search.Finish(queryIter, neighbors);
+            benchmark::DoNotOptimize(neighbors.MaxDistanceElement());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations()*queries.size());
+}
+BENCHMARK(BM_PlaneSweepStripe_Float)->Apply(StripeArguments);
+
+//sweep of a stripe over the quantized coordinates (structure of arrays) with the recheck of the candidates
+static void BM_PlaneSweepStripe_Fixed(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    size_t k = state.range(1);
+    CompactStripes<int32_t> fixedStripes(stripe.trainingDataset, stripe.boundingBox, 1);
+    fixedStripes.AddStripe(0, stripe.trainingStripes[0], GetPositionsById(stripe.trainingDataset));
+    CompactStripes<int32_t>::PointSearch search(fixedStripes, k);
+    auto& queries = stripe.inputStripes[0];
+
+    for (auto _ : state)
+    {
+        for (auto queryIter = queries.cbegin(); queryIter < queries.cend(); ++queryIter)
+        {
+            PointNeighbors<neighbors_priority_queue_t> neighbors(k);
+            search.Start(*queryIter);
+            search.PlaneSweepStripe(0, 0.0);
+            search.Finish(queryIter, neighbors);
+            benchmark::DoNotOptimize(neighbors.MaxDistanceElement());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations()*queries.size());
+}
+BENCHMARK(BM_PlaneSweepStripe_Fixed)->Apply(StripeArguments);
+
+//conversion of a stripe to single precision coordinates
+static void BM_FloatStripes_AddStripe(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    CompactStripes<float> floatStripes(stripe.trainingDataset, stripe.boundingBox, 1);
+    auto positionsById = GetPositionsById(stripe.trainingDataset);
+
+    for (auto _ : state)
+        floatStripes.AddStripe(0, stripe.trainingStripes[0], positionsById);
+
+    state.SetItemsProcessed(state.iterations()*stripe.trainingStripes[0].size());
+}
+BENCHMARK(BM_FloatStripes_AddStripe)->RangeMultiplier(16)->Range(1<<10, 1<<18);
+
+//quantization of a stripe
+static void BM_FixedPointStripes_AddStripe(benchmark::State& state)
+{
+    SyntheticStripe stripe(state.range(0));
+    CompactStripes<int32_t> fixedStripes(stripe.trainingDataset, stripe.boundingBox, 1);
+    auto positionsById = GetPositionsById(stripe.trainingDataset);
+
+    for (auto _ : state)
+        fixedStripes.AddStripe(0, stripe.trainingStripes[0], positionsById);
+
+    state.SetItemsProcessed(state.iterations()*stripe.trainingStripes[0].size());
+}
+BENCHMARK(BM_FixedPointStripes_AddStripe)->RangeMultiplier(16)->Range(1<<10, 1<<18);
+
+//splitting of both datasets into stripes, the arguments are the number of points and splitByT
+template<class StripesResult>
+static void BM_GetStripeData(benchmark::State& state)
+{
+    auto pProblem = CreateProblem(state.range(0));
+    bool splitByT = state.range(1) != 0;
+
+    for (auto _ : state)
+    {
+        StripesResult result(*pProblem, "", true, splitByT);
+        auto stripeData = result.GetStripeData(NUM_STRIPES);
+        benchmark::DoNotOptimize(stripeData.StripeBoundaries.data());
+    }
+
+    state.SetItemsProcessed(state.iterations()*2*state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_GetStripeData, AllKnnResultStripesParallel)->ArgsProduct({{1<<17, 1<<20}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_GetStripeData, AllKnnResultStripesParallelTBB)->ArgsProduct({{1<<17, 1<<20}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -12,6 +12,9 @@
 #include "AllKnnProblem.h"
 #include "AllKnnResult.h"
 #include "PlaneSweepParallel.h"
+#include "ResultSink.h"
+#include "SearchCounters.h"
+#include "PhaseProfiler.h"
 #include <tbb/tbb.h>
 
 template<class OuterContainer>
@@ -31,9 +34,9 @@ std::unique_ptr<pointNeighbors_priority_queue_vector_t> CreateNeighborsContainer
         std::unique_ptr<pointNeighbors_priority_queue_vector_t> pContainer(new pointNeighbors_priority_queue_vector_t(tbb::cache_aligned_allocator<PointNeighbors<neighbors_priority_queue_t>>()));
         pContainer->reserve(inputDataset.size());
 
-        //for each input point, create a max heap filled with k neighbors of a very large distance
+        //for each input point, create an empty max heap, memory for the neighbors is allocated on the first addition
         for (size_t i=0; i < inputDataset.size(); ++i)
-            pContainer->emplace_back(PointNeighbors<neighbors_priority_queue_t>(numNeighbors));
+            pContainer->emplace_back(numNeighbors);
 
         return pContainer;
     }
@@ -75,9 +78,51 @@ class AbstractAllKnnAlgorithm
         {
             return false;
         }
+
+        /** \brief
+         *
+         * \return bool True if this algorithm passes the neighbors of each input point to a result sink when its search is completed
+         *
+         */
+        virtual bool SupportsResultSink() const
+        {
+            return false;
+        }
+
+        /** \brief Sets the sink that receives the neighbors of the completed input points
+         *          The neighbors passed to the sink are released, so the returned result holds only the heap statistics
+         * \param pSink ResultSink* the sink, or nullptr to keep all neighbors in the result
+         * \return void
+         *
+         */
+        void SetResultSink(ResultSink* pSink)
+        {
+            pResultSink = pSink;
+        }
     protected:
         AbstractAllKnnAlgorithm() {}
 
+        ResultSink* pResultSink = nullptr;
+
+        /** \brief Passes the neighbors of a completed input point to the result sink and frees the memory of its heap
+         *
+         * \param pointId point_id_t the id of the input point
+         * \param neighbors PointNeighbors<neighbors_priority_queue_t>& the heap of neighbors of the input point
+         * \return void
+         *
+         */
+        void ConsumeNeighbors(point_id_t pointId, PointNeighbors<neighbors_priority_queue_t>& neighbors) const
+        {
+            //each thread sorts the neighbors in its own buffer
+            thread_local std::vector<Neighbor> sortedNeighbors;
+            size_t numNeighbors = neighbors.GetNumNeighbors();
+            sortedNeighbors.resize(numNeighbors);
+
+            neighbors.CopySortedNeighbors(sortedNeighbors.data());
+            pResultSink->Consume(pointId, sortedNeighbors.data(), numNeighbors);
+            neighbors.Release();
+        }
+
         /** \brief Allocates the container of neighbors for all input points
          *
          * \param inputDataset const point_vector_t& The input dataset
@@ -87,6 +132,7 @@ class AbstractAllKnnAlgorithm
         template<class OuterContainer>
         std::unique_ptr<OuterContainer> CreateNeighborsContainer(const point_vector_t& inputDataset, size_t numNeighbors) const
         {
+            ProfileScope profileScope(ProfilePhase::Allocation);
             return ::CreateNeighborsContainer<OuterContainer>(inputDataset, numNeighbors);
         }
 
@@ -117,7 +163,10 @@ class AbstractAllKnnAlgorithm
         {
             double dx = 0.0;
             double dsq = CalcDistanceSquared(inputPoint, trainingPoint, dx);
-            return neighbors.CheckAdd(trainingPoint, dsq, dx);
+            bool isSweepContinued = neighbors.CheckAdd(trainingPoint, dsq, dx);
+            COUNT_SEARCH(candidatesExamined, 1);
+            COUNT_SEARCH(dxTerminations, isSweepContinued ? 0 : 1);
+            return isSweepContinued;
         }
 
         /** \brief Adds a training point to the max heap of neighbors for a specific input point
@@ -134,7 +183,10 @@ class AbstractAllKnnAlgorithm
         {
             double dx = 0.0;
             double dsq = CalcDistanceSquared(inputPoint, trainingPoint, dx);
-            return neighbors.CheckAdd(trainingPoint, dsq, dx, mindy);
+            bool isSweepContinued = neighbors.CheckAdd(trainingPoint, dsq, dx, mindy);
+            COUNT_SEARCH(candidatesExamined, 1);
+            COUNT_SEARCH(dxTerminations, isSweepContinued ? 0 : 1);
+            return isSweepContinued;
         }
 
         /** \brief Adds a training point to the max heap of neighbors for a specific input point with a pre-calculated distance
@@ -158,6 +210,7 @@ class AbstractAllKnnAlgorithm
          */
         inline double CalcDistanceSquared(point_vector_iterator_t p1, point_vector_iterator_t p2) const
         {
+            COUNT_SEARCH(distanceEvaluations, 1);
             double dx = p2->x - p1->x;
             double dy = p2->y - p1->y;
 
@@ -173,6 +226,7 @@ class AbstractAllKnnAlgorithm
          */
         inline double CalcDistanceSquared(point_vector_iterator_t p1, point_vector_iterator_t p2, double& dx) const
         {
+            COUNT_SEARCH(distanceEvaluations, 1);
             dx = p2->x - p1->x;
             double dy = p2->y - p1->y;
 
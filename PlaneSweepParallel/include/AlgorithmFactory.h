@@ -0,0 +1,211 @@
+/* Factory of the AkNN algorithms
+    Each algorithm variant has an index, which is its position in the bitstream of enabled algorithms of the command line,
+    and a name, which is used by the job specifications (see JobSpec.h)
+ */
+#ifndef ALGORITHMFACTORY_H
+#define ALGORITHMFACTORY_H
+
+#include <string>
+#include <memory>
+#include "AbstractAllKnnAlgorithm.h"
+#include "BruteForceAlgorithm.h"
+#include "BruteForceParallelAlgorithm.h"
+#include "BruteForceParallelTBBAlgorithm.h"
+#include "PlaneSweepAlgorithm.h"
+#include "PlaneSweepCopyAlgorithm.h"
+#include "PlaneSweepCopyParallelAlgorithm.h"
+#include "PlaneSweepCopyParallelTBBAlgorithm.h"
+#include "PlaneSweepStripesAlgorithm.h"
+#include "PlaneSweepStripesParallelAlgorithm.h"
+#include "PlaneSweepStripesParallelTBBAlgorithm.h"
+#include "PlaneSweepStripesParallelExternalAlgorithm.h"
+#include "PlaneSweepStripesParallelExternalTBBAlgorithm.h"
+#include "PlaneSweepStripesParallelCompactAlgorithm.h"
+
+#define NUM_ALGORITHMS 42
+
+typedef std::unique_ptr<AbstractAllKnnAlgorithm> algorithm_ptr_t;
+
+/** \brief Parameters passed to the constructors of the algorithms
+ */
+struct AlgorithmParameters
+{
+    int numStripes = 0;             /**< number of stripes, 0 to calculate it from the datasets */
+    int numThreads = 0;             /**< number of threads, 0 to let the system decide */
+    bool prefetchWindows = true;    /**< load the next window in the background (external memory algorithms) */
+};
+
+//names of the algorithms in the order of their indices
+const char* const ALGORITHM_NAMES[NUM_ALGORITHMS] =
+{
+    "bruteforce",
+    "bruteforce_parallel",
+    "bruteforce_parallel_tbb",
+    "planesweep",
+    "planesweep_copy",
+    "planesweep_copy_parallel",
+    "planesweep_copy_parallel_psort",
+    "planesweep_copy_parallel_tbb",
+    "planesweep_copy_parallel_tbb_psort",
+    "planesweep_stripes",
+    "planesweep_stripes_parallel",
+    "planesweep_stripes_parallel_psplit",
+    "planesweep_stripes_parallel_psort",
+    "planesweep_stripes_parallel_psort_psplit",
+    "planesweep_stripes_parallel_tbb",
+    "planesweep_stripes_parallel_tbb_psplit",
+    "planesweep_stripes_parallel_tbb_psort",
+    "planesweep_stripes_parallel_tbb_psort_psplit",
+    "planesweep_stripes_parallel_splitbyt",
+    "planesweep_stripes_parallel_psplit_splitbyt",
+    "planesweep_stripes_parallel_psort_splitbyt",
+    "planesweep_stripes_parallel_psort_psplit_splitbyt",
+    "planesweep_stripes_parallel_tbb_splitbyt",
+    "planesweep_stripes_parallel_tbb_psplit_splitbyt",
+    "planesweep_stripes_parallel_tbb_psort_splitbyt",
+    "planesweep_stripes_parallel_tbb_psort_psplit_splitbyt",
+    "planesweep_stripes_external",
+    "planesweep_stripes_external_splitbyt",
+    "planesweep_stripes_external_tbb",
+    "planesweep_stripes_external_tbb_splitbyt",
+    "planesweep_stripes_fixed",
+    "planesweep_stripes_fixed_splitbyt",
+    "planesweep_stripes_fixed_tbb",
+    "planesweep_stripes_fixed_tbb_splitbyt",
+    "planesweep_stripes_float",
+    "planesweep_stripes_float_splitbyt",
+    "planesweep_stripes_float_tbb",
+    "planesweep_stripes_float_tbb_splitbyt",
+    "planesweep_stripes_external_halo",
+    "planesweep_stripes_external_splitbyt_halo",
+    "planesweep_stripes_external_tbb_halo",
+    "planesweep_stripes_external_tbb_splitbyt_halo"
+};
+
+/** \brief Finds the index of an algorithm by its name
+ *
+ * \param name const std::string& the name of the algorithm
+ * \return int the index, or -1 if there is no algorithm with this name
+ *
+ */
+inline int FindAlgorithm(const std::string& name)
+{
+    for (int i = 0; i < NUM_ALGORITHMS; ++i)
+    {
+        if (name == ALGORITHM_NAMES[i])
+            return i;
+    }
+
+    return -1;
+}
+
+/** \brief Creates an algorithm by its index
+ *
+ * \param index int the index of the algorithm, from 0 to NUM_ALGORITHMS-1
+ * \param parameters const AlgorithmParameters& the parameters of the algorithm
+ * \return algorithm_ptr_t the algorithm
+ *
+ */
+inline algorithm_ptr_t CreateAlgorithm(int index, const AlgorithmParameters& parameters)
+{
+    int numStripes = parameters.numStripes;
+    int numThreads = parameters.numThreads;
+    bool prefetchWindows = parameters.prefetchWindows;
+
+    switch(index)
+    {
+        case 0:
+            return algorithm_ptr_t(new BruteForceAlgorithm);
+        case 1:
+            return algorithm_ptr_t(new BruteForceParallelAlgorithm(numThreads));
+        case 2:
+            return algorithm_ptr_t(new BruteForceParallelTBBAlgorithm(numThreads));
+        case 3:
+            return algorithm_ptr_t(new PlaneSweepAlgorithm());
+        case 4:
+            return algorithm_ptr_t(new PlaneSweepCopyAlgorithm());
+        case 5:
+            return algorithm_ptr_t(new PlaneSweepCopyParallelAlgorithm(numThreads, false));
+        case 6:
+            return algorithm_ptr_t(new PlaneSweepCopyParallelAlgorithm(numThreads, true));
+        case 7:
+            return algorithm_ptr_t(new PlaneSweepCopyParallelTBBAlgorithm(numThreads, false));
+        case 8:
+            return algorithm_ptr_t(new PlaneSweepCopyParallelTBBAlgorithm(numThreads, true));
+        case 9:
+            return algorithm_ptr_t(new PlaneSweepStripesAlgorithm(numStripes));
+
+        case 10:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, false, false));
+        case 11:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, true, false));
+        case 12:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, false, false));
+        case 13:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, true, false));
+        case 14:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, false, false));
+        case 15:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, true, false));
+        case 16:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, false, false));
+        case 17:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, true, false));
+        case 18:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, false, true));
+        case 19:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, true, true));
+        case 20:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, false, true));
+        case 21:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, true, true));
+        case 22:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, false, true));
+        case 23:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, true, true));
+        case 24:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, false, true));
+        case 25:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, true, true));
+
+        case 26:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, false, prefetchWindows, false));
+        case 27:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, true, prefetchWindows, false));
+        case 28:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, false, prefetchWindows, false));
+        case 29:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, true, prefetchWindows, false));
+
+        case 30:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<int32_t, false>(numStripes, numThreads, false));
+        case 31:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<int32_t, false>(numStripes, numThreads, true));
+        case 32:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<int32_t, true>(numStripes, numThreads, false));
+        case 33:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<int32_t, true>(numStripes, numThreads, true));
+
+        case 34:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<float, false>(numStripes, numThreads, false));
+        case 35:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<float, false>(numStripes, numThreads, true));
+        case 36:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<float, true>(numStripes, numThreads, false));
+        case 37:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelCompactAlgorithm<float, true>(numStripes, numThreads, true));
+
+        case 38:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, false, prefetchWindows, true));
+        case 39:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, true, prefetchWindows, true));
+        case 40:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, false, prefetchWindows, true));
+        case 41:
+            return algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, true, prefetchWindows, true));
+    }
+
+    throw ApplicationException("Unknown algorithm index " + std::to_string(index));
+}
+
+#endif // ALGORITHMFACTORY_H
@@ -12,8 +12,11 @@
 #include <memory>
 #include <chrono>
 #include <iterator>
+#include <limits>
+#include <omp.h>
 #include "ApplicationException.h"
 #include "PlaneSweepParallel.h"
+#include "DatasetTransform.h"
 
 /** \brief Boundaries of a stripe
  */
@@ -23,6 +26,49 @@ struct StripeBoundaries_t
     double maxY;
 };
 
+/** \brief Bounding box of both datasets, calculated once when loading the data files
+ */
+struct BoundingBox_t
+{
+    double minX = std::numeric_limits<double>::max();
+    double minY = std::numeric_limits<double>::max();
+    double maxX = std::numeric_limits<double>::lowest();
+    double maxY = std::numeric_limits<double>::lowest();
+
+    /** \brief Extends the bounding box to contain a point
+     *
+     * \param point const Point&
+     * \return void
+     *
+     */
+    inline void Add(const Point& point)
+    {
+        if (point.x < minX) minX = point.x;
+        if (point.x > maxX) maxX = point.x;
+        if (point.y < minY) minY = point.y;
+        if (point.y > maxY) maxY = point.y;
+    }
+
+    /** \brief Extends the bounding box to contain another bounding box
+     *
+     * \param other const BoundingBox_t&
+     * \return void
+     *
+     */
+    void Merge(const BoundingBox_t& other)
+    {
+        if (other.minX < minX) minX = other.minX;
+        if (other.maxX > maxX) maxX = other.maxX;
+        if (other.minY < minY) minY = other.minY;
+        if (other.maxY > maxY) maxY = other.maxY;
+    }
+
+    bool IsEmpty() const
+    {
+        return minX > maxX || minY > maxY;
+    }
+};
+
 /** \brief Structure containing stripe data
  */
 struct StripeData
@@ -60,14 +106,33 @@ std::istream& operator >>(std::istream& i, Point& p)
     return i;
 }
 
+/** \brief Returns the position of each point of a dataset by point id, the position of the point with id i is stored at i-1
+ *          Ids are sequential starting from 1, so there is one position for each point
+ * \param dataset const point_vector_t& the dataset
+ * \return std::vector<point_id_t> the positions of the points
+ *
+ */
+inline std::vector<point_id_t> GetPositionsById(const point_vector_t& dataset)
+{
+    size_t numPoints = dataset.size();
+    std::vector<point_id_t> positions(numPoints);
+
+    #pragma omp parallel for
+    for (size_t i=0; i < numPoints; ++i)
+        positions[dataset[i].id - 1] = point_id_t(i);
+
+    return positions;
+}
+
 
 /** \brief Class definition for AkNN problem stored in internal memory
  */
 class AllKnnProblem
 {
     public:
-        AllKnnProblem(const std::string& inputFilename, const std::string& trainingFilename, size_t numNeighbors, bool loadDataFiles)
-            : pInputDataset(new point_vector_t), pTrainingDataset(new point_vector_t)
+        AllKnnProblem(const std::string& inputFilename, const std::string& trainingFilename, size_t numNeighbors, bool loadDataFiles,
+                      StripeAxisMode stripeAxisMode)
+            : transform(stripeAxisMode), pInputDataset(new point_vector_t), pTrainingDataset(new point_vector_t)
         {
             //set the filenames and read the data files
             this->inputFilename = inputFilename;
@@ -96,6 +161,17 @@ class AllKnnProblem
             return numNeighbors;
         }
 
+        /** \brief Changes the number of nearest neighbors, so the loaded datasets can be reused for another k
+         *
+         * \param numNeighbors size_t the number of nearest neighbors (k)
+         * \return void
+         *
+         */
+        void SetNumNeighbors(size_t numNeighbors)
+        {
+            this->numNeighbors = numNeighbors;
+        }
+
         virtual size_t GetInputDatasetSize() const
         {
             return pInputDataset->size();
@@ -113,10 +189,32 @@ class AllKnnProblem
          */
         const std::chrono::duration<double>& getLoadingTime() const { return loadingTime; }
 
+        /** \brief Returns the transform applied to the coordinates of both datasets after loading
+         *
+         * \return const DatasetTransform&
+         *
+         */
+        const DatasetTransform& GetTransform() const
+        {
+            return transform;
+        }
+
+        /** \brief Returns the bounding box of both datasets after the transform has been applied
+         *
+         * \return const BoundingBox_t&
+         *
+         */
+        const BoundingBox_t& GetBoundingBox() const
+        {
+            return boundingBox;
+        }
+
     protected:
         std::string inputFilename;
         std::string trainingFilename;
         std::chrono::duration<double> loadingTime;
+        DatasetTransform transform;
+        BoundingBox_t boundingBox;
 
         /** \brief Template method for loading data files. It can add the points in an internal or external memory vector
          *
@@ -138,7 +236,50 @@ class AllKnnProblem
             }
         }
 
+        /** \brief Template method for reading data files without storing the points, each point is passed to a function
+         *          Binary files are read in blocks of records
+         * \param filename const string& the filename to read from
+         * \param processPoint Function function called for each point with a const Point& argument
+         *
+         */
+        template<class Function>
+        void ScanFile(const std::string& filename, Function processPoint)
+        {
+            if (endsWith(filename, ".bin"))
+            {
+                std::fstream fs(filename, std::ios::in | std::ios::binary);
+                size_t numPoints = 0;
+                fs.read(reinterpret_cast<char*>(&numPoints), std::streamsize(sizeof(size_t)));
+                CheckNumPoints(filename, numPoints);
+
+                std::vector<PointRecord> records(std::min(numPoints, SCAN_BLOCK_RECORDS));
+                for (size_t i=0; i < numPoints && !fs.eof(); i += records.size())
+                {
+                    size_t numRecords = std::min(numPoints - i, records.size());
+                    fs.read(reinterpret_cast<char*>(records.data()), std::streamsize(numRecords*sizeof(PointRecord)));
+                    numRecords = size_t(fs.gcount())/sizeof(PointRecord);
+
+                    for (size_t iRecord=0; iRecord < numRecords; ++iRecord)
+                        processPoint(Point{point_id_t(records[iRecord].id), records[iRecord].x, records[iRecord].y});
+                }
+
+                fs.close();
+            }
+            else
+            {
+                std::fstream fs(filename, std::ios::in);
+                size_t numPoints = 0;
+                for (auto iter = std::istream_iterator<Point>(fs); iter != std::istream_iterator<Point>(); ++iter, ++numPoints)
+                    processPoint(*iter);
+
+                fs.close();
+                CheckNumPoints(filename, numPoints);
+            }
+        }
+
     private:
+        static constexpr size_t SCAN_BLOCK_RECORDS = 64*1024; /**< number of records read at once by ScanFile */
+
         size_t numNeighbors = 0;
         std::unique_ptr<point_vector_t> pInputDataset;
         std::unique_ptr<point_vector_t> pTrainingDataset;
@@ -151,10 +292,75 @@ class AllKnnProblem
             LoadFile(inputFilename, *pInputDataset);
             LoadFile(trainingFilename, *pTrainingDataset);
 
+            TransformDatasets();
+
             auto finish = std::chrono::high_resolution_clock::now();
             loadingTime = finish - start;
         }
 
+        /** \brief Selects the stripe axis from the spread of both datasets, transforms their coordinates and calculates the bounding box
+         *          Without a stripe axis mode only the bounding box is calculated
+         * \return void
+         *
+         */
+        void TransformDatasets()
+        {
+            size_t numInputPoints = pInputDataset->size();
+            size_t numTrainingPoints = pTrainingDataset->size();
+
+            if (transform.NeedsStatistics())
+            {
+                //each thread accumulates the statistics of its points, they are merged in thread order so the transform is the same in every run
+                std::vector<DatasetTransform> localTransforms(omp_get_max_threads(), transform);
+
+                #pragma omp parallel
+                {
+                    DatasetTransform& localTransform = localTransforms[omp_get_thread_num()];
+
+                    #pragma omp for schedule(static) nowait
+                    for (size_t i=0; i < numInputPoints; ++i)
+                        localTransform.AddPoint(pInputDataset->at(i));
+
+                    #pragma omp for schedule(static) nowait
+                    for (size_t i=0; i < numTrainingPoints; ++i)
+                        localTransform.AddPoint(pTrainingDataset->at(i));
+                }
+
+                for (auto& localTransform : localTransforms)
+                    transform.Merge(localTransform);
+            }
+
+            transform.Fit();
+
+            //the bounding box is calculated on the transformed coordinates
+            boundingBox = BoundingBox_t();
+            bool isIdentity = transform.IsIdentity();
+
+            #pragma omp parallel
+            {
+                BoundingBox_t localBoundingBox;
+
+                #pragma omp for nowait
+                for (size_t i=0; i < numInputPoints; ++i)
+                {
+                    if (!isIdentity)
+                        transform.Apply(pInputDataset->at(i));
+                    localBoundingBox.Add(pInputDataset->at(i));
+                }
+
+                #pragma omp for nowait
+                for (size_t i=0; i < numTrainingPoints; ++i)
+                {
+                    if (!isIdentity)
+                        transform.Apply(pTrainingDataset->at(i));
+                    localBoundingBox.Add(pTrainingDataset->at(i));
+                }
+
+                #pragma omp critical
+                boundingBox.Merge(localBoundingBox);
+            }
+        }
+
         template<class PointVector>
         void LoadBinaryFile(const std::string& filename, PointVector& dataset)
         {
@@ -163,13 +369,18 @@ class AllKnnProblem
             size_t numPoints = 0;
             //read the number of points at the beginning of the file
             fs.read(reinterpret_cast<char*>(&numPoints), std::streamsize(sizeof(size_t)));
+            CheckNumPoints(filename, numPoints);
             dataset.reserve(numPoints);
 
-            //read each point and add to vector
+            //read each point and add to vector, the file records always have 64-bit ids
             for (size_t i=0; i < numPoints && !fs.eof(); ++i)
             {
+                PointRecord record;
+                fs.read(reinterpret_cast<char*>(&record), std::streamsize(sizeof(PointRecord)));
                 Point p;
-                fs.read(reinterpret_cast<char*>(&p), std::streamsize(sizeof(Point)));
+                p.id = point_id_t(record.id);
+                p.x = record.x;
+                p.y = record.y;
                 dataset.push_back(p);
             }
 
@@ -182,6 +393,25 @@ class AllKnnProblem
             std::fstream fs(filename, std::ios::in);
             std::copy(std::istream_iterator<Point>(fs), std::istream_iterator<Point>(), std::back_inserter(dataset));
             fs.close();
+            CheckNumPoints(filename, dataset.size());
+        }
+
+        /** \brief Checks that the point ids of a dataset can be stored in point_id_t
+         *          Ids are sequential starting from 1, so the number of points is the largest id
+         * \param filename const string& the filename of the dataset
+         * \param numPoints size_t the number of points of the dataset
+         * \return void
+         *
+         */
+        void CheckNumPoints(const std::string& filename, size_t numPoints) const
+        {
+            if (numPoints > std::numeric_limits<point_id_t>::max())
+            {
+                std::stringstream ss;
+                ss << "Dataset " << filename << " has " << numPoints << " points, which exceeds the range of point ids. "
+                   << "Rebuild without COMPACT_POINT_IDS to use 64-bit ids.";
+                throw ApplicationException(ss.str());
+            }
         }
 };
 
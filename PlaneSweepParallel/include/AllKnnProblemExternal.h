@@ -3,17 +3,48 @@
 #ifndef ALLKNNPROBLEMEXTERNAL_H
 #define ALLKNNPROBLEMEXTERNAL_H
 
+#include <stxxl/stream>
 #include "AllKnnProblem.h"
 
+/** \brief Comparer for sorting points by y
+ *          The sentinel values must be lower/greater than any coordinate, so the coordinates are not restricted to the unit square
+ */
+struct ExternalPointComparerY
+{
+    Point minval = {0, 0.0, std::numeric_limits<double>::lowest()};
+    Point maxval = {0, 0.0, std::numeric_limits<double>::max()};
+
+    bool operator()(const Point& point1, const Point& point2) const
+    {
+        return point1.y < point2.y;
+    }
+
+    const Point& min_value() const
+    {
+        return minval;
+    }
+
+    const Point& max_value() const
+    {
+        return maxval;
+    }
+};
+
+//stream sorting of points by y, the sorted runs are formed while the data files are read
+typedef stxxl::stream::runs_creator<stxxl::stream::use_push<Point>, ExternalPointComparerY> ext_point_runs_creator_t;
+typedef stxxl::stream::runs_merger<ext_point_runs_creator_t::sorted_runs_type, ExternalPointComparerY> ext_point_runs_merger_t;
 
 /** \brief Class definition for AkNN problem stored in external memory
+ *          The datasets are stored sorted by y (after the transform of coordinates), which is the order needed for splitting them into stripes
  */
 class AllKnnProblemExternal : public AllKnnProblem
 {
     public:
-        AllKnnProblemExternal(const std::string& inputFilename, const std::string& trainingFilename, size_t numNeighbors, bool loadDataFiles, size_t memoryLimitMB)
-            : AllKnnProblem(inputFilename, trainingFilename, numNeighbors, false),
-                memoryLimitMB(memoryLimitMB), pExtInputDataset(new ext_point_vector_t()), pExtTrainingDataset(new ext_point_vector_t())
+        AllKnnProblemExternal(const std::string& inputFilename, const std::string& trainingFilename, size_t numNeighbors, bool loadDataFiles,
+                              StripeAxisMode stripeAxisMode, size_t memoryLimitMB)
+            : AllKnnProblem(inputFilename, trainingFilename, numNeighbors, false, stripeAxisMode),
+                memoryLimitMB(memoryLimitMB), stripeAxisMode(stripeAxisMode),
+                pExtInputDataset(new ext_point_vector_t()), pExtTrainingDataset(new ext_point_vector_t())
         {
             if (loadDataFiles)
                 this->LoadExternalDataFiles();
@@ -21,11 +52,21 @@ class AllKnnProblemExternal : public AllKnnProblem
 
         virtual ~AllKnnProblemExternal() {}
 
+        /** \brief Returns the input dataset sorted by y
+         *
+         * \return const ext_point_vector_t&
+         *
+         */
         const ext_point_vector_t& GetExtInputDataset() const
         {
             return *pExtInputDataset;
         }
 
+        /** \brief Returns the training dataset sorted by y
+         *
+         * \return const ext_point_vector_t&
+         *
+         */
         const ext_point_vector_t& GetExtTrainingDataset() const
         {
             return *pExtTrainingDataset;
@@ -51,22 +92,86 @@ class AllKnnProblemExternal : public AllKnnProblem
             return memoryLimitMB*1024*1024;
         }
 
+        /** \brief Changes the memory limit of the external memory algorithm, so the loaded datasets can be reused for another limit
+         *
+         * \param memoryLimitMB size_t memory limit in MB
+         * \return void
+         *
+         */
+        void SetMemoryLimitMB(size_t memoryLimitMB)
+        {
+            this->memoryLimitMB = memoryLimitMB;
+        }
+
     private:
         size_t memoryLimitMB = 0;
+        StripeAxisMode stripeAxisMode = StripeAxisMode::Y;
         std::unique_ptr<ext_point_vector_t> pExtInputDataset;
         std::unique_ptr<ext_point_vector_t> pExtTrainingDataset;
 
+        /** \brief Loads both datasets sorted by y
+         *          Without a transform each file is read once and the sorted runs are formed while reading.
+         *          Otherwise the files are read once for the statistics of the transform and once more for the sorted runs of the transformed points
+         * \return void
+         *
+         */
         void LoadExternalDataFiles()
         {
             auto start = std::chrono::high_resolution_clock::now();
 
-            //call template method of parent class by passing an external memory vector
-            LoadFile(inputFilename, *pExtInputDataset);
-            LoadFile(trainingFilename, *pExtTrainingDataset);
+            boundingBox = BoundingBox_t();
+
+            if (stripeAxisMode != StripeAxisMode::Y)
+            {
+                auto addStatistics = [this](const Point& point) { transform.AddPoint(point); };
+                ScanFile(inputFilename, addStatistics);
+                ScanFile(trainingFilename, addStatistics);
+            }
+
+            transform.Fit();
+
+            LoadSortedDataset(inputFilename, *pExtInputDataset);
+            LoadSortedDataset(trainingFilename, *pExtTrainingDataset);
 
             auto finish = std::chrono::high_resolution_clock::now();
             loadingTime = finish - start;
         }
+
+        /** \brief Reads a data file, transforms the points and stores them sorted by y
+         *          The sorted runs are formed while the file is read and they are merged into the dataset by a buffered writer
+         * \param filename const string& the filename to read from
+         * \param dataset ext_point_vector_t& the external memory vector to store the sorted points
+         * \return void
+         *
+         */
+        void LoadSortedDataset(const std::string& filename, ext_point_vector_t& dataset)
+        {
+            //the caches of both datasets are taken from the memory limit, the rest is used by run formation and merging
+            size_t usedMemory = 2*GetExtVectorCacheBytes<ext_point_vector_t>();
+            size_t sortMemory = GetMemoryLimitBytes() > usedMemory ? GetMemoryLimitBytes() - usedMemory : GetMemoryLimitBytes()/2;
+
+            ext_point_runs_creator_t runsCreator(ExternalPointComparerY(), sortMemory);
+            bool isIdentity = transform.IsIdentity();
+
+            ScanFile(filename, [&](const Point& point)
+                {
+                    Point transformedPoint = point;
+                    if (!isIdentity)
+                        transform.Apply(transformedPoint);
+
+                    boundingBox.Add(transformedPoint);
+                    runsCreator.push(transformedPoint);
+                });
+
+            ext_point_runs_merger_t runsMerger(runsCreator.result(), ExternalPointComparerY(), sortMemory);
+
+            dataset.resize(runsMerger.size());
+            stxxl::vector_bufwriter<ext_point_vector_t> writer(dataset);
+            for (; !runsMerger.empty(); ++runsMerger)
+                writer << *runsMerger;
+
+            writer.finish();
+        }
 };
 
 #endif // ALLKNNPROBLEMEXTERNAL_H
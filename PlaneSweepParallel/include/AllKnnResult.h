@@ -7,9 +7,14 @@
 #include <chrono>
 #include <fstream>
 #include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <tbb/tbb.h>
 #include "PlaneSweepParallel.h"
 #include "AllKnnProblem.h"
 #include "PointNeighbors.h"
+#include "ResultFile.h"
+#include "PhaseProfiler.h"
 
 /** \brief Class definition of AkNN result
  */
@@ -52,6 +57,26 @@ class AllKnnResult
             return std::chrono::duration<double>(0.0);
         }
 
+        virtual const std::chrono::duration<double> getDurationOutputFlush() const
+        {
+            return std::chrono::duration<double>(0.0);
+        }
+
+        virtual const std::chrono::duration<double> getDurationWindowIOWait() const
+        {
+            return std::chrono::duration<double>(0.0);
+        }
+
+        virtual const std::chrono::duration<double> getDurationWindowLoad() const
+        {
+            return std::chrono::duration<double>(0.0);
+        }
+
+        virtual const std::chrono::duration<double> getDurationWindowCompute() const
+        {
+            return std::chrono::duration<double>(0.0);
+        }
+
         virtual size_t getNumFirstPassWindows() const
         {
             return 0;
@@ -62,6 +87,11 @@ class AllKnnResult
             return 0;
         }
 
+        virtual size_t getNumLoadedTrainingPoints() const
+        {
+            return 0;
+        }
+
         void setDurationSorting(std::chrono::duration<double> value)
         {
             elapsedSorting = value;
@@ -70,9 +100,32 @@ class AllKnnResult
         void setNeighborsContainer(std::unique_ptr<pointNeighbors_priority_queue_vector_t>& pNeighborsContainer)
         {
             pNeighborsPriorityQueueVector = std::move(pNeighborsContainer);
+            isFinalized = false;
             CalcHeapStats();
         }
 
+        /** \brief Sorts the heaps of all input points in parallel, so SaveToFile and FindDifferences read them without changes
+         *          The heaps are sorted once, when the result is read for the first time, so results that are only streamed
+         *          to a result sink never sort their released heaps
+         * \return void
+         *
+         */
+        void Finalize() const
+        {
+            if (isFinalized)
+                return;
+
+            ProfileScope profileScope(ProfilePhase::Finalize);
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, pNeighborsPriorityQueueVector->size()), [&](const tbb::blocked_range<size_t>& range)
+                {
+                    for (size_t iPoint = range.begin(); iPoint < range.end(); ++iPoint)
+                        pNeighborsPriorityQueueVector->at(iPoint).Finalize();
+                });
+
+            isFinalized = true;
+        }
+
         size_t getMinHeapAdditions()
         {
             return minHeapAdditions;
@@ -103,131 +156,201 @@ class AllKnnResult
             return 0;
         }
 
+        virtual size_t getNumSpilledPoints() const
+        {
+            return 0;
+        }
+
         virtual bool HasAllocationError()
         {
             return false;
         }
 
         /** \brief Saves neighbors found for each input point to a text file
-         *
+         *          The finalized heaps are read without changes, consecutive points are formatted in parallel into texts that are written in order
          */
         virtual void SaveToFile() const
         {
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+            Finalize();
+            std::ofstream outFile(GetOutputFilename(".txt"), std::ios_base::out);
 
-            auto now = std::chrono::system_clock::now();
-            auto in_time_t = std::chrono::system_clock::to_time_t(now);
+            size_t numInputPoints = pNeighborsPriorityQueueVector->size();
+            size_t numNeighbors = problem.GetNumNeighbors();
+            size_t chunkPoints = std::max(RESULT_CHUNK_NEIGHBORS/numNeighbors, size_t(1));
+            size_t partPoints = std::max(chunkPoints/RESULT_CHUNK_PARTS, size_t(1));
 
-            //generate a unique filename
-            std::stringstream ss;
-            ss << filePrefix << "_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << "_" << ms.count() << ".txt";
+            for (size_t startPoint = 0; startPoint < numInputPoints; startPoint += chunkPoints)
+            {
+                size_t numPoints = std::min(chunkPoints, numInputPoints - startPoint);
+                size_t numParts = (numPoints + partPoints - 1)/partPoints;
+                std::vector<std::string> texts(numParts);
 
-            std::ofstream outFile(ss.str(), std::ios_base::out);
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, numParts), [&](const tbb::blocked_range<size_t>& range)
+                    {
+                        for (size_t iPart = range.begin(); iPart < range.end(); ++iPart)
+                        {
+                            std::ostringstream text;
+                            size_t partEnd = std::min((iPart + 1)*partPoints, numPoints);
+
+                            for (size_t iPoint = iPart*partPoints; iPoint < partEnd; ++iPoint)
+                            {
+                                auto& neighbors = pNeighborsPriorityQueueVector->at(startPoint + iPoint);
+                                text << startPoint + iPoint + 1;
+
+                                //the neighbors are listed from the farthest to the nearest, missing neighbors first
+                                for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
+                                {
+                                    auto& neighbor = neighbors.FinalizedNeighbor(iNeighbor);
+
+                                    if (neighbor.pointId > 0)
+                                    {
+                                        text << "\t(" << neighbor.pointId << " " << neighbor.distanceSquared << ")";
+                                    }
+                                    else
+                                    {
+                                        text << "\t(" << "NULL" << " " << neighbor.distanceSquared << ")";
+                                    }
+                                }
+
+                                text << '\n';
+                            }
+
+                            texts[iPart] = text.str();
+                        }
+                    });
 
-            const point_vector_t& inputDataset = problem.GetInputDataset();
+                for (auto& text : texts)
+                    outFile << text;
+            }
 
-            //loop through the input dataset
-            for (auto inputPoint = inputDataset.cbegin(); inputPoint != inputDataset.cend(); ++inputPoint)
-            {
-                outFile << inputPoint->id;
+            outFile.close();
+        }
 
-                NeighborsEnumerator* pNeighbors = &pNeighborsPriorityQueueVector->at((inputPoint->id) - 1);
+        /** \brief Saves neighbors found for each input point to a binary result file (see ResultFile.h)
+         *          The heaps are read without changes, consecutive points are encoded in parallel and written while the next points are encoded
+         */
+        virtual void SaveToBinaryFile() const
+        {
+            size_t numInputPoints = pNeighborsPriorityQueueVector->size();
+            size_t numNeighbors = problem.GetNumNeighbors();
 
-                std::vector<Neighbor> removedNeighbors;
+            ResultFileWriter writer(GetOutputFilename(".bin"), sizeof(point_id_t), numInputPoints, numNeighbors);
+            size_t recordSize = writer.GetRecordSize();
+            size_t chunkPoints = std::max(RESULT_CHUNK_NEIGHBORS/numNeighbors, size_t(1));
 
-                //loop through all the neighbors in the max heap
-                while (pNeighbors->HasNext())
+            for (size_t startPoint = 0; startPoint < numInputPoints; startPoint += chunkPoints)
+            {
+                size_t numPoints = std::min(chunkPoints, numInputPoints - startPoint);
+                std::unique_ptr<std::vector<char>> pBuffer(new std::vector<char>(numPoints*numNeighbors*recordSize));
+
+                #pragma omp parallel
                 {
-                    Neighbor neighbor = pNeighbors->Next();
-                    //add neighbor to a second vector so we can put it back again
-                    //(this is needed when we want to use the result as a reference for comparison)
-                    removedNeighbors.push_back(neighbor);
+                    std::vector<Neighbor> neighbors(numNeighbors);
 
-                    //output point Id and squared distance
-                    if (neighbor.pointId > 0)
-                    {
-                        outFile << "\t(" << neighbor.pointId << " " << neighbor.distanceSquared << ")";
-                    }
-                    else
+                    #pragma omp for schedule(static)
+                    for (size_t iPoint = 0; iPoint < numPoints; ++iPoint)
                     {
-                        outFile << "\t(" << "NULL" << " " << neighbor.distanceSquared << ")";
+                        pNeighborsPriorityQueueVector->at(startPoint + iPoint).CopySortedNeighbors(neighbors.data());
+                        char* pRecord = pBuffer->data() + iPoint*numNeighbors*recordSize;
+
+                        for (auto& neighbor : neighbors)
+                        {
+                            EncodeResultNeighbor(pRecord, sizeof(point_id_t), neighbor.pointId, neighbor.distanceSquared);
+                            pRecord += recordSize;
+                        }
                     }
                 }
 
-                outFile << std::endl;
-
-                //put back all removed neighbors
-                pNeighbors->AddAllRemoved(removedNeighbors);
+                writer.Write(std::move(pBuffer));
             }
 
-            outFile.close();
+            writer.Close();
         }
 
         /** \brief Compares a result with a reference result to find any differences in distances of neighbors
-         *
+         *          The finalized heaps of both results are read without changes, the points are compared in parallel
          * \param result AllKnnResult& the result to check for differences
          * \param accuracy double the accuracy to use for comparisons
-         * \return unique_ptr<vector<unsigned long>>  vector of input point ids where differences exist
+         * \return unique_ptr<vector<point_id_t>>  vector of input point ids where differences exist
          *
          */
-        virtual std::unique_ptr<std::vector<unsigned long>> FindDifferences(AllKnnResult& result, double accuracy)
+        virtual std::unique_ptr<std::vector<point_id_t>> FindDifferences(AllKnnResult& result, double accuracy)
         {
-            auto differences = std::unique_ptr<std::vector<unsigned long>>(new std::vector<unsigned long>());
-
-            auto& inputDataset = problem.GetInputDataset();
+            auto differences = std::unique_ptr<std::vector<point_id_t>>(new std::vector<point_id_t>());
 
-            //loop through all input points
-            for (auto inputPoint = inputDataset.cbegin(); inputPoint != inputDataset.cend(); ++inputPoint)
-            {
-                NeighborsEnumerator* pNeighbors = &pNeighborsPriorityQueueVector->at((inputPoint->id) - 1);
-                NeighborsEnumerator* pNeighborsReference = &result.pNeighborsPriorityQueueVector->at((inputPoint->id) - 1);
+            Finalize();
+            size_t numInputPoints = pNeighborsPriorityQueueVector->size();
+            size_t numNeighbors = problem.GetNumNeighbors();
+            auto& neighborsVectorReference = result.GetNeighborsPriorityQueueVector();
 
-                std::vector<Neighbor> removedNeighbors;
-                std::vector<Neighbor> removedNeighborsReference;
+            //each thread collects the differences it finds, the lists are merged at the end
+            tbb::enumerable_thread_specific<std::vector<point_id_t>> threadDifferences;
 
-                //loop through all neighbors
-                while (pNeighbors->HasNext())
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, numInputPoints), [&](const tbb::blocked_range<size_t>& range)
                 {
-                    Neighbor neighbor = pNeighbors->Next();
-                    removedNeighbors.push_back(neighbor);
+                    auto& localDifferences = threadDifferences.local();
 
-                    if (pNeighborsReference->HasNext())
+                    for (size_t iPoint = range.begin(); iPoint < range.end(); ++iPoint)
                     {
-                        Neighbor neighborReference = pNeighborsReference->Next();
-                        removedNeighborsReference.push_back(neighborReference);
+                        auto& neighbors = pNeighborsPriorityQueueVector->at(iPoint);
+                        auto& neighborsReference = neighborsVectorReference.at(iPoint);
 
                         //compare with reference result and check if difference in squared distance exceeds the desired accuracy
-                        double diff = neighbor.distanceSquared - neighborReference.distanceSquared;
-
-                        if (abs(diff) > accuracy)
+                        for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
                         {
-                            //insert the id of input point in a vector for reporting purposes
-                            differences->push_back(inputPoint->id);
-                            break;
+                            double diff = neighbors.FinalizedNeighbor(iNeighbor).distanceSquared - neighborsReference.FinalizedNeighbor(iNeighbor).distanceSquared;
+
+                            if (std::abs(diff) > accuracy)
+                            {
+                                //insert the id of input point in a vector for reporting purposes
+                                localDifferences.push_back(point_id_t(iPoint + 1));
+                                break;
+                            }
                         }
                     }
-                    else
-                    {
-                        differences->push_back(inputPoint->id);
-                        break;
-                    }
-                }
+                });
 
-                if (!pNeighbors->HasNext() && pNeighborsReference->HasNext())
-                {
-                    differences->push_back(inputPoint->id);
-                }
+            for (auto& localDifferences : threadDifferences)
+                differences->insert(differences->end(), localDifferences.cbegin(), localDifferences.cend());
 
-                //put back all removed neighbors from both vectors
-                pNeighbors->AddAllRemoved(removedNeighbors);
-                pNeighborsReference->AddAllRemoved(removedNeighborsReference);
-            }
+            std::sort(differences->begin(), differences->end());
 
             return differences;
         }
 
+        /** \brief Copies the neighbors of some input points, in the order of Next() (missing neighbors first, then by descending distance)
+         *
+         * \param pointIds const std::vector<point_id_t>& the ids of the input points in ascending order
+         * \return unique_ptr<vector<Neighbor>> k neighbors for each input point
+         *
+         */
+        virtual std::unique_ptr<std::vector<Neighbor>> GetNeighbors(const std::vector<point_id_t>& pointIds) const
+        {
+            size_t numNeighbors = problem.GetNumNeighbors();
+            std::unique_ptr<std::vector<Neighbor>> pNeighbors(new std::vector<Neighbor>());
+            pNeighbors->reserve(pointIds.size()*numNeighbors);
+
+            Finalize();
+
+            for (auto pointId : pointIds)
+            {
+                auto& neighbors = pNeighborsPriorityQueueVector->at(pointId - 1);
+
+                for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
+                    pNeighbors->push_back(neighbors.FinalizedNeighbor(iNeighbor));
+            }
+
+            return pNeighbors;
+        }
+
+        /** \brief Returns the finalized heaps of all input points, they are sorted at the first read of the result
+         *
+         * \return pointNeighbors_priority_queue_vector_t&
+         *
+         */
         pointNeighbors_priority_queue_vector_t& GetNeighborsPriorityQueueVector()
         {
+            Finalize();
             return *pNeighborsPriorityQueueVector;
         }
 
@@ -268,18 +391,42 @@ class AllKnnResult
         }
 
     protected:
+        //number of neighbors formatted or encoded at once by SaveToFile and SaveToBinaryFile
+        static constexpr size_t RESULT_CHUNK_NEIGHBORS = 1024*1024;
+        //number of parts of a chunk that are formatted in parallel by SaveToFile
+        static constexpr size_t RESULT_CHUNK_PARTS = 64;
+
         const AllKnnProblem& problem;
         std::string filePrefix;
         size_t minHeapAdditions = 0;
         size_t maxHeapAdditions = 0;
         double avgHeapAdditions = 0.0;
-        size_t totalHeapAdditions = 0.0;
+        size_t totalHeapAdditions = 0;
+
+        /** \brief Generates a unique filename for saving the result, from the prefix of the algorithm, the current time and the duration
+         *
+         * \param extension const std::string& the extension of the file
+         * \return std::string
+         *
+         */
+        std::string GetOutputFilename(const std::string& extension) const
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+
+            auto now = std::chrono::system_clock::now();
+            auto in_time_t = std::chrono::system_clock::to_time_t(now);
+
+            std::stringstream ss;
+            ss << filePrefix << "_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << "_" << ms.count() << extension;
+
+            return ss.str();
+        }
 
     private:
         std::unique_ptr<pointNeighbors_priority_queue_vector_t> pNeighborsPriorityQueueVector;
         std::chrono::duration<double> elapsed;
         std::chrono::duration<double> elapsedSorting;
-
+        mutable bool isFinalized = false;   /**< the heaps have been sorted by Finalize */
 };
 
 #endif // AllKnnRESULT_H
@@ -31,6 +31,8 @@ class AllKnnResultSorted : public AllKnnResult
         {
             if (!pInputDatasetSorted)
             {
+                ProfileScope profileScope(ProfilePhase::SortX);
+
                 //makes a copy of the original dataset
                 pInputDatasetSorted.reset(new point_vector_t(problem.GetInputDataset()));
 
@@ -66,6 +68,8 @@ class AllKnnResultSorted : public AllKnnResult
         {
             if (!pTrainingDatasetSorted)
             {
+                ProfileScope profileScope(ProfilePhase::SortX);
+
                 pTrainingDatasetSorted.reset(new point_vector_t(problem.GetTrainingDataset()));
 
                 if (parallelSort)
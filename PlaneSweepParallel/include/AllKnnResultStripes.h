@@ -6,6 +6,28 @@
 #include <tbb/tbb.h>
 #include <cmath>
 
+/** \brief Returns the lower y limit of the first stripe, which is the lowest y of both datasets
+ *
+ * \param boundingBox const BoundingBox_t& the bounding box of both datasets
+ * \return double
+ *
+ */
+inline double GetStripesLowerLimitY(const BoundingBox_t& boundingBox)
+{
+    return boundingBox.minY;
+}
+
+/** \brief Returns the upper y limit of the last stripe, which is strictly greater than the highest y of both datasets
+ *
+ * \param boundingBox const BoundingBox_t& the bounding box of both datasets
+ * \return double
+ *
+ */
+inline double GetStripesUpperLimitY(const BoundingBox_t& boundingBox)
+{
+    return std::nextafter(boundingBox.maxY, std::numeric_limits<double>::max());
+}
+
 /** \brief Class definition of AkNN result for striped plane sweep algorithm
  */
 class AllKnnResultStripes : public AllKnnResult
@@ -48,6 +70,8 @@ class AllKnnResultStripes : public AllKnnResult
                 pStripeBoundaries.reset(new std::vector<StripeBoundaries_t>());
             }
 
+            ProfileSample sortStart = PhaseProfiler::Now();
+
             //copy both datasets so we don't destroy the original problem data
             point_vector_t inputDatasetSortedY(problem.GetInputDataset());
             point_vector_t trainingDatasetSortedY(problem.GetTrainingDataset());
@@ -83,6 +107,10 @@ class AllKnnResultStripes : public AllKnnResult
                      });
             }
 
+            //the split includes sorting the points of each stripe by x
+            ProfileSample splitStart = PhaseProfiler::Now();
+            PhaseProfiler::Record(ProfilePhase::SortY, sortStart, splitStart);
+
             //check if specific number of stripes has been requested
             if (numStripes > 0)
             {
@@ -96,9 +124,21 @@ class AllKnnResultStripes : public AllKnnResult
                 create_fixed_stripes(numStripes, inputDatasetSortedY, trainingDatasetSortedY);
             }
 
+            PhaseProfiler::Record(ProfilePhase::SplitStripes, splitStart, PhaseProfiler::Now());
+
             return {*pInputDatasetStripe, *pTrainingDatasetStripe, *pStripeBoundaries};
         }
 
+        /** \brief Releases the memory of the points of a training stripe, it is used by algorithms that keep their own copy of the stripe
+         *          Stripes can be released in parallel, the stripe remains in the stripe data without points
+         * \param iStripe size_t the index of the stripe
+         * \return void
+         *
+         */
+        void ReleaseTrainingStripe(size_t iStripe)
+        {
+            point_vector_t().swap(pTrainingDatasetStripe->at(iStripe));
+        }
 
         /** \brief Returns the number of stripes
          *
@@ -214,6 +254,7 @@ class AllKnnResultStripes : public AllKnnResult
                 double minY = inputIterStart->y <= trainingIterStart->y ? inputIterStart->y : trainingIterStart->y;
 
                 //sort input points of current stripe by x
+                ProfileSample sortStart = PhaseProfiler::Now();
                 if (parallelSort)
                 {
                     tbb::parallel_sort(pInputDatasetStripe->back().begin(), pInputDatasetStripe->back().end(),
@@ -230,6 +271,7 @@ class AllKnnResultStripes : public AllKnnResult
                              return point1.x < point2.x;
                          });
                 }
+                PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
                 //now find the maxy boundary of current stripe
                 double maxY = minY;
@@ -253,6 +295,7 @@ class AllKnnResultStripes : public AllKnnResult
                     maxY = prev(trainingIterEnd)->y >= prev(inputIterEnd)->y ? prev(trainingIterEnd)->y : prev(inputIterEnd)->y;
 
                     //sort training points of current stripe by x
+                    ProfileSample sortStart = PhaseProfiler::Now();
                     if (parallelSort)
                     {
                         tbb::parallel_sort(pTrainingDatasetStripe->back().begin(), pTrainingDatasetStripe->back().end(),
@@ -269,6 +312,7 @@ class AllKnnResultStripes : public AllKnnResult
                              return point1.x < point2.x;
                          });
                     }
+                    PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
                     //start of next stripe is the end of current stripe
                     trainingIterStart = trainingIterEnd;
@@ -340,6 +384,7 @@ class AllKnnResultStripes : public AllKnnResult
 
                 double minY = inputIterStart->y <= trainingIterStart->y ? inputIterStart->y : trainingIterStart->y;
 
+                ProfileSample sortStart = PhaseProfiler::Now();
                 if (parallelSort)
                 {
                     tbb::parallel_sort(pTrainingDatasetStripe->back().begin(), pTrainingDatasetStripe->back().end(),
@@ -356,6 +401,7 @@ class AllKnnResultStripes : public AllKnnResult
                              return point1.x < point2.x;
                          });
                 }
+                PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
                 double maxY = minY;
 
@@ -374,6 +420,7 @@ class AllKnnResultStripes : public AllKnnResult
 
                     maxY = prev(inputIterEnd)->y >= prev(trainingIterEnd)->y ? prev(inputIterEnd)->y : prev(trainingIterEnd)->y;
 
+                    ProfileSample sortStart = PhaseProfiler::Now();
                     if (parallelSort)
                     {
                         tbb::parallel_sort(pInputDatasetStripe->back().begin(), pInputDatasetStripe->back().end(),
@@ -390,6 +437,7 @@ class AllKnnResultStripes : public AllKnnResult
                              return point1.x < point2.x;
                          });
                     }
+                    PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
                     inputIterStart = inputIterEnd;
                 }
@@ -42,6 +42,9 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
             auto trainingDatasetSortedYBegin = trainingDatasetSortedY.cbegin();
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = inputDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
@@ -94,14 +97,16 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
                     //we found the input points for current stripe
                     inputStripe.assign(inputIterStart, inputIterEnd);
                     //sort the input points by using serial sort
+                    ProfileSample sortStart = PhaseProfiler::Now();
                     sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
                          {
                              return point1.x < point2.x;
                          });
+                    PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
                     //find the boundaries of current stripe
-                    stripeBoundaries.minY =  i > 0 ? inputIterStart->y : 0.0;
-                    stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : 1.0001) : 1.0001;
+                    stripeBoundaries.minY =  i > 0 ? inputIterStart->y : lowerLimitY;
+                    stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : upperLimitY) : upperLimitY;
 
                     //do a binary search to find the first training point of current stripe
                     //unfortunately we cannot use the end point of previous stripe because the loop runs in parallel execution
@@ -118,10 +123,12 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
                         //we found training points for current stripe
                         trainingStripe.assign(trainingIterStart, trainingIterEnd);
                         //sort training points by x using a serial sort
+                        ProfileSample sortStart = PhaseProfiler::Now();
                         sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
                          {
                              return point1.x < point2.x;
                          });
+                        PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
                     }
                 }
                 else
@@ -129,8 +136,8 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
                     //in this case we have an empty stripe, it will be ignored by the algorithm
                     if (inputIterStart >= inputDatasetSortedYEnd)
                     {
-                        stripeBoundaries.minY = 1.0001;
-                        stripeBoundaries.maxY = 1.0001;
+                        stripeBoundaries.minY = upperLimitY;
+                        stripeBoundaries.maxY = upperLimitY;
                     }
                     else
                     {
@@ -159,6 +166,9 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
             auto trainingDatasetSortedYBegin = trainingDatasetSortedY.cbegin();
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = trainingDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
@@ -201,13 +211,15 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
                 if (trainingIterStart < trainingIterEnd)
                 {
                     trainingStripe.assign(trainingIterStart, trainingIterEnd);
+                    ProfileSample sortStart = PhaseProfiler::Now();
                     sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
                          {
                              return point1.x < point2.x;
                          });
+                    PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
-                    stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : 0.0;
-                    stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : 1.0001) : 1.0001;
+                    stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : lowerLimitY;
+                    stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : upperLimitY) : upperLimitY;
 
                     auto inputIterStart = lower_bound(inputDatasetSortedYBegin, inputDatasetSortedYEnd, stripeBoundaries.minY,
                                                         [](const Point& point, const double& value) { return point.y < value; });
@@ -219,18 +231,20 @@ class AllKnnResultStripesParallel : public AllKnnResultStripes
                     if (inputIterStart < inputIterEnd)
                     {
                         inputStripe.assign(inputIterStart, inputIterEnd);
+                        ProfileSample sortStart = PhaseProfiler::Now();
                         sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
                          {
                              return point1.x < point2.x;
                          });
+                        PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
                     }
                 }
                 else
                 {
                     if (trainingIterStart >= trainingDatasetSortedYEnd)
                     {
-                        stripeBoundaries.minY = 1.0001;
-                        stripeBoundaries.maxY = 1.0001;
+                        stripeBoundaries.minY = upperLimitY;
+                        stripeBoundaries.maxY = upperLimitY;
                     }
                     else
                     {
@@ -1,40 +1,21 @@
 /* This file contains a class definition of AkNN result for striped plane sweep algorithm when external memory is used */
 #ifndef ALLKNNRESULTSTRIPESPARALLELEXTERNAL_H
 #define ALLKNNRESULTSTRIPESPARALLELEXTERNAL_H
-#include <stxxl/sort>
+#include <future>
+#include <omp.h>
 #include "AllKnnResultStripes.h"
 #include "StripesWindow.h"
+#include "PendingPoints.h"
+#include "NeighborsOutputBuffer.h"
 #include "AllKnnProblemExternal.h"
-
-/** \brief Comparer for sorting points by y
- */
-struct ExternalPointComparerY
-{
-    Point minval = {0, 0.0, -0.00000001};
-    Point maxval = {0, 0.0, 1.00000001};
-
-    bool operator()(const Point& point1, const Point& point2) const
-    {
-        return point1.y < point2.y;
-    }
-
-    const Point& min_value() const
-    {
-        return minval;
-    }
-
-    const Point& max_value() const
-    {
-        return maxval;
-    }
-};
+#include "ResultSink.h"
 
 /** \brief Comparer for sorting points by x
  */
 struct ExternalPointComparerX
 {
-    Point minval = {0, -0.00000001, 0.0};
-    Point maxval = {0, 1.00000001, 0.0};
+    Point minval = {0, std::numeric_limits<double>::lowest(), 0.0};
+    Point maxval = {0, std::numeric_limits<double>::max(), 0.0};
 
     bool operator()(const Point& point1, const Point& point2) const
     {
@@ -52,28 +33,19 @@ struct ExternalPointComparerX
     }
 };
 
-/** \brief Comparer for sorting neighbors by input point id and neighbor rank
- *          This is used for sorting the result of the algorithm
+/** \brief Range of stripes of a window and its estimated memory, calculated before the window is loaded
  */
-struct ExternalNeighborComparer
+struct StripesWindowPlan
 {
-    NeighborExt minval = {0, 0.0, 0, 0};
-    NeighborExt maxval = {0, 0.0, ULONG_MAX, UINT_MAX};
-
-    bool operator()(const NeighborExt& neighbor1, const NeighborExt& neighbor2) const
-    {
-        return neighbor1.inputPointId < neighbor2.inputPointId || ( (neighbor1.inputPointId == neighbor2.inputPointId) && (neighbor1.position < neighbor2.position) );
-    }
-
-    const NeighborExt& min_value() const
-    {
-        return minval;
-    }
-
-    const NeighborExt& max_value() const
-    {
-        return maxval;
-    }
+    size_t startStripe;
+    size_t endStripe;
+    bool secondPass;
+    size_t memory;
+    size_t memoryGrowth; /**< part of the memory allocated while the window is processed */
+    bool isValid;
+    size_t haloStripes; /**< number of stripes at the start of the window loaded with training points only */
+    std::vector<bool> loadTraining; /**< second phase only, false for stripes that no pending point needs to search */
+    size_t missingMemory; /**< memory to release before the first stripe fits, if the window is not valid */
 };
 
 /** \brief Class definition of AkNN result of striped plane sweep algorithm (external memory)
@@ -86,8 +58,10 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         {
         }
 
-        AllKnnResultStripesParallelExternal(const AllKnnProblemExternal& problem, const std::string& filePrefix, bool parallelSort, bool splitByT)
-            : AllKnnResult(problem, filePrefix), splitByT(splitByT), parallelSort(parallelSort), problemExt(problem)
+        AllKnnResultStripesParallelExternal(const AllKnnProblemExternal& problem, const std::string& filePrefix, bool parallelSort, bool splitByT,
+                                            bool prefetchWindows, bool haloWindows)
+            : AllKnnResult(problem, filePrefix), splitByT(splitByT), parallelSort(parallelSort), prefetchWindows(prefetchWindows), haloWindows(haloWindows),
+              problemExt(problem)
         {
         }
 
@@ -95,6 +69,17 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         {
         }
 
+        /** \brief Sets the sink that receives the neighbors of the points completed by each window, instead of the output vector
+         *
+         * \param pSink ResultSink* the sink, or nullptr to store the neighbors in the output vector
+         * \return void
+         *
+         */
+        void SetResultSink(ResultSink* pSink)
+        {
+            pResultSink = pSink;
+        }
+
         /** \brief Splits the datasets into stripes
          *
          * \param numStripes size_t the desired number of stripes
@@ -103,18 +88,11 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
          */
         size_t SplitStripes(size_t numStripes)
         {
-            //copy both datasets
-            ext_point_vector_t inputDatasetSortedY(problemExt.GetExtInputDataset());
-            ext_point_vector_t trainingDatasetSortedY(problemExt.GetExtTrainingDataset());
+            ProfileScope profileScope(ProfilePhase::SplitStripes);
 
-            //calculate memory limit based on variables
-            size_t usedMemory = 4*64*1024*1024;
-            auto memoryLimit = problemExt.GetMemoryLimitBytes();
-            auto safeMemoryLimit = memoryLimit - usedMemory;
-
-            //call external memory sort routine of STXXL library
-            stxxl::sort(inputDatasetSortedY.cbegin(), inputDatasetSortedY.cend(), ExternalPointComparerY(), safeMemoryLimit);
-            stxxl::sort(trainingDatasetSortedY.cbegin(), trainingDatasetSortedY.cend(), ExternalPointComparerY(), safeMemoryLimit);
+            //the datasets of the problem are already sorted by y, they have been sorted while loading
+            const ext_point_vector_t& inputDatasetSortedY = problemExt.GetExtInputDataset();
+            const ext_point_vector_t& trainingDatasetSortedY = problemExt.GetExtTrainingDataset();
 
             //check if specific number of stripes has been requested
             if (numStripes > 0)
@@ -133,157 +111,119 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         }
 
         /** \brief Returns a set of stripes that fits into RAM
-         *
+         *          The window is loaded by the calling thread, so the whole loading time is recorded as I/O wait.
+         *          In the second phase the window starts from the highest stripe that pending points need to search, stripes that are not needed are skipped.
          * \param fromStripe size_t index of starting stripe
          * \param secondPass bool true if this is the second phase of the algorithm (higher to lower y)
-         * \return unique_ptr<StripesWindow> the window of stripes
+         * \return unique_ptr<StripesWindow> the window of stripes or nullptr if no stripes are needed in the second phase
          *
          */
         std::unique_ptr<StripesWindow> GetWindow(size_t fromStripe, bool secondPass)
         {
-            auto memoryLimit = problemExt.GetMemoryLimitBytes();
-            auto safeMemoryLimit = 9*memoryLimit/10;
-
-            size_t numNeighbors = problem.GetNumNeighbors();
-            size_t numStripes = pStripeBoundaries->size();
-            //estimation of required memory based on variables, this is an approximation with some safety factors
-            size_t usedMemory = (pPendingPoints->size()*(sizeof(unsigned long) + sizeof(StripePoint)))
-                                + (pPendingNeighborsContainer->size()*(sizeof(unsigned long) + sizeof(PointNeighbors<neighbors_priority_queue_t>) + numNeighbors*sizeof(Neighbor)))
-                                + (pPendingPoints->size()*(sizeof(Point)))
-                                + 2*(pPendingPoints->size()*(2*sizeof(void*)))
-                                + 4*numStripes*sizeof(size_t)
-                                + numStripes*sizeof(StripeBoundaries_t)
-                                + 6*64*1024*1024;
-
-            std::cout << "pending points " << pPendingPoints->size() << " " << pPendingNeighborsContainer->size() << std::endl;
-            std::cout << "reserved memory " << usedMemory << std::endl;
+            if (secondPass && !pPendingPoints->FindDownStripe(fromStripe, fromStripe))
+                return std::unique_ptr<StripesWindow>(nullptr);
 
-            if (secondPass)
-            {
-                //in the second phase we return training points only
-                size_t endStripe = fromStripe;
-                size_t startStripe = endStripe + 1;
+            ProfileSample waitStart = PhaseProfiler::Now();
 
-                //find how many stripes can fit into available memory
-                do
-                {
-                    //add stripes of training points until we reach the memory limit
-                    size_t sizeTraining = (pTrainingStripeCount->at(startStripe - 1))*sizeof(Point);
+            //with prefetching the window takes half of the available memory, so the next window can be loaded while this one is in process
+            StripesWindowPlan plan = PlanWindow(fromStripe, secondPass, 0, prefetchWindows);
 
-                    if (usedMemory + sizeTraining <= safeMemoryLimit)
-                    {
-                        usedMemory += sizeTraining;
-                        --startStripe;
-                    }
-                    else
-                        break;
-                } while (startStripe > 0);
+            //if even a single stripe does not fit into half of the memory, the window takes all of it and the next one is not prefetched
+            if (!plan.isValid)
+                plan = PlanWindow(fromStripe, secondPass, 0, false);
 
-                if (endStripe < startStripe)
-                {
-                    //we cannot allocate even a single stripe so the algorithm reports memory allocation error
-                    //this can happen if we have too many pending points
-                    hasAllocationError = true;
-                    return std::unique_ptr<StripesWindow>(nullptr);
-                }
+            //if there are too many pending points, the points that are needed later are written to external memory
+            if (!plan.isValid && SpillPendingPoints(fromStripe, secondPass))
+                plan = PlanWindow(fromStripe, secondPass, 0, false);
 
-                size_t numWindowStripes = endStripe - startStripe + 1;
-                std::unique_ptr<point_vector_vector_t> pTrainingStripes(new point_vector_vector_t(numWindowStripes));
-                std::unique_ptr<std::vector<StripeBoundaries_t>> pBoundaries(new std::vector<StripeBoundaries_t>(numWindowStripes));
+            if (!plan.isValid)
+            {
+                //we cannot allocate even a single stripe after spilling the pending points so the algorithm reports memory allocation error
+                hasAllocationError = true;
+                return std::unique_ptr<StripesWindow>(nullptr);
+            }
 
-                //add stripes to current window until we reach the memory limit
-                for (size_t iStripe = startStripe; iStripe <= endStripe; ++iStripe)
-                {
-                    auto& trainingPoints = pTrainingStripes->at(iStripe-startStripe);
-                    auto& boundaries = pBoundaries->at(iStripe-startStripe);
+            auto pWindow = LoadWindow(plan);
+            AcceptWindow(*pWindow, waitStart, false);
+            return pWindow;
+        }
 
-                    if (pTrainingStripeCount->at(iStripe) > 0)
-                    {
-                        auto trainingStart = pStripedTrainingDataset->cbegin() + pTrainingStripeOffset->at(iStripe);
-                        auto trainingEnd = trainingStart + pTrainingStripeCount->at(iStripe);
-                        trainingPoints.reserve(pTrainingStripeCount->at(iStripe));
-                        std::copy(trainingStart, trainingEnd, std::back_inserter(trainingPoints));
-                    }
+        /** \brief Starts loading the window that follows the given window in a background thread
+         *          The next window is loaded only if it fits into RAM together with the given window, which is still in process
+         * \param window const StripesWindow& the window of stripes that is going to be processed
+         * \return void
+         *
+         */
+        void PrefetchNextWindow(const StripesWindow& window)
+        {
+            size_t fromStripe = 0;
+            if (!prefetchWindows || !GetNextStripe(window.GetStartStripe(), window.GetEndStripe(), window.IsSecondPass(), fromStripe))
+                return;
 
-                    //store the boundaries of each stripe
-                    boundaries.minY = pStripeBoundaries->at(iStripe).minY;
-                    boundaries.maxY = pStripeBoundaries->at(iStripe).maxY;
-                }
+            //in the second phase the next window starts from the highest stripe that pending points need to search, like GetWindow
+            //the points of the given window are still in its buckets and they may continue to the stripe below it
+            if (window.IsSecondPass())
+            {
+                size_t pendingStripe = 0;
+                if (!pPendingPoints->FindDownStripe(window.GetEndStripe(), pendingStripe))
+                    return;
 
-                std::unique_ptr<StripesWindow> pWindow(new StripesWindow(startStripe, endStripe, pTrainingStripes, pBoundaries));
-                ++numSecondPassWindows;
-                return pWindow;
+                fromStripe = std::min(fromStripe, pendingStripe);
             }
-            else
-            {
-                //this is the first phase of the algorithm, we return input and training point stripes
-                size_t startStripe = fromStripe;
-                size_t endStripe = startStripe;
 
-                //find how many stripes can fit into available memory
-                do
-                {
-                    size_t sizeInput = (pInputStripeCount->at(endStripe))*sizeof(Point);
-                    size_t sizeTraining = (pTrainingStripeCount->at(endStripe))*sizeof(Point);
-                    size_t sizeNeighbors = (pInputStripeCount->at(endStripe))*(sizeof(PointNeighbors<neighbors_priority_queue_t>) + numNeighbors*sizeof(Neighbor));
-                    size_t additionalMemory = sizeInput + sizeTraining + sizeNeighbors;
+            //the loaded stripes of the current window are measured, the memory it allocates while it is processed is reserved
+            //the next window takes the rest of the memory, which is about half of it since the current window has been planned with double buffering
+            StripesWindowPlan plan = PlanWindow(fromStripe, window.IsSecondPass(), window.GetMemoryGrowth(), false);
 
-                    if (usedMemory + additionalMemory <= safeMemoryLimit)
+            if (plan.isValid)
+            {
+                futureWindow = std::async(std::launch::async, [this, plan]()
                     {
-                        usedMemory += additionalMemory;
-                        ++endStripe;
-                    }
-                    else
-                        break;
-                } while (endStripe <= numStripes - 1);
-
-                if (endStripe <= startStripe)
-                {
-                    //we cannot allocate even a single stripe so the algorithm reports memory allocation error
-                    //this can happen if we have too many pending points
-                    hasAllocationError = true;
-                    return std::unique_ptr<StripesWindow>(nullptr);
-                }
-
-                size_t numWindowStripes = endStripe - startStripe;
-
-                std::unique_ptr<point_vector_vector_t> pInputStripes(new point_vector_vector_t(numWindowStripes)), pTrainingStripes(new point_vector_vector_t(numWindowStripes));
-                std::unique_ptr<std::vector<StripeBoundaries_t>> pBoundaries(new std::vector<StripeBoundaries_t>(numWindowStripes));
+                        return LoadWindow(plan);
+                    });
+            }
+        }
 
-                //add stripes to current window until we reach the memory limit
-                for (size_t iStripe = startStripe; iStripe < endStripe; ++iStripe)
-                {
-                    auto& inputPoints = pInputStripes->at(iStripe-startStripe);
-                    auto& trainingPoints = pTrainingStripes->at(iStripe-startStripe);
-                    auto& boundaries = pBoundaries->at(iStripe-startStripe);
+        /** \brief Returns the window that follows a processed window, it waits for the background loading if it has been started
+         *          If the window has not been prefetched, it is loaded by the calling thread
+         * \param startStripe size_t the starting stripe of the processed window
+         * \param endStripe size_t the ending stripe of the processed window
+         * \param secondPass bool true if the processed window belongs to the second phase
+         * \return unique_ptr<StripesWindow> the next window or nullptr if there are no more windows in this phase
+         *
+         */
+        std::unique_ptr<StripesWindow> GetNextWindow(size_t startStripe, size_t endStripe, bool secondPass)
+        {
+            size_t fromStripe = 0;
+            if (!GetNextStripe(startStripe, endStripe, secondPass, fromStripe))
+                return std::unique_ptr<StripesWindow>(nullptr);
 
-                    //add input point stripes
-                    if (pInputStripeCount->at(iStripe) > 0)
-                    {
-                        auto inputStart = pStripedInputDataset->cbegin() + pInputStripeOffset->at(iStripe);
-                        auto inputEnd = inputStart + pInputStripeCount->at(iStripe);
-                        inputPoints.reserve(pInputStripeCount->at(iStripe));
-                        std::copy(inputStart, inputEnd, std::back_inserter(inputPoints));
-                    }
+            if (!futureWindow.valid())
+                return GetWindow(fromStripe, secondPass);
 
-                    //add training point stripes
-                    if (pTrainingStripeCount->at(iStripe) > 0)
-                    {
-                        auto trainingStart = pStripedTrainingDataset->cbegin() + pTrainingStripeOffset->at(iStripe);
-                        auto trainingEnd = trainingStart + pTrainingStripeCount->at(iStripe);
-                        trainingPoints.reserve(pTrainingStripeCount->at(iStripe));
-                        std::copy(trainingStart, trainingEnd, std::back_inserter(trainingPoints));
-                    }
+            ProfileSample waitStart = PhaseProfiler::Now();
+            auto pWindow = futureWindow.get();
+            AcceptWindow(*pWindow, waitStart, true);
+            return pWindow;
+        }
 
-                    //store the boundaries of each stripe
-                    boundaries.minY = pStripeBoundaries->at(iStripe).minY;
-                    boundaries.maxY = pStripeBoundaries->at(iStripe).maxY;
-                }
+        /** \brief Records the timings of a processed window for reporting purposes
+         *          The I/O wait, the loading and the computation of each window are also recorded as events of the phase profiler
+         * \param window StripesWindow& the processed window
+         * \param computeStart const ProfileSample& the start of the plane sweep of the window
+         * \param computeFinish const ProfileSample& the finish of the commit of the window
+         * \return void
+         *
+         */
+        void RecordWindowTimes(StripesWindow& window, const ProfileSample& computeStart, const ProfileSample& computeFinish)
+        {
+            std::chrono::duration<double> elapsedCompute(computeFinish.time - computeStart.time);
+            PhaseProfiler::Record(ProfilePhase::WindowCompute, computeStart, computeFinish, long(window.GetStartStripe()));
 
-                std::unique_ptr<StripesWindow> pWindow(new StripesWindow(startStripe, endStripe-1, pInputStripes, pTrainingStripes, pBoundaries, numNeighbors));
-                ++numFirstPassWindows;
-                return pWindow;
-            }
+            window.SetDurationCompute(elapsedCompute);
+            totalElapsedIOWait += window.GetDurationIOWait();
+            totalElapsedLoad += window.GetDurationLoad();
+            totalElapsedCompute += elapsedCompute;
         }
 
         /** \brief Returns true if an allocation error happened
@@ -296,91 +236,41 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             return hasAllocationError;
         }
 
-        /** \brief Returns a list of pending points to be examined for a specified window
-         *
+        /** \brief Returns the pending points to be examined for a specified window
+         *          In the first phase these are the points that need to search the stripes of the window to higher y,
+         *          in the second phase the points that need to search them to lower y. The points are moved out of their buckets
+         *          and they are added again, if needed, by the commit of the window.
          * \param window const StripesWindow& the window of stripes that is currently in process
-         * \return unique_ptr<point_vector_t> the vector of pending points
-         *
-         */
-        std::unique_ptr<point_vector_t> GetPendingPointsForWindow(const StripesWindow& window)
-        {
-            std::unique_ptr<point_vector_t> pPoints(new point_vector_t());
-            pPoints->reserve(pPendingPoints->size());
-            auto pendingPointsBegin = pPendingPoints->cbegin();
-            auto pendingPointsEnd = pPendingPoints->cend();
-
-            if (window.IsSecondPass())
-            {
-                size_t startStripe = window.GetStartStripe();
-
-                //for second phase we want to examine all pending points except those
-                // with neighbors having a low stripe lower than the first stripe of current window
-                for (auto pendingIter = pendingPointsBegin; pendingIter != pendingPointsEnd; ++pendingIter)
-                {
-                    auto pointId = pendingIter->second.id;
-                    //find the neighbors of pending points by looking at a hash table
-                    auto& neighbors = pPendingNeighborsContainer->at(pointId);
-                    //get the lowest stripe examined so far
-                    size_t lowStripe = neighbors.getLowStripe();
-
-                    //if lowest stripe examined is lower than the first stripe of current window,
-                    //we do not need to examine this pending point
-                    if (lowStripe > startStripe)
-                    {
-                        pPoints->push_back({pendingIter->second.id, pendingIter->second.x, pendingIter->second.y});
-                    }
-                }
-            }
-            else
-            {
-                size_t endStripe = window.GetEndStripe();
-
-                //for first phase we want all pending points
-                for (auto pendingIter = pendingPointsBegin; pendingIter != pendingPointsEnd; ++pendingIter)
-                {
-                    auto pointId = pendingIter->second.id;
-                    //find the neighbors of pending points by looking at a hash table
-                    auto& neighbors = pPendingNeighborsContainer->at(pointId);
-                    //get the highest stripe examined so far
-                    size_t highStripe = neighbors.getHighStripe();
-
-                    //if highest stripe examined is higher than the last stripe of current window,
-                    //we do not need to examine this pending point
-                    if (highStripe < endStripe)
-                    {
-                        pPoints->push_back({pointId, pendingIter->second.x, pendingIter->second.y});
-                    }
-                }
-            }
-
-            return pPoints;
-        }
-
-        /** \brief Returns the hash table of neighbors fo pending points
-         *
-         * \return pointNeighbors_priority_queue_map_t&
+         * \return unique_ptr<PendingPointsBucket> the pending points and their neighbors
          *
          */
-        pointNeighbors_priority_queue_map_t& GetPendingNeighborsContainer()
+        std::unique_ptr<PendingPointsBucket> GetPendingPointsForWindow(const StripesWindow& window)
         {
-            return *pPendingNeighborsContainer;
+            //the halo stripes have been searched to higher y by previous windows
+            return pPendingPoints->Take(window.GetStartStripe() + window.GetNumHaloStripes(), window.GetEndStripe(), window.IsSecondPass());
         }
 
         /** \brief Transfers all the completed points to STXXL vectors. It checks points in the given window and pending points
-         *
+         *          Input point ids are 1..N and each point has exactly k neighbors, so the neighbors of a point are written directly
+         *          to their final position. They are buffered by block of the output vector, so each block is written once when it is complete.
+         *          The points are examined and their neighbors are extracted by all threads, only the writing to the STXXL vectors is serial.
          * \param window StripesWindow& the window of stripes to examine
-         * \param pendingPoints point_vector_t& the list of pending points to examine
+         * \param pendingPoints PendingPointsBucket& the pending points taken by the window
          * \return void
          *
          */
-        void CommitWindow(StripesWindow& window, point_vector_t& pendingPoints)
+        void CommitWindow(StripesWindow& window, PendingPointsBucket& pendingPoints)
         {
+            //the neighbors of the completed points are moved to their final position, so the commit is a part of the finalization
+            ProfileScope profileScope(ProfilePhase::Finalize);
             auto commitStart = std::chrono::high_resolution_clock::now();
 
-            if (pNeighborsExtVector == nullptr)
+            if (pNeighborsExtVector == nullptr && pResultSink == nullptr)
             {
+                //the output vector holds k neighbors for every input point
                 pNeighborsExtVector.reset(new ext_neighbors_vector_t());
-                pNeighborsExtVector->reserve(problem.GetNumNeighbors()*problem.GetInputDatasetSize());
+                pNeighborsExtVector->resize(problem.GetNumNeighbors()*problem.GetInputDatasetSize());
+                pNeighborsOutputBuffer.reset(new NeighborsOutputBuffer(*pNeighborsExtVector, GetOutputBufferMemory()/(sizeof(NeighborRecord) + sizeof(NeighborsPiece))));
             }
 
             if (pHeapAdditionsVector == nullptr)
@@ -389,93 +279,154 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
                 pHeapAdditionsVector->reserve(problem.GetInputDatasetSize());
             }
 
-            auto pendingPointsBegin = pendingPoints.cbegin();
-            auto pendingPointsEnd = pendingPoints.cend();
+            typedef std::pair<point_id_t, PointNeighbors<neighbors_priority_queue_t>*> completed_point_t;
 
-            //check pending list for any completed points
-            for (auto pendingPointsIter = pendingPointsBegin; pendingPointsIter < pendingPointsEnd; ++pendingPointsIter)
+            //each thread keeps a list of the completed points and a list of the points that remain pending
+            int numThreads = omp_get_max_threads();
+            std::vector<std::vector<completed_point_t>> threadCompletedPoints(numThreads);
+            std::vector<std::vector<pending_point_t>> threadPendingPoints(numThreads);
+
+            bool isSecondPass = window.IsSecondPass();
+            size_t numPendingPoints = pendingPoints.size();
+
+            //distances of the k-th neighbor of the input points of the window, used for the depth of the halo
+            double sumDistance = 0.0;
+            double sumSquaredDistance = 0.0;
+            size_t numDistances = 0;
+
+            #pragma omp parallel num_threads(numThreads)
             {
-                auto pointId = pendingPointsIter->id;
-                auto& pointNeighbors = pPendingNeighborsContainer->at(pointId);
-                //check if search has been completed
-                if (IsSearchCompleted(pointNeighbors))
-                {
-                    //transfer heap statistics
-                    pHeapAdditionsVector->push_back(pointNeighbors.GetNumAdditions());
+                int iThread = omp_get_thread_num();
+                auto& completedPoints = threadCompletedPoints[iThread];
+                auto& remainingPoints = threadPendingPoints[iThread];
 
-                    unsigned int neighborPosition = 0;
+                //check pending points for any completed points
+                #pragma omp for schedule(dynamic, 100) nowait
+                for (size_t iPoint = 0; iPoint < numPendingPoints; ++iPoint)
+                {
+                    auto& point = pendingPoints.points[iPoint];
+                    auto& pointNeighbors = pendingPoints.neighbors[iPoint];
+                    //check if search has been completed
+                    if (IsSearchCompleted(pointNeighbors))
+                        completedPoints.emplace_back(point.id, &pointNeighbors);
+                    else
+                        remainingPoints.emplace_back(&point, &pointNeighbors);
+                }
 
-                    while (pointNeighbors.HasNext())
+                if (!isSecondPass)
+                {
+                    //check window of stripes for completed points
+                    auto stripeData = window.GetStripeData();
+                    auto& neighborsContainer = window.GetNeighborsContainer();
+                    size_t numWindowStripes = window.GetNumStripes();
+
+                    //examine all stripes of the window
+                    #pragma omp for schedule(dynamic) reduction(+:sumDistance,sumSquaredDistance,numDistances) nowait
+                    for (size_t iWindowStripe = 0; iWindowStripe < numWindowStripes; ++iWindowStripe)
                     {
-                        Neighbor neighbor = pointNeighbors.Next();
+                        auto& inputDataset = stripeData.InputDatasetStripe[iWindowStripe];
+                        size_t numInputPoints = inputDataset.size();
+
+                        if (numInputPoints > 0)
+                        {
+                            auto& stripeNeighbors = neighborsContainer.at(iWindowStripe);
+
+                            for (size_t iPoint=0; iPoint < numInputPoints; ++iPoint)
+                            {
+                                auto& pointNeighbors = stripeNeighbors[iPoint];
+                                auto& point = inputDataset[iPoint];
 
-                        //we need to store the input point id and rank so we can later sort the neighbors
-                        NeighborExt extNeighbor = {neighbor.pointId, neighbor.distanceSquared, pointId, neighborPosition};
+                                if (haloWindows && pointNeighbors.MaxDistanceElement().pointId != 0)
+                                {
+                                    double distance = sqrt(pointNeighbors.MaxDistanceElement().distanceSquared);
+                                    sumDistance += distance;
+                                    sumSquaredDistance += distance*distance;
+                                    ++numDistances;
+                                }
 
-                        //store the neighbors in external memory vector
-                        pNeighborsExtVector->push_back(extNeighbor);
-                        ++neighborPosition;
+                                if (IsSearchCompleted(pointNeighbors))
+                                    completedPoints.emplace_back(point.id, &pointNeighbors);
+                                else
+                                    remainingPoints.emplace_back(&point, &pointNeighbors);
+                            }
+                        }
                     }
-                    //remove pending points and neighbors from RAM
-                    pPendingPoints->erase(pointId);
-                    pPendingNeighborsContainer->erase(pointId);
                 }
             }
 
-            bool isSecondPass = window.IsSecondPass();
-            if (!isSecondPass)
-            {
-                //check window of stripes for completed points
-                auto stripeData = window.GetStripeData();
-                auto& neighborsContainer = window.GetNeighborsContainer();
-                size_t numWindowStripes = window.GetNumStripes();
-                size_t windowStartStripe = window.GetStartStripe();
-
-                //examine all stripes of the window
-                for (size_t iWindowStripe = 0; iWindowStripe < numWindowStripes; ++iWindowStripe)
+            sumKthDistance += sumDistance;
+            sumSquaredKthDistance += sumSquaredDistance;
+            numKthDistances += numDistances;
+
+            //if search of neighbors has not been completed, move the point and its so far found neighbors to the bucket of the next stripe to search
+            //the lists of the threads are added concurrently (this does not move the heaps of the completed points, so the collected pointers remain valid)
+            pPendingPoints->AddParallel(threadPendingPoints);
+
+            //the points taken by the window have been either added again or completed
+            pPendingPoints->Release(numPendingPoints);
+
+            //merge the lists of all threads and sort by id, so the output vector is written in increasing position
+            std::vector<completed_point_t> completedPoints;
+            size_t numCompletedPoints = 0;
+            for (auto& points : threadCompletedPoints)
+                numCompletedPoints += points.size();
+
+            completedPoints.reserve(numCompletedPoints);
+            for (auto& points : threadCompletedPoints)
+                completedPoints.insert(completedPoints.end(), points.cbegin(), points.cend());
+
+            tbb::parallel_sort(completedPoints.begin(), completedPoints.end(), [](const completed_point_t& point1, const completed_point_t& point2)
                 {
-                    auto& inputDataset = stripeData.InputDatasetStripe[iWindowStripe];
-                    size_t numInputPoints = inputDataset.size();
+                    return point1.first < point2.first;
+                });
 
-                    if (numInputPoints > 0)
-                    {
-                        auto& stripeNeighbors = neighborsContainer.at(iWindowStripe);
+            size_t numNeighbors = problem.GetNumNeighbors();
 
-                        for (size_t iPoint=0; iPoint < numInputPoints; ++iPoint)
-                        {
-                            auto& pointNeighbors = stripeNeighbors[iPoint];
-                            auto& point = inputDataset[iPoint];
-                            unsigned long pointId = point.id;
+            //the neighbors are extracted in batches that fit into a buffer of fixed size
+            size_t batchSize = std::max<size_t>(1, COMMIT_BUFFER_NEIGHBORS/numNeighbors);
+            std::vector<Neighbor> neighborsBuffer(std::min(batchSize, numCompletedPoints)*numNeighbors);
+            std::vector<size_t> heapAdditionsBuffer(std::min(batchSize, numCompletedPoints));
 
-                            if (IsSearchCompleted(pointNeighbors))
-                            {
-                                //transfer heap statistics
-                                pHeapAdditionsVector->push_back(pointNeighbors.GetNumAdditions());
+            for (size_t batchStart = 0; batchStart < numCompletedPoints; batchStart += batchSize)
+            {
+                size_t batchEnd = std::min(batchStart + batchSize, numCompletedPoints);
 
-                                unsigned int neighborPosition = 0;
+                //each thread pops the heaps of its points to their own part of the buffer
+                #pragma omp parallel for schedule(dynamic, 64) num_threads(numThreads)
+                for (size_t iPoint = batchStart; iPoint < batchEnd; ++iPoint)
+                {
+                    auto& pointNeighbors = *completedPoints[iPoint].second;
+                    heapAdditionsBuffer[iPoint - batchStart] = pointNeighbors.GetNumAdditions();
 
-                                while (pointNeighbors.HasNext())
-                                {
-                                    Neighbor neighbor = pointNeighbors.Next();
+                    auto bufferIter = neighborsBuffer.begin() + (iPoint - batchStart)*numNeighbors;
 
-                                    //we need to store the input point id and rank so we can later sort the neighbors
-                                    NeighborExt extNeighbor = {neighbor.pointId, neighbor.distanceSquared, pointId, neighborPosition};
+                    //with a result sink, the neighbors are passed to the sink in ascending distance and they are not stored
+                    if (pResultSink != nullptr)
+                    {
+                        pointNeighbors.CopySortedNeighbors(&*bufferIter);
+                        pResultSink->Consume(completedPoints[iPoint].first, &*bufferIter, numNeighbors);
+                        continue;
+                    }
 
-                                    //store the neighbors in external memory vector
-                                    pNeighborsExtVector->push_back(extNeighbor);
-                                    ++neighborPosition;
-                                }
-                            }
-                            else
-                            {
-                                //if search of neighbors has not been completed, move the point and its so far found neighbors in the pending points list
-                                StripePoint stripePoint = {pointId, point.x, point.y, iWindowStripe + windowStartStripe};
-                                pPendingPoints->emplace(pointId, stripePoint);
-                                pPendingNeighborsContainer->emplace(pointId, std::move(pointNeighbors));
-                            }
-                        }
+                    while (pointNeighbors.HasNext())
+                    {
+                        *bufferIter = pointNeighbors.Next();
+                        ++bufferIter;
                     }
                 }
+
+                //a single thread writes the batch to the STXXL vectors, the neighbors are written when their blocks are complete
+                for (size_t iPoint = batchStart; iPoint < batchEnd; ++iPoint)
+                {
+                    //transfer heap statistics
+                    pHeapAdditionsVector->push_back(heapAdditionsBuffer[iPoint - batchStart]);
+
+                    if (pResultSink != nullptr)
+                        continue;
+
+                    //the neighbors of point with id i are stored at positions (i-1)*k to i*k-1, in the order they are popped from the heap
+                    pNeighborsOutputBuffer->Add(completedPoints[iPoint].first, &neighborsBuffer[(iPoint - batchStart)*numNeighbors], numNeighbors);
+                }
             }
 
             //we record the time for reporting purposes
@@ -484,29 +435,27 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             totalElapsedCommit += elapsed;
         }
 
-        /** \brief Sorts the final result by input point id and neighbor rank
+        /** \brief Writes the buffered and the cached blocks of the result to disk, the result is already in order of input point id
          *
          * \return void
          *
          */
-        void SortNeighbors()
+        void FlushNeighbors()
         {
-            if (hasAllocationError)
+            if (hasAllocationError || pNeighborsExtVector == nullptr)
                 return;
 
-            auto memoryLimit = problemExt.GetMemoryLimitBytes();
-            size_t numStripes = pStripeBoundaries->size();
-            size_t usedMemory = 4*numStripes*sizeof(size_t)
-                                + numStripes*sizeof(StripeBoundaries_t)
-                                + 6*64*1024*1024;
-
-            auto safeMemoryLimit = (memoryLimit - usedMemory);
+            ProfileScope profileScope(ProfilePhase::Finalize);
+            auto flushStart = std::chrono::high_resolution_clock::now();
+            if (pNeighborsOutputBuffer != nullptr)
+            {
+                pNeighborsOutputBuffer->Flush();
+                pNeighborsOutputBuffer.reset();
+            }
 
-            auto finalSortStart = std::chrono::high_resolution_clock::now();
-            //call the STXXL sort routine to sort neighbors
-            stxxl::sort(pNeighborsExtVector->cbegin(), pNeighborsExtVector->cend(), ExternalNeighborComparer(), safeMemoryLimit);
-            auto finalSortEnd = std::chrono::high_resolution_clock::now();
-            elapsedFinalSorting = finalSortEnd - finalSortStart;
+            pNeighborsExtVector->flush();
+            auto flushEnd = std::chrono::high_resolution_clock::now();
+            elapsedOutputFlush = flushEnd - flushStart;
         }
 
         size_t getNumPendingPoints() override
@@ -514,6 +463,16 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             return pPendingPoints->size();
         }
 
+        /** \brief Returns the number of pending points written to external memory
+         *
+         * \return size_t
+         *
+         */
+        size_t getNumSpilledPoints() const override
+        {
+            return pPendingPoints != nullptr ? pPendingPoints->GetNumSpilledPoints() : 0;
+        }
+
         size_t getNumStripes() override
         {
             if (pStripeBoundaries != nullptr)
@@ -531,9 +490,44 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             return totalElapsedCommit;
         }
 
-        const std::chrono::duration<double> getDurationFinalSorting() const override
+        /** \brief Returns the time spent in writing the rest of the result to disk after the last window
+         *
+         * \return const std::chrono::duration<double>
+         *
+         */
+        const std::chrono::duration<double> getDurationOutputFlush() const override
+        {
+            return elapsedOutputFlush;
+        }
+
+        /** \brief Returns the total time the algorithm waited for windows to be loaded
+         *
+         * \return const std::chrono::duration<double>
+         *
+         */
+        const std::chrono::duration<double> getDurationWindowIOWait() const override
+        {
+            return totalElapsedIOWait;
+        }
+
+        /** \brief Returns the total time spent in loading windows, including loading in the background
+         *
+         * \return const std::chrono::duration<double>
+         *
+         */
+        const std::chrono::duration<double> getDurationWindowLoad() const override
+        {
+            return totalElapsedLoad;
+        }
+
+        /** \brief Returns the total time spent in processing windows
+         *
+         * \return const std::chrono::duration<double>
+         *
+         */
+        const std::chrono::duration<double> getDurationWindowCompute() const override
         {
-            return elapsedFinalSorting;
+            return totalElapsedCompute;
         }
 
         /** \brief Returns the number of windows processed in the first phase
@@ -556,114 +550,185 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             return numSecondPassWindows;
         }
 
-        /** \brief Saves neighbors found for each input point to a text file
+        /** \brief Returns the total number of training points loaded by all windows, including the halo stripes
          *
+         * \return size_t
+         *
+         */
+        size_t getNumLoadedTrainingPoints() const override
+        {
+            return numLoadedTrainingPoints;
+        }
+
+        /** \brief Saves neighbors found for each input point to a text file
+         *          The neighbors are read in chunks by a streaming reader, each chunk is formatted in parallel and written while the next one is read
          */
         void SaveToFile() const override
         {
             if (hasAllocationError)
                 return;
 
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(getDuration());
-
-            auto now = std::chrono::system_clock::now();
-            auto in_time_t = std::chrono::system_clock::to_time_t(now);
+            std::ofstream outFile(GetOutputFilename(".txt"), std::ios_base::out);
 
-            std::stringstream ss;
-            ss << filePrefix << "_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << "_" << ms.count() << ".txt";
-
-            std::ofstream outFile(ss.str(), std::ios_base::out);
-
-            size_t numInputPoints = problem.GetInputDatasetSize();
             size_t numNeighbors = problem.GetNumNeighbors();
-            size_t pos = 0;
-
-            for (size_t pointId = 1; pointId <=  numInputPoints; ++pointId)
-            {
-                outFile << pointId;
+            int numThreads = omp_get_max_threads();
 
-                for (size_t iNeighbor=0; iNeighbor < numNeighbors; ++iNeighbor)
+            ForEachNeighborsChunk([&](size_t startPoint, size_t numPoints, const std::vector<Neighbor>& neighbors)
                 {
-                    auto& neighbor = pNeighborsExtVector->at(pos);
+                    //each part of the chunk is formatted by a thread into its own text, the texts are written in order
+                    std::vector<std::string> texts(numThreads);
 
-                    if (neighbor.pointId > 0)
-                    {
-                        outFile << "\t(" << neighbor.pointId << " " << neighbor.distanceSquared << ")";
-                    }
-                    else
+                    #pragma omp parallel for schedule(static) num_threads(numThreads)
+                    for (int iPart = 0; iPart < numThreads; ++iPart)
                     {
-                        outFile << "\t(" << "NULL" << " " << neighbor.distanceSquared << ")";
-                    }
+                        std::ostringstream text;
+                        size_t partStart = numPoints*iPart/numThreads;
+                        size_t partEnd = numPoints*(iPart + 1)/numThreads;
 
-                    ++pos;
-                }
+                        for (size_t iPoint = partStart; iPoint < partEnd; ++iPoint)
+                        {
+                            text << startPoint + iPoint + 1;
 
-                outFile << std::endl;
-            }
+                            for (size_t iNeighbor=0; iNeighbor < numNeighbors; ++iNeighbor)
+                            {
+                                auto& neighbor = neighbors[iPoint*numNeighbors + iNeighbor];
 
-            outFile.close();
-        }
+                                if (neighbor.pointId > 0)
+                                {
+                                    text << "\t(" << neighbor.pointId << " " << neighbor.distanceSquared << ")";
+                                }
+                                else
+                                {
+                                    text << "\t(" << "NULL" << " " << neighbor.distanceSquared << ")";
+                                }
+                            }
+
+                            text << '\n';
+                        }
+
+                        texts[iPart] = text.str();
+                    }
+
+                    for (auto& text : texts)
+                        outFile << text;
+                });
+
+            outFile.close();
+        }
+
+        /** \brief Saves neighbors found for each input point to a binary result file (see ResultFile.h)
+         *          The neighbors are read in chunks by a streaming reader, each chunk is encoded in parallel and written while the next one is read
+         */
+        void SaveToBinaryFile() const override
+        {
+            if (hasAllocationError)
+                return;
+
+            size_t numNeighbors = problem.GetNumNeighbors();
+            ResultFileWriter writer(GetOutputFilename(".bin"), sizeof(point_id_t), problem.GetInputDatasetSize(), numNeighbors);
+            size_t recordSize = writer.GetRecordSize();
+
+            ForEachNeighborsChunk([&](size_t startPoint, size_t numPoints, const std::vector<Neighbor>& neighbors)
+                {
+                    std::unique_ptr<std::vector<char>> pBuffer(new std::vector<char>(numPoints*numNeighbors*recordSize));
+
+                    //the neighbors of each point are stored in the order they were removed from the heap, so they are reversed
+                    #pragma omp parallel for schedule(static)
+                    for (size_t iPoint = 0; iPoint < numPoints; ++iPoint)
+                    {
+                        char* pRecord = pBuffer->data() + iPoint*numNeighbors*recordSize;
+
+                        for (size_t iNeighbor = numNeighbors; iNeighbor > 0; --iNeighbor)
+                        {
+                            auto& neighbor = neighbors[iPoint*numNeighbors + iNeighbor - 1];
+                            EncodeResultNeighbor(pRecord, sizeof(point_id_t), neighbor.pointId, neighbor.distanceSquared);
+                            pRecord += recordSize;
+                        }
+                    }
+
+                    writer.Write(std::move(pBuffer));
+                });
+
+            writer.Close();
+        }
 
         /** \brief Compares a result with a reference result to find any differences in distances of neighbors
-         *
+         *          The neighbors are read in chunks by a streaming reader and the points of each chunk are compared in parallel
          * \param result AllKnnResult& the result to check for differences
          * \param accuracy double the accuracy to use for comparisons
-         * \return unique_ptr<vector<unsigned long>>  vector of input point ids where differences exist
+         * \return unique_ptr<vector<point_id_t>>  vector of input point ids where differences exist
          *
          */
-        std::unique_ptr<std::vector<unsigned long>> FindDifferences(AllKnnResult& result, double accuracy) override
+        std::unique_ptr<std::vector<point_id_t>> FindDifferences(AllKnnResult& result, double accuracy) override
         {
             if (hasAllocationError)
-                return std::unique_ptr<std::vector<unsigned long>>(nullptr);
+                return std::unique_ptr<std::vector<point_id_t>>(nullptr);
 
-            auto differences = std::unique_ptr<std::vector<unsigned long>>(new std::vector<unsigned long>());
+            auto differences = std::unique_ptr<std::vector<point_id_t>>(new std::vector<point_id_t>());
 
-            size_t numInputPoints = problem.GetInputDatasetSize();
             size_t numNeighbors = problem.GetNumNeighbors();
-            size_t pos = 0;
+            int numThreads = omp_get_max_threads();
 
             auto& neighborsVector = result.GetNeighborsPriorityQueueVector();
 
-            for (size_t pointId = 1; pointId <=  numInputPoints; ++pointId)
-            {
-                NeighborsEnumerator* pNeighborsReference = &(neighborsVector.at(pointId - 1));
-                std::vector<Neighbor> removedNeighborsReference;
-
-                for (size_t iNeighbor=0; iNeighbor < numNeighbors; ++iNeighbor)
+            ForEachNeighborsChunk([&](size_t startPoint, size_t numPoints, const std::vector<Neighbor>& neighbors)
                 {
-                    auto& neighbor = pNeighborsExtVector->at(pos);
+                    //each thread compares a part of the chunk, the differences of the parts are appended in order
+                    std::vector<std::vector<point_id_t>> partDifferences(numThreads);
 
-                    if (pNeighborsReference->HasNext())
+                    #pragma omp parallel for schedule(static) num_threads(numThreads)
+                    for (int iPart = 0; iPart < numThreads; ++iPart)
                     {
-                        Neighbor neighborReference = pNeighborsReference->Next();
-                        removedNeighborsReference.push_back(neighborReference);
-
-                        double diff = neighbor.distanceSquared - neighborReference.distanceSquared;
+                        size_t partStart = numPoints*iPart/numThreads;
+                        size_t partEnd = numPoints*(iPart + 1)/numThreads;
 
-                        if (abs(diff) > accuracy)
+                        for (size_t iPoint = partStart; iPoint < partEnd; ++iPoint)
                         {
-                            differences->push_back(pointId);
-                            break;
+                            size_t pointId = startPoint + iPoint + 1;
+                            auto& neighborsReference = neighborsVector.at(pointId - 1);
+
+                            //the neighbors are stored in the order they were removed from the heap, which is the order of the finalized reference heap
+                            for (size_t iNeighbor=0; iNeighbor < numNeighbors; ++iNeighbor)
+                            {
+                                double diff = neighbors[iPoint*numNeighbors + iNeighbor].distanceSquared - neighborsReference.FinalizedNeighbor(iNeighbor).distanceSquared;
+
+                                if (std::abs(diff) > accuracy)
+                                {
+                                    partDifferences[iPart].push_back(point_id_t(pointId));
+                                    break;
+                                }
+                            }
                         }
                     }
-                    else
-                    {
-                        differences->push_back(pointId);
-                        break;
-                    }
 
-                    ++pos;
-                }
+                    for (auto& part : partDifferences)
+                        differences->insert(differences->end(), part.cbegin(), part.cend());
+                });
 
-                if (pNeighborsReference->HasNext())
-                {
-                    differences->push_back(pointId);
-                }
+            return differences;
+        }
 
-                pNeighborsReference->AddAllRemoved(removedNeighborsReference);
+        /** \brief Copies the neighbors of some input points from the output vector, in the order they were removed from the heap
+         *
+         * \param pointIds const std::vector<point_id_t>& the ids of the input points in ascending order
+         * \return unique_ptr<vector<Neighbor>> k neighbors for each input point
+         *
+         */
+        std::unique_ptr<std::vector<Neighbor>> GetNeighbors(const std::vector<point_id_t>& pointIds) const override
+        {
+            size_t numNeighbors = problem.GetNumNeighbors();
+            std::unique_ptr<std::vector<Neighbor>> pNeighbors(new std::vector<Neighbor>());
+            pNeighbors->reserve(pointIds.size()*numNeighbors);
+
+            for (auto pointId : pointIds)
+            {
+                auto neighborIter = pNeighborsExtVector->cbegin() + (pointId - 1)*numNeighbors;
+
+                for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor, ++neighborIter)
+                    pNeighbors->push_back(*neighborIter);
             }
 
-            return differences;
+            return pNeighbors;
         }
 
          /** \brief Calculates heap statistics for reporting purposes
@@ -699,9 +764,23 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         }
 
     private:
+        //number of neighbors extracted from the heaps before they are written to the output vector
+        static constexpr size_t COMMIT_BUFFER_NEIGHBORS = 64*1024;
+        //the neighbors of the completed points are buffered until their blocks are complete, up to this fraction of the memory limit
+        static constexpr size_t OUTPUT_BUFFER_MEMORY_DIVISOR = 8;
+        //number of neighbors read at once by SaveToFile and FindDifferences
+        static constexpr size_t EXPORT_CHUNK_NEIGHBORS = 1024*1024;
+        //the halo covers the mean distance of the k-th neighbor plus this number of standard deviations
+        static constexpr double HALO_RADIUS_DEVIATIONS = 2.0;
+
         bool splitByT = false;
         bool parallelSort = false;
-        std::unique_ptr<pointNeighbors_priority_queue_map_t> pPendingNeighborsContainer;
+        bool prefetchWindows = false;
+        bool haloWindows = false;
+        size_t memoryBaseline = MemoryTracker::GetAllocatedBytes(); /**< memory allocated by tracked containers before the algorithm started */
+        double sumKthDistance = 0.0;
+        double sumSquaredKthDistance = 0.0;
+        size_t numKthDistances = 0;
         std::unique_ptr<ext_point_vector_t> pStripedInputDataset;
         std::unique_ptr<ext_point_vector_t> pStripedTrainingDataset;
         std::unique_ptr<std::vector<size_t>> pInputStripeOffset;
@@ -710,14 +789,21 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         std::unique_ptr<std::vector<size_t>> pTrainingStripeCount;
         std::unique_ptr<std::vector<StripeBoundaries_t>> pStripeBoundaries;
         bool hasAllocationError = false;
-        std::unique_ptr<std::unordered_map<unsigned long, StripePoint>> pPendingPoints;
+        std::unique_ptr<PendingPoints> pPendingPoints;
         std::unique_ptr<ext_neighbors_vector_t> pNeighborsExtVector;
+        std::unique_ptr<NeighborsOutputBuffer> pNeighborsOutputBuffer;
+        ResultSink* pResultSink = nullptr; /**< if set, the completed points are passed to the sink instead of pNeighborsExtVector */
         const AllKnnProblemExternal& problemExt;
         std::unique_ptr<ext_size_vector_t> pHeapAdditionsVector;
         size_t numFirstPassWindows = 0;
         size_t numSecondPassWindows = 0;
+        size_t numLoadedTrainingPoints = 0;
         std::chrono::duration<double> totalElapsedCommit = std::chrono::duration<double>(0.0);
-        std::chrono::duration<double> elapsedFinalSorting = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> elapsedOutputFlush = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> totalElapsedIOWait = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> totalElapsedLoad = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> totalElapsedCompute = std::chrono::duration<double>(0.0);
+        std::future<std::unique_ptr<StripesWindow>> futureWindow;
 
         /** \brief calculate an optimal number of stripes based on the number of training points and neighbors
          *
@@ -736,6 +822,46 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             return optimal_stripes;
         }
 
+        /** \brief Reads the neighbors of all input points in chunks of consecutive points and passes each chunk to a function
+         *          The neighbors are read sequentially by a streaming reader and the next chunk is read while the function processes the current one
+         * \param processChunk Function function called with the index of the first point of the chunk, the number of points and their neighbors
+         * \return void
+         *
+         */
+        template<class Function>
+        void ForEachNeighborsChunk(Function processChunk) const
+        {
+            size_t numInputPoints = problem.GetInputDatasetSize();
+            size_t numNeighbors = problem.GetNumNeighbors();
+            size_t chunkPoints = std::max(EXPORT_CHUNK_NEIGHBORS/numNeighbors, size_t(1));
+
+            stxxl::vector_bufreader<ext_neighbors_vector_t> reader(*pNeighborsExtVector);
+
+            auto readChunk = [&reader, numNeighbors](size_t numPoints)
+            {
+                std::unique_ptr<std::vector<Neighbor>> pChunk(new std::vector<Neighbor>());
+                pChunk->reserve(numPoints*numNeighbors);
+
+                for (size_t i = 0; i < numPoints*numNeighbors && !reader.empty(); ++i, ++reader)
+                    pChunk->push_back(*reader);
+
+                return pChunk;
+            };
+
+            auto futureChunk = std::async(std::launch::async, readChunk, std::min(chunkPoints, numInputPoints));
+
+            for (size_t startPoint = 0; startPoint < numInputPoints; startPoint += chunkPoints)
+            {
+                auto pChunk = futureChunk.get();
+                size_t numPoints = std::min(chunkPoints, numInputPoints - startPoint);
+
+                if (startPoint + chunkPoints < numInputPoints)
+                    futureChunk = std::async(std::launch::async, readChunk, std::min(chunkPoints, numInputPoints - startPoint - chunkPoints));
+
+                processChunk(startPoint, numPoints, *pChunk);
+            }
+        }
+
         void create_fixed_stripes(size_t numStripes, const ext_point_vector_t& inputDatasetSortedY, const ext_point_vector_t& trainingDatasetSortedY)
         {
             if (splitByT)
@@ -755,7 +881,7 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         void create_fixed_stripes_input(size_t numStripes, const ext_point_vector_t& inputDatasetSortedY, const ext_point_vector_t& trainingDatasetSortedY)
         {
             //The implementation is similar to AllKnnResultStripesParallel.create_fixed_stripes_input
-            //with the difference of using external memory vectors and a serial for loop instead of parallel
+            //with the difference that the boundaries are found first and the stripes are copied afterwards by copy_stripes
 
             size_t inputDatasetStripeSize = inputDatasetSortedY.size()/numStripes;
             auto inputDatasetSortedYBegin = inputDatasetSortedY.cbegin();
@@ -764,27 +890,24 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
             auto prevTrainingIterEnd = trainingDatasetSortedYBegin;
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = inputDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
                 numStripes += (numRemainingPoints/inputDatasetStripeSize + 1);
             }
 
-            pStripedInputDataset.reset(new ext_point_vector_t());
-            pStripedTrainingDataset.reset(new ext_point_vector_t());
-            pStripedInputDataset->reserve(inputDatasetSortedY.size());
-            pStripedTrainingDataset->reserve(trainingDatasetSortedY.size());
-
             pInputStripeOffset.reset(new std::vector<size_t>(numStripes, 0));
             pInputStripeCount.reset(new std::vector<size_t>(numStripes, 0));
             pTrainingStripeOffset.reset(new std::vector<size_t>(numStripes, 0));
             pTrainingStripeCount.reset(new std::vector<size_t>(numStripes, 0));
             pStripeBoundaries.reset(new std::vector<StripeBoundaries_t>(numStripes, {0.0, 0.0}));
 
-            pPendingPoints.reset(new std::unordered_map<unsigned long, StripePoint>());
-            pPendingNeighborsContainer.reset(new pointNeighbors_priority_queue_map_t());
+            pPendingPoints.reset(new PendingPoints(numStripes, problem.GetNumNeighbors()));
 
-            //we cannot use a parallel loop because the external memory vectors do not allow concurrent access by multiple threads
+            //the boundaries are found by random access to a few points around each boundary, this loop does not read the datasets sequentially
             for (size_t i=0; i < numStripes; ++i)
             {
                 StripeBoundaries_t& stripeBoundaries = pStripeBoundaries->at(i);
@@ -815,65 +938,26 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
 
                 if (inputIterStart < inputIterEnd)
                 {
-                    point_vector_t inputStripe(inputIterStart, inputIterEnd);
-                    pInputStripeCount->at(i) = inputStripe.size();
-                    if (parallelSort)
-                    {
-                        tbb::parallel_sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
-                             {
-                                 return point1.x < point2.x;
-                             });
-
-                    }
-                    else
-                    {
-                        std::sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
-                             {
-                                 return point1.x < point2.x;
-                             });
-                    }
-                    std::copy(inputStripe.begin(), inputStripe.end(), std::back_inserter(*pStripedInputDataset));
-                    stripeBoundaries.minY =  i > 0 ? inputIterStart->y : 0.0;
-                    stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : 1.0001) : 1.0001;
+                    pInputStripeCount->at(i) = (size_t)std::distance(inputIterStart, inputIterEnd);
+                    stripeBoundaries.minY =  i > 0 ? inputIterStart->y : lowerLimitY;
+                    stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : upperLimitY) : upperLimitY;
 
+                    //binary search for the first training point above the stripe
                     auto trainingIterStart = prevTrainingIterEnd;
-                    auto trainingIterEnd = trainingIterStart;
-
-                    while (trainingIterEnd != trainingDatasetSortedYEnd && trainingIterEnd->y < stripeBoundaries.maxY)
-                        ++trainingIterEnd;
+                    auto trainingIterEnd = std::lower_bound(trainingIterStart, trainingDatasetSortedYEnd, stripeBoundaries.maxY,
+                                                            [](const Point& point, double y) { return point.y < y; });
 
                     prevTrainingIterEnd = trainingIterEnd;
 
                     pTrainingStripeOffset->at(i) = (size_t)std::distance(trainingDatasetSortedYBegin, trainingIterStart);
-
-                    if (trainingIterStart < trainingIterEnd)
-                    {
-                        point_vector_t trainingStripe(trainingIterStart, trainingIterEnd);
-                        pTrainingStripeCount->at(i) = trainingStripe.size();
-                        if (parallelSort)
-                        {
-                            tbb::parallel_sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
-                             {
-                                 return point1.x < point2.x;
-                             });
-
-                        }
-                        else
-                        {
-                            std::sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
-                             {
-                                 return point1.x < point2.x;
-                             });
-                        }
-                        std::copy(trainingStripe.begin(), trainingStripe.end(), std::back_inserter(*pStripedTrainingDataset));
-                    }
+                    pTrainingStripeCount->at(i) = (size_t)std::distance(trainingIterStart, trainingIterEnd);
                 }
                 else
                 {
                     if (inputIterStart >= inputDatasetSortedYEnd)
                     {
-                        stripeBoundaries.minY = 1.0001;
-                        stripeBoundaries.maxY = 1.0001;
+                        stripeBoundaries.minY = upperLimitY;
+                        stripeBoundaries.maxY = upperLimitY;
                     }
                     else
                     {
@@ -882,6 +966,11 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
                     }
                 }
             }
+
+            pStripedInputDataset.reset(new ext_point_vector_t());
+            pStripedTrainingDataset.reset(new ext_point_vector_t());
+            copy_stripes(inputDatasetSortedY, *pInputStripeCount, *pStripedInputDataset);
+            copy_stripes(trainingDatasetSortedY, *pTrainingStripeCount, *pStripedTrainingDataset);
         }
 
         /** \brief Splits the datasets into stripes based on the training dataset (fixed number of training points per stripe)
@@ -895,7 +984,7 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
         void create_fixed_stripes_training(size_t numStripes, const ext_point_vector_t& inputDatasetSortedY, const ext_point_vector_t& trainingDatasetSortedY)
         {
             //The implementation is similar to AllKnnResultStripesParallel.create_fixed_stripes_training
-            //with the difference of using external memory vectors and a serial for loop instead of parallel
+            //with the difference that the boundaries are found first and the stripes are copied afterwards by copy_stripes
 
             size_t trainingDatasetStripeSize = trainingDatasetSortedY.size()/numStripes;
             auto inputDatasetSortedYBegin = inputDatasetSortedY.cbegin();
@@ -904,27 +993,24 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
             auto prevInputIterEnd = inputDatasetSortedYBegin;
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = trainingDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
                 numStripes += (numRemainingPoints/trainingDatasetStripeSize + 1);
             }
 
-            pStripedInputDataset.reset(new ext_point_vector_t());
-            pStripedTrainingDataset.reset(new ext_point_vector_t());
-            pStripedInputDataset->reserve(inputDatasetSortedY.size());
-            pStripedTrainingDataset->reserve(trainingDatasetSortedY.size());
-
             pInputStripeOffset.reset(new std::vector<size_t>(numStripes, 0));
             pInputStripeCount.reset(new std::vector<size_t>(numStripes, 0));
             pTrainingStripeOffset.reset(new std::vector<size_t>(numStripes, 0));
             pTrainingStripeCount.reset(new std::vector<size_t>(numStripes, 0));
             pStripeBoundaries.reset(new std::vector<StripeBoundaries_t>(numStripes, {0.0, 0.0}));
 
-            pPendingPoints.reset(new std::unordered_map<unsigned long, StripePoint>());
-            pPendingNeighborsContainer.reset(new pointNeighbors_priority_queue_map_t());
+            pPendingPoints.reset(new PendingPoints(numStripes, problem.GetNumNeighbors()));
 
-            //we cannot use a parallel loop because the external memory vectors do not allow concurrent access by multiple threads
+            //the boundaries are found by random access to a few points around each boundary, this loop does not read the datasets sequentially
             for (size_t i=0; i < numStripes; ++i)
             {
                 StripeBoundaries_t& stripeBoundaries = pStripeBoundaries->at(i);
@@ -955,71 +1041,584 @@ class AllKnnResultStripesParallelExternal : public AllKnnResult
 
                 if (trainingIterStart < trainingIterEnd)
                 {
-                    point_vector_t trainingStripe(trainingIterStart, trainingIterEnd);
-                    pTrainingStripeCount->at(i) = trainingStripe.size();
-                    if (parallelSort)
+                    pTrainingStripeCount->at(i) = (size_t)std::distance(trainingIterStart, trainingIterEnd);
+                    stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : lowerLimitY;
+                    stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : upperLimitY) : upperLimitY;
+
+                    //binary search for the first input point above the stripe
+                    auto inputIterStart = prevInputIterEnd;
+                    auto inputIterEnd = std::lower_bound(inputIterStart, inputDatasetSortedYEnd, stripeBoundaries.maxY,
+                                                         [](const Point& point, double y) { return point.y < y; });
+
+                    prevInputIterEnd = inputIterEnd;
+
+                    pInputStripeOffset->at(i) = (size_t)std::distance(inputDatasetSortedYBegin, inputIterStart);
+                    pInputStripeCount->at(i) = (size_t)std::distance(inputIterStart, inputIterEnd);
+                }
+                else
+                {
+                    if (trainingIterStart >= trainingDatasetSortedYEnd)
                     {
-                            tbb::parallel_sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
-                                 {
-                                     return point1.x < point2.x;
-                                 });
+                        stripeBoundaries.minY = upperLimitY;
+                        stripeBoundaries.maxY = upperLimitY;
                     }
                     else
                     {
-                            std::sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
-                                 {
-                                     return point1.x < point2.x;
-                                 });
+                        stripeBoundaries.minY = trainingIterStart->y;
+                        stripeBoundaries.maxY = trainingIterStart->y;
                     }
-                    std::copy(trainingStripe.begin(), trainingStripe.end(), std::back_inserter(*pStripedTrainingDataset));
-                    stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : 0.0;
-                    stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : 1.0001) : 1.0001;
+                }
+            }
 
-                    auto inputIterStart = prevInputIterEnd;
-                    auto inputIterEnd = inputIterStart;
+            pStripedInputDataset.reset(new ext_point_vector_t());
+            pStripedTrainingDataset.reset(new ext_point_vector_t());
+            copy_stripes(inputDatasetSortedY, *pInputStripeCount, *pStripedInputDataset);
+            copy_stripes(trainingDatasetSortedY, *pTrainingStripeCount, *pStripedTrainingDataset);
+        }
 
-                    while (inputIterEnd != inputDatasetSortedYEnd && inputIterEnd->y < stripeBoundaries.maxY)
-                        ++inputIterEnd;
+        /** \brief Copies the stripes of a dataset sorted by y to the striped dataset, with the points of each stripe sorted by x
+         *          The stripes are read in batches of consecutive stripes. The next batch is read while the stripes of the current batch are sorted in parallel
+         *          and written, so the I/O overlaps with the sorting. Both the reading and the writing of a batch are split into ranges of whole blocks
+         *          of the external vectors, each range has its own streaming reader or buffered writer and the ranges are processed by parallel threads.
+         *          Stripes are not aligned to blocks, so the points after the last block boundary of a batch are carried over and written with the next batch
+         * \param datasetSortedY const ext_point_vector_t& the dataset sorted by y
+         * \param stripeCount const std::vector<size_t>& the number of points of each stripe, the stripes are consecutive in the sorted dataset
+         * \param stripedDataset ext_point_vector_t& the striped dataset
+         * \return void
+         *
+         */
+        void copy_stripes(const ext_point_vector_t& datasetSortedY, const std::vector<size_t>& stripeCount, ext_point_vector_t& stripedDataset)
+        {
+            size_t numStripes = stripeCount.size();
+            constexpr size_t blockPoints = size_t(ext_point_vector_t::block_size)/sizeof(Point);
+
+            //the caches of the datasets of the problem and of the striped datasets are taken from the memory limit
+            //each reader and each writer buffers as much as a cache, the readers and the writers may use up to half of the remaining memory
+            //and there are no more readers or writers than processors, the reading of the next batch runs concurrently with the writing
+            size_t cacheMemory = GetExtVectorCacheBytes<ext_point_vector_t>();
+            size_t usedMemory = 4*cacheMemory;
+            size_t memoryLimit = problemExt.GetMemoryLimitBytes();
+            size_t freeMemory = memoryLimit > usedMemory ? memoryLimit - usedMemory : 0;
+            int maxStreams = std::min(omp_get_max_threads(), omp_get_num_procs());
+            int numStreams = int(std::max<size_t>(1, std::min<size_t>(maxStreams, freeMemory/(4*cacheMemory))));
+            usedMemory += 2*numStreams*cacheMemory;
+
+            //two batches are held in RAM, the one that is sorted and the one that is read
+            size_t batchLimit = memoryLimit > usedMemory ? (memoryLimit - usedMemory)/(4*sizeof(Point)) : 0;
+
+            //position of each stripe in the sorted dataset, it is the same in the striped dataset
+            std::vector<size_t> stripeOffset(numStripes + 1, 0);
+            for (size_t i = 0; i < numStripes; ++i)
+                stripeOffset[i + 1] = stripeOffset[i] + stripeCount[i];
+
+            //split the stripes into batches, a batch has at least one stripe even if it exceeds the limit
+            std::vector<size_t> batchStart;
+            for (size_t i = 0; i < numStripes; ++i)
+            {
+                if (batchStart.empty() || (stripeOffset[i + 1] - stripeOffset[batchStart.back()] > batchLimit && i > batchStart.back()))
+                    batchStart.push_back(i);
+            }
+            batchStart.push_back(numStripes);
 
-                    prevInputIterEnd = inputIterEnd;
+            //a batch is held from the block boundary before its first point, the points before the batch are the ones carried over from the previous batch
+            auto blockStart = [blockPoints](size_t position)
+            {
+                return position - position % blockPoints;
+            };
 
-                    pInputStripeOffset->at(i) = (size_t)std::distance(inputDatasetSortedYBegin, inputIterStart);
+            auto datasetBegin = datasetSortedY.cbegin();
+            auto readBatch = [&datasetBegin, &stripeOffset, &blockStart, blockPoints, numStreams](size_t startStripe, size_t endStripe)
+            {
+                size_t bufferStart = blockStart(stripeOffset[startStripe]);
+                size_t readStart = stripeOffset[startStripe];
+                size_t readEnd = stripeOffset[endStripe];
+                std::unique_ptr<point_vector_t> pBatch(new point_vector_t(readEnd - bufferStart));
 
-                    if (inputIterStart < inputIterEnd)
-                    {
-                        point_vector_t inputStripe(inputIterStart, inputIterEnd);
-                        pInputStripeCount->at(i) = inputStripe.size();
-                        if (parallelSort)
-                        {
-                            tbb::parallel_sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
-                                 {
-                                     return point1.x < point2.x;
-                                 });
-                        }
-                        else
-                        {
-                            std::sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
-                             {
-                                 return point1.x < point2.x;
-                             });
-                        }
-                        std::copy(inputStripe.begin(), inputStripe.end(), std::back_inserter(*pStripedInputDataset));
-                    }
+                size_t numBlocks = (readEnd - bufferStart + blockPoints - 1)/blockPoints;
+                int numReaders = int(std::min<size_t>(numStreams, numBlocks));
+
+                #pragma omp parallel for schedule(static, 1) num_threads(std::max(numReaders, 1))
+                for (int iReader = 0; iReader < numReaders; ++iReader)
+                {
+                    size_t rangeStart = std::max(readStart, bufferStart + numBlocks*iReader/numReaders*blockPoints);
+                    size_t rangeEnd = std::min(readEnd, bufferStart + numBlocks*(iReader + 1)/numReaders*blockPoints);
+                    if (rangeStart >= rangeEnd)
+                        continue;
+
+                    auto batchIter = pBatch->begin() + (rangeStart - bufferStart);
+
+                    for (stxxl::vector_bufreader<ext_point_vector_t> reader(datasetBegin + rangeStart, datasetBegin + rangeEnd); !reader.empty(); ++reader, ++batchIter)
+                        *batchIter = *reader;
+                }
+
+                return pBatch;
+            };
+
+            stripedDataset.resize(stripeOffset[numStripes]);
+            auto stripedBegin = stripedDataset.begin();
+            point_vector_t carriedPoints;
+            auto futureBatch = std::async(std::launch::async, readBatch, batchStart[0], batchStart[1]);
+
+            for (size_t iBatch = 0; iBatch < batchStart.size() - 1; ++iBatch)
+            {
+                auto pBatch = futureBatch.get();
+                size_t startStripe = batchStart[iBatch];
+                size_t endStripe = batchStart[iBatch + 1];
+                size_t bufferStart = blockStart(stripeOffset[startStripe]);
+
+                if (endStripe < numStripes)
+                    futureBatch = std::async(std::launch::async, readBatch, endStripe, batchStart[iBatch + 2]);
+
+                std::copy(carriedPoints.cbegin(), carriedPoints.cend(), pBatch->begin());
+
+                auto batchBegin = pBatch->begin();
+                auto sortStripe = [&](size_t iStripe)
+                {
+                    auto stripeBegin = batchBegin + (stripeOffset[iStripe] - bufferStart);
+                    auto stripeEnd = stripeBegin + stripeCount[iStripe];
+                    ProfileScope profileScope(ProfilePhase::SortX, long(iStripe));
+
+                    if (parallelSort)
+                        tbb::parallel_sort(stripeBegin, stripeEnd, ExternalPointComparerX());
+                    else
+                        std::sort(stripeBegin, stripeEnd, ExternalPointComparerX());
+                };
+
+                if (parallelSort)
+                {
+                    //the stripes are sorted in parallel and the points of large stripes are also sorted in parallel
+                    tbb::parallel_for(startStripe, endStripe, sortStripe);
                 }
                 else
                 {
-                    if (trainingIterStart >= trainingDatasetSortedYEnd)
+                    for (size_t iStripe = startStripe; iStripe < endStripe; ++iStripe)
+                        sortStripe(iStripe);
+                }
+
+                //the batch is written up to its last block boundary, the last batch is written to the end
+                size_t writeEnd = endStripe < numStripes ? blockStart(stripeOffset[endStripe]) : stripeOffset[numStripes];
+                size_t numBlocks = (writeEnd - bufferStart + blockPoints - 1)/blockPoints;
+                int numWriters = int(std::min<size_t>(numStreams, numBlocks));
+
+                #pragma omp parallel for schedule(static, 1) num_threads(std::max(numWriters, 1))
+                for (int iWriter = 0; iWriter < numWriters; ++iWriter)
+                {
+                    size_t rangeStart = bufferStart + numBlocks*iWriter/numWriters*blockPoints;
+                    size_t rangeEnd = std::min(writeEnd, bufferStart + numBlocks*(iWriter + 1)/numWriters*blockPoints);
+
+                    stxxl::vector_bufwriter<ext_point_vector_t> writer(stripedBegin + rangeStart);
+                    for (auto batchIter = batchBegin + (rangeStart - bufferStart); batchIter != batchBegin + (rangeEnd - bufferStart); ++batchIter)
+                        writer << *batchIter;
+
+                    writer.finish();
+                }
+
+                carriedPoints.assign(batchBegin + (writeEnd - bufferStart), pBatch->end());
+            }
+        }
+
+        /** \brief Returns the index of the first stripe of the window that follows a given window in the same phase
+         *
+         * \param startStripe size_t the starting stripe of the given window
+         * \param endStripe size_t the ending stripe of the given window
+         * \param secondPass bool true if the given window belongs to the second phase
+         * \param nextStripe size_t& the first stripe of the next window
+         * \return bool false if there are no more stripes in this phase
+         *
+         */
+        bool GetNextStripe(size_t startStripe, size_t endStripe, bool secondPass, size_t& nextStripe) const
+        {
+            if (secondPass)
+            {
+                if (startStripe == 0)
+                    return false;
+
+                nextStripe = startStripe - 1;
+            }
+            else
+            {
+                if (endStripe >= pStripeBoundaries->size() - 1)
+                    return false;
+
+                nextStripe = endStripe + 1;
+            }
+
+            return true;
+        }
+
+        /** \brief Writes buckets of pending points to external memory until a window can be loaded
+         *          Buckets are written in reverse order of use, the bucket of the starting stripe is never written because it is needed first.
+         *          In the first phase these are the buckets of the second phase starting from the lowest stripe, then the buckets above the window.
+         * \param fromStripe size_t index of starting stripe of the window
+         * \param secondPass bool true if this is the second phase of the algorithm (higher to lower y)
+         * \return bool true if a window fits into RAM after spilling
+         *
+         */
+        bool SpillPendingPoints(size_t fromStripe, bool secondPass)
+        {
+            size_t numStripes = pStripeBoundaries->size();
+
+            //the buckets in the order they are written
+            std::vector<std::pair<size_t, bool>> buckets;
+
+            //the second phase runs from higher to lower y, so the buckets of the lowest stripes are needed last
+            size_t endDownStripe = secondPass ? fromStripe : numStripes;
+            for (size_t iStripe = 0; iStripe < endDownStripe; ++iStripe)
+                buckets.push_back({iStripe, true});
+
+            if (!secondPass)
+            {
+                for (size_t iStripe = numStripes - 1; iStripe > fromStripe; --iStripe)
+                    buckets.push_back({iStripe, false});
+            }
+
+            //the memory released by writing the first i buckets, so the number of buckets to write is found by a binary search
+            size_t pendingPointMemory = sizeof(Point) + GetHeapMemory();
+            std::vector<size_t> releasedMemory(buckets.size() + 1, 0);
+            for (size_t iBucket = 0; iBucket < buckets.size(); ++iBucket)
+                releasedMemory[iBucket + 1] = releasedMemory[iBucket] + pPendingPoints->GetNumPointsInMemory(buckets[iBucket].first, buckets[iBucket].second)*pendingPointMemory;
+
+            //the released memory is estimated from the number of points, so the window is planned again after the buckets have been written
+            size_t numWritten = 0;
+            StripesWindowPlan plan = PlanWindow(fromStripe, secondPass, 0, false);
+
+            while (!plan.isValid && numWritten < buckets.size())
+            {
+                auto endIter = std::lower_bound(releasedMemory.cbegin() + numWritten + 1, releasedMemory.cend(), releasedMemory[numWritten] + plan.missingMemory);
+                size_t endWritten = std::min(size_t(endIter - releasedMemory.cbegin()), buckets.size());
+
+                for (; numWritten < endWritten; ++numWritten)
+                    pPendingPoints->Spill(buckets[numWritten].first, buckets[numWritten].second);
+
+                plan = PlanWindow(fromStripe, secondPass, 0, false);
+            }
+
+            return plan.isValid;
+        }
+
+        /** \brief Returns the memory of the heap of neighbors of an input point
+         *          It is measured by a test allocation, so it includes the slack of the allocator
+         * \return size_t
+         *
+         */
+        size_t GetHeapMemory() const
+        {
+            return sizeof(PointNeighbors<neighbors_priority_queue_t>) + MemoryTracker::MeasureAllocationSize(problem.GetNumNeighbors()*sizeof(Neighbor));
+        }
+
+        /** \brief Returns the memory of the first stripe of a window, no window can be loaded from this stripe if it does not fit
+         *
+         * \param fromStripe size_t index of starting stripe
+         * \param secondPass bool true if this is the second phase of the algorithm (higher to lower y)
+         * \param heapMemory size_t the memory of a heap of neighbors
+         * \return size_t
+         *
+         */
+        size_t GetFirstStripeMemory(size_t fromStripe, bool secondPass, size_t heapMemory) const
+        {
+            size_t pendingPointMemory = sizeof(Point) + heapMemory;
+
+            if (secondPass)
+            {
+                //the stripe is loaded only if a pending point of this or a higher stripe needs to search it, like PlanWindow
+                double minY = std::numeric_limits<double>::max();
+                for (size_t iStripe = fromStripe; iStripe < pStripeBoundaries->size(); ++iStripe)
+                    minY = std::min(minY, pPendingPoints->GetDownMinY(iStripe));
+
+                bool isNeeded = pStripeBoundaries->at(fromStripe).maxY > minY;
+                return (isNeeded ? pTrainingStripeCount->at(fromStripe)*sizeof(Point) : 0)
+                       + pPendingPoints->GetNumSpilledPoints(fromStripe, true)*pendingPointMemory;
+            }
+
+            return pInputStripeCount->at(fromStripe)*(sizeof(Point) + heapMemory) + pTrainingStripeCount->at(fromStripe)*sizeof(Point)
+                   + pPendingPoints->GetNumSpilledPoints(fromStripe, false)*pendingPointMemory;
+        }
+
+        /** \brief Returns the memory limit of the buffer of the output neighbors
+         *
+         * \return size_t
+         *
+         */
+        size_t GetOutputBufferMemory() const
+        {
+            return problemExt.GetMemoryLimitBytes()/OUTPUT_BUFFER_MEMORY_DIVISOR;
+        }
+
+        /** \brief Finds the set of stripes that fits into RAM without loading them
+         *
+         * \param fromStripe size_t index of starting stripe
+         * \param secondPass bool true if this is the second phase of the algorithm (higher to lower y)
+         * \param reservedMemory size_t memory held by a window that is still in process
+         * \param doubleBuffer bool true if the window may take up to half of the memory that is not used by pending points
+         * \return StripesWindowPlan the range of stripes
+         *
+         */
+        StripesWindowPlan PlanWindow(size_t fromStripe, bool secondPass, size_t reservedMemory, bool doubleBuffer)
+        {
+            auto memoryLimit = problemExt.GetMemoryLimitBytes();
+            auto safeMemoryLimit = 9*memoryLimit/10;
+
+            size_t numStripes = pStripeBoundaries->size();
+
+            size_t heapMemory = GetHeapMemory();
+            size_t pendingPointMemory = sizeof(Point) + heapMemory;
+
+            //memory of points, heaps and pending points that are in RAM (measured by the tracking allocator)
+            size_t allocatedMemory = MemoryTracker::GetAllocatedBytes();
+            size_t measuredMemory = allocatedMemory > memoryBaseline ? allocatedMemory - memoryBaseline : 0;
+
+            //memory of the caches of the external vectors: datasets of the problem, striped datasets, neighbors and heap additions of the result
+            size_t cacheMemory = 4*GetExtVectorCacheBytes<ext_point_vector_t>() + GetExtVectorCacheBytes<ext_size_vector_t>() + pPendingPoints->GetCacheMemory()
+                                 + (pResultSink == nullptr ? GetExtVectorCacheBytes<ext_neighbors_vector_t>() : 0);
+
+            //the buffered output neighbors are measured, the rest of the memory of the output buffer is reserved
+            if (pResultSink == nullptr)
+                cacheMemory += pNeighborsOutputBuffer != nullptr ? pNeighborsOutputBuffer->GetRemainingMemory() : GetOutputBufferMemory();
+
+            //spilled pending points are not counted, they are counted by the window that reads them back
+            size_t usedMemory = measuredMemory + cacheMemory
+                                + 2*numStripes*(sizeof(PendingPointsBucket) + sizeof(std::vector<SpilledSegment>))
+                                + 4*numStripes*sizeof(size_t)
+                                + numStripes*sizeof(StripeBoundaries_t)
+                                + COMMIT_BUFFER_NEIGHBORS*(sizeof(Neighbor) + sizeof(size_t));
+
+            StripesWindowPlan plan = {0, 0, secondPass, 0, 0, false, 0, {}, 0};
+
+            //a window needs at least its first stripe, which may be empty
+            size_t firstStripeMemory = GetFirstStripeMemory(fromStripe, secondPass, heapMemory);
+            size_t requiredMemory = usedMemory + reservedMemory + std::max(firstStripeMemory, size_t(1));
+
+            if (requiredMemory > safeMemoryLimit)
+            {
+                plan.missingMemory = requiredMemory - safeMemoryLimit;
+                return plan;
+            }
+
+            //memory available for this window
+            size_t windowLimit = safeMemoryLimit - usedMemory - reservedMemory;
+            if (doubleBuffer)
+                windowLimit = std::min(windowLimit, (safeMemoryLimit - usedMemory)/2);
+
+            size_t windowMemory = 0;
+            size_t windowMemoryGrowth = 0;
+
+            if (secondPass)
+            {
+                //in the second phase we load training points only
+                size_t endStripe = fromStripe;
+                size_t startStripe = endStripe + 1;
+
+                //the lowest y that pending points of this and the higher stripes may need to search
+                double minY = std::numeric_limits<double>::max();
+                for (size_t iStripe = fromStripe + 1; iStripe < numStripes; ++iStripe)
+                    minY = std::min(minY, pPendingPoints->GetDownMinY(iStripe));
+
+                std::vector<bool> loadTraining;
+
+                //find how many stripes can fit into available memory
+                do
+                {
+                    //stripes that are out of reach of all pending points are not loaded
+                    minY = std::min(minY, pPendingPoints->GetDownMinY(startStripe - 1));
+                    bool isNeeded = pStripeBoundaries->at(startStripe - 1).maxY > minY;
+
+                    //add stripes of training points until we reach the memory limit
+                    size_t sizeTraining = isNeeded ? (pTrainingStripeCount->at(startStripe - 1))*sizeof(Point) : 0;
+                    size_t sizeSpilled = pPendingPoints->GetNumSpilledPoints(startStripe - 1, true)*pendingPointMemory;
+
+                    if (windowMemory + sizeTraining + sizeSpilled <= windowLimit)
                     {
-                        stripeBoundaries.minY = 1.0001;
-                        stripeBoundaries.maxY = 1.0001;
+                        windowMemory += sizeTraining + sizeSpilled;
+                        windowMemoryGrowth += sizeSpilled;
+                        loadTraining.push_back(isNeeded);
+                        --startStripe;
                     }
                     else
+                        break;
+                } while (startStripe > 0);
+
+                if (endStripe >= startStripe)
+                {
+                    //the flags have been added from higher to lower stripes
+                    std::reverse(loadTraining.begin(), loadTraining.end());
+                    plan = {startStripe, endStripe, true, windowMemory, windowMemoryGrowth, true, 0, std::move(loadTraining), 0};
+                }
+            }
+            else
+            {
+                //this is the first phase of the algorithm, we load input and training point stripes
+                size_t startStripe = fromStripe;
+                size_t endStripe = startStripe;
+
+                //find how many stripes can fit into available memory
+                do
+                {
+                    size_t sizeInput = (pInputStripeCount->at(endStripe))*sizeof(Point);
+                    size_t sizeTraining = (pTrainingStripeCount->at(endStripe))*sizeof(Point);
+                    size_t sizeNeighbors = (pInputStripeCount->at(endStripe))*heapMemory;
+                    size_t sizeSpilled = pPendingPoints->GetNumSpilledPoints(endStripe, false)*pendingPointMemory;
+                    size_t additionalMemory = sizeInput + sizeTraining + sizeNeighbors + sizeSpilled;
+                    //the heaps are allocated when the first neighbor is added and the spilled points are read back when the window is processed
+                    size_t additionalGrowth = (sizeNeighbors - (pInputStripeCount->at(endStripe))*sizeof(PointNeighbors<neighbors_priority_queue_t>)) + sizeSpilled;
+
+                    if (windowMemory + additionalMemory <= windowLimit)
                     {
-                        stripeBoundaries.minY = trainingIterStart->y;
-                        stripeBoundaries.maxY = trainingIterStart->y;
+                        windowMemory += additionalMemory;
+                        windowMemoryGrowth += additionalGrowth;
+                        ++endStripe;
                     }
+                    else
+                        break;
+
+                    //the halo is added after the first stripe, so it does not take the memory of the first stripe but it may limit the rest of the window
+                    if (haloWindows && endStripe == fromStripe + 1)
+                        windowMemory += PlanHalo(fromStripe, windowLimit/2 - std::min(windowLimit/2, windowMemory), startStripe);
+                } while (endStripe <= numStripes - 1);
+
+                if (endStripe > fromStripe)
+                {
+                    plan = {startStripe, endStripe - 1, false, windowMemory, windowMemoryGrowth, true, fromStripe - startStripe, {}, 0};
+                }
+            }
+
+            //with double buffering the first stripe may not fit into half of the memory
+            if (!plan.isValid)
+                plan.missingMemory = firstStripeMemory > windowLimit ? firstStripeMemory - windowLimit : 1;
+
+            return plan;
+        }
+
+        /** \brief Finds the stripes below a window that contain training points within the expected distance of the k-th neighbor
+         *          Input points of the window search these stripes in the first phase, so most of them do not need the second phase.
+         *          The expected distance is the mean distance of the k-th neighbor of the input points processed so far plus HALO_RADIUS_DEVIATIONS standard deviations.
+         * \param fromStripe size_t the first stripe of the window
+         * \param haloLimit size_t memory available for the training points of the halo
+         * \param startStripe size_t& the first stripe of the halo, equal to fromStripe if there is no halo
+         * \return size_t the memory of the halo
+         *
+         */
+        size_t PlanHalo(size_t fromStripe, size_t haloLimit, size_t& startStripe) const
+        {
+            startStripe = fromStripe;
+            if (numKthDistances == 0)
+                return 0;
+
+            double meanDistance = sumKthDistance/numKthDistances;
+            double variance = std::max(0.0, sumSquaredKthDistance/numKthDistances - meanDistance*meanDistance);
+            double haloMinY = pStripeBoundaries->at(fromStripe).minY - (meanDistance + HALO_RADIUS_DEVIATIONS*sqrt(variance));
+
+            size_t haloMemory = 0;
+            while (startStripe > 0 && pStripeBoundaries->at(startStripe - 1).maxY > haloMinY)
+            {
+                size_t sizeTraining = (pTrainingStripeCount->at(startStripe - 1))*sizeof(Point);
+                if (haloMemory + sizeTraining > haloLimit)
+                    break;
+
+                haloMemory += sizeTraining;
+                --startStripe;
+            }
+
+            return haloMemory;
+        }
+
+        /** \brief Copies the stripes of a planned window from the STXXL vectors to RAM
+         *          It may run in a background thread, it only reads the striped datasets which are not modified after splitting.
+         *          The counts of the window are kept in the window and they are added to the counts of the result by AcceptWindow
+         * \param plan const StripesWindowPlan& the range of stripes
+         * \return unique_ptr<StripesWindow> the window of stripes
+         *
+         */
+        std::unique_ptr<StripesWindow> LoadWindow(const StripesWindowPlan& plan)
+        {
+            ProfileSample loadStart = PhaseProfiler::Now();
+            size_t numLoadedTrainingPoints = 0;
+
+            size_t startStripe = plan.startStripe;
+            size_t endStripe = plan.endStripe;
+            size_t numWindowStripes = endStripe - startStripe + 1;
+
+            std::unique_ptr<point_vector_vector_t> pInputStripes, pTrainingStripes(new point_vector_vector_t(numWindowStripes));
+            std::unique_ptr<std::vector<StripeBoundaries_t>> pBoundaries(new std::vector<StripeBoundaries_t>(numWindowStripes));
+
+            if (!plan.secondPass)
+                pInputStripes.reset(new point_vector_vector_t(numWindowStripes));
+
+            //add stripes to the window
+            for (size_t iStripe = startStripe; iStripe <= endStripe; ++iStripe)
+            {
+                auto& trainingPoints = pTrainingStripes->at(iStripe-startStripe);
+                auto& boundaries = pBoundaries->at(iStripe-startStripe);
+
+                //add input point stripes, in the second phase and in the halo we need training points only
+                if (!plan.secondPass && iStripe >= startStripe + plan.haloStripes && pInputStripeCount->at(iStripe) > 0)
+                {
+                    auto& inputPoints = pInputStripes->at(iStripe-startStripe);
+                    auto inputStart = pStripedInputDataset->cbegin() + pInputStripeOffset->at(iStripe);
+                    auto inputEnd = inputStart + pInputStripeCount->at(iStripe);
+                    inputPoints.reserve(pInputStripeCount->at(iStripe));
+                    std::copy(inputStart, inputEnd, std::back_inserter(inputPoints));
                 }
+
+                //add training point stripes
+                if (pTrainingStripeCount->at(iStripe) > 0 && (plan.loadTraining.empty() || plan.loadTraining[iStripe-startStripe]))
+                {
+                    numLoadedTrainingPoints += pTrainingStripeCount->at(iStripe);
+                    auto trainingStart = pStripedTrainingDataset->cbegin() + pTrainingStripeOffset->at(iStripe);
+                    auto trainingEnd = trainingStart + pTrainingStripeCount->at(iStripe);
+                    trainingPoints.reserve(pTrainingStripeCount->at(iStripe));
+                    std::copy(trainingStart, trainingEnd, std::back_inserter(trainingPoints));
+                }
+
+                //store the boundaries of each stripe
+                boundaries.minY = pStripeBoundaries->at(iStripe).minY;
+                boundaries.maxY = pStripeBoundaries->at(iStripe).maxY;
+            }
+
+            std::unique_ptr<StripesWindow> pWindow;
+
+            if (plan.secondPass)
+            {
+                pWindow.reset(new StripesWindow(startStripe, endStripe, pTrainingStripes, pBoundaries));
+            }
+            else
+            {
+                pWindow.reset(new StripesWindow(startStripe, endStripe, pInputStripes, pTrainingStripes, pBoundaries, problem.GetNumNeighbors()));
             }
+
+            pWindow->SetMemoryGrowth(plan.memoryGrowth);
+            pWindow->SetNumHaloStripes(plan.haloStripes);
+            pWindow->SetNumLoadedTrainingPoints(numLoadedTrainingPoints);
+            pWindow->SetLoadSamples(loadStart, PhaseProfiler::Now());
+            return pWindow;
+        }
+
+        /** \brief Counts a loaded window and records the time waited for it, it is called by the main thread when it takes the window
+         *
+         * \param window StripesWindow& the loaded window
+         * \param waitStart const ProfileSample& the time the main thread started waiting for the window
+         * \param isBackground bool true if the window has been loaded by a background thread
+         * \return void
+         *
+         */
+        void AcceptWindow(StripesWindow& window, const ProfileSample& waitStart, bool isBackground)
+        {
+            ProfileSample waitFinish = PhaseProfiler::Now();
+            long stripe = long(window.GetStartStripe());
+
+            window.SetDurationIOWait(std::chrono::duration<double>(waitFinish.time - waitStart.time));
+            PhaseProfiler::Record(ProfilePhase::WindowIOWait, waitStart, waitFinish, stripe);
+
+            if (isBackground)
+                PhaseProfiler::RecordBackground(ProfilePhase::WindowLoad, window.GetLoadStart(), window.GetLoadFinish(), stripe);
+            else
+                PhaseProfiler::Record(ProfilePhase::WindowLoad, window.GetLoadStart(), window.GetLoadFinish(), stripe);
+
+            if (window.IsSecondPass())
+                ++numSecondPassWindows;
+            else
+                ++numFirstPassWindows;
+
+            numLoadedTrainingPoints += window.GetNumLoadedTrainingPoints();
         }
 
         /** \brief Returns true if search of k nearest neighbors neighbors has been completed
@@ -32,6 +32,9 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
             auto trainingDatasetSortedYBegin = trainingDatasetSortedY.cbegin();
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = inputDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
@@ -78,13 +81,15 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
                     if (inputIterStart < inputIterEnd)
                     {
                         inputStripe.assign(inputIterStart, inputIterEnd);
+                        ProfileSample sortStart = PhaseProfiler::Now();
                         sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
                              {
                                  return point1.x < point2.x;
                              });
+                        PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
-                        stripeBoundaries.minY =  i > 0 ? inputIterStart->y : 0.0;
-                        stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : 1.0001) : 1.0001;
+                        stripeBoundaries.minY =  i > 0 ? inputIterStart->y : lowerLimitY;
+                        stripeBoundaries.maxY =  i < numStripes - 1 ? (inputIterEnd < inputDatasetSortedYEnd ? inputIterEnd->y : upperLimitY) : upperLimitY;
 
                         auto trainingIterStart = lower_bound(trainingDatasetSortedYBegin, trainingDatasetSortedYEnd, stripeBoundaries.minY,
                                                         [](const Point& point, const double& value) { return point.y < value; });
@@ -96,18 +101,20 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
                         if (trainingIterStart < trainingIterEnd)
                         {
                             trainingStripe.assign(trainingIterStart, trainingIterEnd);
+                            ProfileSample sortStart = PhaseProfiler::Now();
                             sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
                              {
                                  return point1.x < point2.x;
                              });
+                            PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
                         }
                     }
                     else
                     {
                         if (inputIterStart >= inputDatasetSortedYEnd)
                         {
-                            stripeBoundaries.minY = 1.0001;
-                            stripeBoundaries.maxY = 1.0001;
+                            stripeBoundaries.minY = upperLimitY;
+                            stripeBoundaries.maxY = upperLimitY;
                         }
                         else
                         {
@@ -127,6 +134,9 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
             auto trainingDatasetSortedYBegin = trainingDatasetSortedY.cbegin();
             auto trainingDatasetSortedYEnd = trainingDatasetSortedY.cend();
 
+            double lowerLimitY = GetStripesLowerLimitY(problem.GetBoundingBox());
+            double upperLimitY = GetStripesUpperLimitY(problem.GetBoundingBox());
+
             size_t numRemainingPoints = trainingDatasetSortedY.size() % numStripes;
             if (numRemainingPoints != 0)
             {
@@ -173,13 +183,15 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
                     if (trainingIterStart < trainingIterEnd)
                     {
                         trainingStripe.assign(trainingIterStart, trainingIterEnd);
+                        ProfileSample sortStart = PhaseProfiler::Now();
                         sort(trainingStripe.begin(), trainingStripe.end(), [](const Point& point1, const Point& point2)
                              {
                                  return point1.x < point2.x;
                              });
+                        PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
 
-                        stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : 0.0;
-                        stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : 1.0001) : 1.0001;
+                        stripeBoundaries.minY =  i > 0 ? trainingIterStart->y : lowerLimitY;
+                        stripeBoundaries.maxY =  i < numStripes - 1 ? (trainingIterEnd < trainingDatasetSortedYEnd ? trainingIterEnd->y : upperLimitY) : upperLimitY;
 
                         auto inputIterStart = lower_bound(inputDatasetSortedYBegin, inputDatasetSortedYEnd, stripeBoundaries.minY,
                                                         [](const Point& point, const double& value) { return point.y < value; });
@@ -191,18 +203,20 @@ class AllKnnResultStripesParallelTBB : public AllKnnResultStripes
                         if (inputIterStart < inputIterEnd)
                         {
                             inputStripe.assign(inputIterStart, inputIterEnd);
+                            ProfileSample sortStart = PhaseProfiler::Now();
                             sort(inputStripe.begin(), inputStripe.end(), [](const Point& point1, const Point& point2)
                              {
                                  return point1.x < point2.x;
                              });
+                            PhaseProfiler::Record(ProfilePhase::SortX, sortStart, PhaseProfiler::Now());
                         }
                     }
                     else
                     {
                         if (trainingIterStart >= trainingDatasetSortedYEnd)
                         {
-                            stripeBoundaries.minY = 1.0001;
-                            stripeBoundaries.maxY = 1.0001;
+                            stripeBoundaries.minY = upperLimitY;
+                            stripeBoundaries.maxY = upperLimitY;
                         }
                         else
                         {
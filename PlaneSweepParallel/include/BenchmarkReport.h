@@ -0,0 +1,263 @@
+/* Class definition for the report of benchmark jobs
+    Each combination of parameters of a job runs a number of times after unmeasured warmup runs. The report summarizes
+    the durations of the repetitions (median, 10th and 90th percentile, mean, standard deviation) and the scaling of each combination
+    with the number of threads, then it is written in JSON for regression tracking.
+ */
+#ifndef BENCHMARKREPORT_H
+#define BENCHMARKREPORT_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <locale>
+#include "ApplicationException.h"
+
+/** \brief Summary of the durations of the repetitions of a combination
+ */
+struct DurationStatistics
+{
+    double median = 0.0;
+    double p10 = 0.0;       /**< 10th percentile */
+    double p90 = 0.0;       /**< 90th percentile */
+    double mean = 0.0;
+    double stddev = 0.0;    /**< sample standard deviation, 0 for a single repetition */
+    double min = 0.0;
+    double max = 0.0;
+
+    /** \brief Calculates the statistics of the durations
+     *
+     * \param durations std::vector<double> the durations of the repetitions in seconds
+     * \return DurationStatistics
+     *
+     */
+    static DurationStatistics Compute(std::vector<double> durations)
+    {
+        DurationStatistics statistics;
+        size_t n = durations.size();
+
+        if (n == 0)
+            return statistics;
+
+        std::sort(durations.begin(), durations.end());
+
+        statistics.median = Percentile(durations, 0.5);
+        statistics.p10 = Percentile(durations, 0.1);
+        statistics.p90 = Percentile(durations, 0.9);
+        statistics.min = durations.front();
+        statistics.max = durations.back();
+        statistics.mean = std::accumulate(durations.cbegin(), durations.cend(), 0.0)/n;
+
+        if (n > 1)
+        {
+            double sumSquares = 0.0;
+            for (auto duration : durations)
+                sumSquares += (duration - statistics.mean)*(duration - statistics.mean);
+
+            statistics.stddev = sqrt(sumSquares/(n - 1));
+        }
+
+        return statistics;
+    }
+
+    /** \brief Calculates a percentile of sorted values by linear interpolation between the closest ranks
+     *
+     * \param sortedValues const std::vector<double>& the values in ascending order, at least one
+     * \param fraction double the percentile as a fraction between 0 and 1
+     * \return double
+     *
+     */
+    static double Percentile(const std::vector<double>& sortedValues, double fraction)
+    {
+        double position = fraction*(sortedValues.size() - 1);
+        size_t lower = size_t(position);
+        size_t upper = std::min(lower + 1, sortedValues.size() - 1);
+
+        return sortedValues[lower] + (position - lower)*(sortedValues[upper] - sortedValues[lower]);
+    }
+};
+
+/** \brief Parameters and measured durations of a combination of a job
+ */
+struct BenchmarkConfiguration
+{
+    std::string algorithmName;
+    std::string algorithmTitle;
+    size_t dataset = 0;             /**< index of the dataset in the job */
+    std::string inputFilename;
+    std::string trainingFilename;
+    size_t numInputPoints = 0;
+    size_t numTrainingPoints = 0;
+    size_t numNeighbors = 0;
+    int numThreads = 0;             /**< number of threads used by the runs */
+    int numStripes = 0;             /**< requested number of stripes, 0 if calculated from the datasets */
+    size_t numStripesUsed = 0;      /**< number of stripes used by every repetition */
+    size_t memoryLimitMB = 0;
+    std::vector<double> durations;
+    DurationStatistics statistics;
+    double speedup = 1.0;           /**< median of the fewest threads of the same dataset divided by the median */
+    double efficiency = 1.0;        /**< speedup divided by the increase of threads */
+    double weakEfficiency = 1.0;    /**< median of the first dataset divided by the median, for weak scaling */
+};
+
+/** \brief Report of the combinations of a benchmark job
+ */
+class BenchmarkReport
+{
+    public:
+        BenchmarkReport(int numWarmupRuns, int numRepetitions, bool weakScaling)
+            : numWarmupRuns(numWarmupRuns), numRepetitions(numRepetitions), weakScaling(weakScaling)
+        {
+        }
+
+        virtual ~BenchmarkReport() {}
+
+        /** \brief Adds a combination after its repetitions and calculates the statistics of its durations
+         *
+         * \param configuration const BenchmarkConfiguration& the combination
+         * \return const BenchmarkConfiguration& the added combination
+         *
+         */
+        const BenchmarkConfiguration& Add(const BenchmarkConfiguration& configuration)
+        {
+            configurations.push_back(configuration);
+            configurations.back().statistics = DurationStatistics::Compute(configuration.durations);
+
+            return configurations.back();
+        }
+
+        const std::vector<BenchmarkConfiguration>& GetConfigurations() const
+        {
+            return configurations;
+        }
+
+        /** \brief Calculates the scaling of all combinations, after they have been added
+         *          The base of strong scaling is the combination with the fewest threads and the same dataset and other parameters,
+         *          the base of weak scaling is the combination of the first dataset with the same parameters
+         * \return void
+         *
+         */
+        void CalcScaling()
+        {
+            for (auto& configuration : configurations)
+            {
+                const BenchmarkConfiguration* pStrongBase = &configuration;
+                const BenchmarkConfiguration* pWeakBase = &configuration;
+
+                for (auto& other : configurations)
+                {
+                    if (!HaveSameParameters(configuration, other))
+                        continue;
+
+                    if (other.dataset == configuration.dataset && other.numThreads < pStrongBase->numThreads)
+                        pStrongBase = &other;
+
+                    if (other.dataset < pWeakBase->dataset)
+                        pWeakBase = &other;
+                }
+
+                configuration.speedup = Ratio(pStrongBase->statistics.median, configuration.statistics.median);
+                configuration.efficiency = configuration.speedup*pStrongBase->numThreads/std::max(configuration.numThreads, 1);
+                configuration.weakEfficiency = Ratio(pWeakBase->statistics.median, configuration.statistics.median);
+            }
+        }
+
+        /** \brief Writes the report to a JSON file
+         *
+         * \param filename const std::string& the file to create
+         * \return void
+         *
+         */
+        void WriteJson(const std::string& filename) const
+        {
+            std::ofstream outFile(filename, std::ios_base::out);
+            if (!outFile.is_open())
+                throw ApplicationException("Cannot create report file " + filename);
+
+            //JSON numbers need the classic format, without thousand separators
+            outFile.imbue(std::locale::classic());
+            outFile << std::setprecision(9);
+
+            outFile << "{\n";
+            outFile << "  \"warmupRuns\": " << numWarmupRuns << ",\n";
+            outFile << "  \"repetitions\": " << numRepetitions << ",\n";
+            outFile << "  \"weakScaling\": " << (weakScaling ? "true" : "false") << ",\n";
+            outFile << "  \"configurations\": [";
+
+            for (size_t i = 0; i < configurations.size(); ++i)
+            {
+                const BenchmarkConfiguration& c = configurations[i];
+                const DurationStatistics& s = c.statistics;
+
+                outFile << (i > 0 ? ",\n" : "\n") << "    {";
+                outFile << "\"algorithm\": " << Quote(c.algorithmName) << ", \"title\": " << Quote(c.algorithmTitle);
+                outFile << ", \"input\": " << Quote(c.inputFilename) << ", \"training\": " << Quote(c.trainingFilename);
+                outFile << ", \"inputPoints\": " << c.numInputPoints << ", \"trainingPoints\": " << c.numTrainingPoints;
+                outFile << ", \"k\": " << c.numNeighbors << ", \"threads\": " << c.numThreads << ", \"stripes\": " << c.numStripes;
+                outFile << ", \"stripesUsed\": " << c.numStripesUsed << ", \"memoryMB\": " << c.memoryLimitMB;
+
+                outFile << ", \"durations\": [";
+                for (size_t iDuration = 0; iDuration < c.durations.size(); ++iDuration)
+                    outFile << (iDuration > 0 ? ", " : "") << c.durations[iDuration];
+                outFile << "]";
+
+                outFile << ", \"median\": " << s.median << ", \"p10\": " << s.p10 << ", \"p90\": " << s.p90;
+                outFile << ", \"mean\": " << s.mean << ", \"stddev\": " << s.stddev << ", \"min\": " << s.min << ", \"max\": " << s.max;
+                outFile << ", \"speedup\": " << c.speedup << ", \"efficiency\": " << c.efficiency;
+
+                if (weakScaling)
+                    outFile << ", \"weakEfficiency\": " << c.weakEfficiency;
+
+                outFile << "}";
+            }
+
+            outFile << "\n  ]\n}\n";
+            outFile.close();
+        }
+
+    private:
+        int numWarmupRuns = 0;
+        int numRepetitions = 1;
+        bool weakScaling = false;
+        std::vector<BenchmarkConfiguration> configurations;
+
+        static bool HaveSameParameters(const BenchmarkConfiguration& c1, const BenchmarkConfiguration& c2)
+        {
+            return c1.algorithmName == c2.algorithmName && c1.numNeighbors == c2.numNeighbors
+                && c1.numStripes == c2.numStripes && c1.memoryLimitMB == c2.memoryLimitMB;
+        }
+
+        static double Ratio(double base, double value)
+        {
+            return value > 0.0 ? base/value : 0.0;
+        }
+
+        static std::string Quote(const std::string& text)
+        {
+            std::string quoted = "\"";
+
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    quoted += '\\';
+                    quoted += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    quoted += ' ';
+                }
+                else
+                {
+                    quoted += c;
+                }
+            }
+
+            return quoted + "\"";
+        }
+};
+
+#endif // BENCHMARKREPORT_H
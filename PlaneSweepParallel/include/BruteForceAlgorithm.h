@@ -37,6 +37,7 @@ class BruteForceAlgorithm : public AbstractAllKnnAlgorithm
             auto& trainingDataset = problem.GetTrainingDataset();
 
             auto start = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -57,6 +58,8 @@ class BruteForceAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
 
@@ -44,6 +44,7 @@ class BruteForceParallelAlgorithm : public AbstractAllKnnAlgorithm
             }
 
             auto start = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -64,6 +65,8 @@ class BruteForceParallelAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
 
@@ -53,6 +53,7 @@ class BruteForceParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
             }
 
             auto start = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -80,6 +81,8 @@ class BruteForceParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
                 }
             );
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
 
@@ -0,0 +1,533 @@
+/* Class definitions for the compact training stripes
+    The training points of each stripe are stored as separate arrays of 32-bit x and y coordinates and 32-bit positions in the training dataset,
+    so a point takes 12 bytes instead of the 24 bytes of a Point. The coordinate type is a template parameter, CompactCoordinates defines
+    how the double coordinates are converted to it: single precision (float) or fixed-point (int32_t) coordinates.
+    The sweep of a stripe examines blocks of eight points and calculates a lower and an upper bound of their distances from the 32-bit coordinates,
+    with AVX2 instructions if they are available. The examined points are appended to a list of candidates and their upper bounds that may be among
+    the k smallest are kept in a small max heap, whose top stops the sweep. The heap of neighbors is not touched by the sweep: when the search
+    of an input point has been completed, only the candidates whose lower bound does not exceed the final k-th upper bound are rechecked with
+    the double coordinates of the training dataset, so the result is exactly the same as the double precision sweep.
+ */
+#ifndef COMPACTSTRIPES_H
+#define COMPACTSTRIPES_H
+
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "PlaneSweepParallel.h"
+#include "PointNeighbors.h"
+#include "AllKnnProblem.h"
+#include "ApplicationException.h"
+#include "SearchCounters.h"
+
+/** \brief Conversion of double coordinates to a compact coordinate type, it is specialized for each supported type
+ *          A specialization defines the scale (units of the compact coordinates per unit of the dataset), the bound of the error
+ *          of a difference of two compact coordinates in units, the conversion of x and y and the difference of coordinates as float
+ */
+template<class Coordinate>
+struct CompactCoordinates;
+
+/** \brief Single precision coordinates relative to the lower corner of the bounding box
+ */
+template<>
+struct CompactCoordinates<float>
+{
+    static constexpr const char* TITLE = "float";
+    static constexpr const char* PREFIX = "float";
+
+    double minX = 0.0;
+    double minY = 0.0;
+    double scale = 1.0;
+    float errorBound = 0.0f;
+
+    CompactCoordinates(const BoundingBox_t& boundingBox) : minX(boundingBox.minX), minY(boundingBox.minY)
+    {
+        double extent = std::max(boundingBox.maxX - boundingBox.minX, boundingBox.maxY - boundingBox.minY);
+
+        //each stored coordinate has an error up to half an epsilon of the extent, so the error of a difference is bounded by one epsilon, we use two
+        errorBound = float(2.0*FLT_EPSILON*extent);
+    }
+
+    inline float ConvertX(double x) const
+    {
+        return float(x - minX);
+    }
+
+    inline float ConvertY(double y) const
+    {
+        return float(y - minY);
+    }
+
+    static inline float Difference(float value1, float value2)
+    {
+        return value1 - value2;
+    }
+
+#ifdef __AVX2__
+    static inline __m256 Difference(const float* values, float value)
+    {
+        return _mm256_sub_ps(_mm256_loadu_ps(values), _mm256_set1_ps(value));
+    }
+#endif
+};
+
+/** \brief Fixed-point coordinates, the coordinates relative to the lower corner of the bounding box are quantized to 2^30 steps of the extent
+ *          Both axes use the same step, and differences of quantized coordinates do not overflow 32 bits
+ */
+template<>
+struct CompactCoordinates<int32_t>
+{
+    static constexpr const char* TITLE = "fixed-point";
+    static constexpr const char* PREFIX = "fixed";
+
+    double minX = 0.0;
+    double minY = 0.0;
+    double scale = 1.0;
+    //quantized values are less than one step below the exact values, so the error of a difference is less than one step, we use two
+    float errorBound = 2.0f;
+
+    CompactCoordinates(const BoundingBox_t& boundingBox) : minX(boundingBox.minX), minY(boundingBox.minY)
+    {
+        double extent = std::max(boundingBox.maxX - boundingBox.minX, boundingBox.maxY - boundingBox.minY);
+        if (!(extent > 0.0))
+            extent = 1.0;
+
+        scale = MAX_VALUE/extent;
+    }
+
+    inline int32_t ConvertX(double x) const
+    {
+        return Quantize((x - minX)*scale);
+    }
+
+    inline int32_t ConvertY(double y) const
+    {
+        return Quantize((y - minY)*scale);
+    }
+
+    static inline float Difference(int32_t value1, int32_t value2)
+    {
+        return float(value1 - value2);
+    }
+
+#ifdef __AVX2__
+    static inline __m256 Difference(const int32_t* values, int32_t value)
+    {
+        return _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)), _mm256_set1_epi32(value)));
+    }
+#endif
+
+    private:
+        static constexpr double MAX_VALUE = 1073741824.0;
+
+        //the points of both datasets are inside the bounding box, the limits only guard the conversion
+        static inline int32_t Quantize(double value)
+        {
+            return int32_t(std::min(std::max(value, -MAX_VALUE), MAX_VALUE));
+        }
+};
+
+/** \brief Compact training stripes of a coordinate type
+ */
+template<class Coordinate>
+class CompactStripes
+{
+    public:
+        /** \brief The coordinates of the training points of a stripe sorted by x, and their positions in the training dataset
+         */
+        struct Stripe
+        {
+            std::vector<Coordinate> x;
+            std::vector<Coordinate> y;
+            std::vector<uint32_t> position;
+        };
+
+        /** \brief The search of the neighbors of one input point at a time, each thread has its own
+         */
+        class PointSearch
+        {
+            public:
+                /** \brief Constructor
+                 *
+                 * \param stripes const CompactStripes& the stripes to search
+                 * \param numNeighbors size_t the number of nearest neighbors (k)
+                 *
+                 */
+                PointSearch(const CompactStripes& stripes, size_t numNeighbors) : stripes(stripes), numNeighbors(numNeighbors)
+                {
+                    upperBounds.reserve(numNeighbors);
+                    candidateLowerBounds.resize(4*numNeighbors + MIN_CANDIDATES);
+                    candidatePositions.resize(4*numNeighbors + MIN_CANDIDATES);
+                }
+
+                /** \brief Starts the search of an input point
+                 *
+                 * \param inputPoint const Point& the input point
+                 * \return void
+                 *
+                 */
+                void Start(const Point& inputPoint)
+                {
+                    x = stripes.coordinates.ConvertX(inputPoint.x);
+                    y = stripes.coordinates.ConvertY(inputPoint.y);
+                    upperBounds.clear();
+                    numCandidates = 0;
+                    threshold = INFINITY;
+                }
+
+                /** \brief Returns an upper bound of the squared distance of the k-th neighbor found so far, it is infinite until k points have been examined
+                 *
+                 * \return double
+                 *
+                 */
+                double GetMaxDistanceSquared() const
+                {
+                    return double(threshold)*stripes.unitSquared*(1.0 + ROUNDING);
+                }
+
+                /** \brief Searches for candidates in a specific stripe
+                 *          The sweep moves alternately to lower and higher x like the double precision sweep, but it examines a block of eight
+                 *          points in each direction at a time
+                 * \param iStripe int index of stripe to be examined
+                 * \param mindy double squared distance of input point from the nearest boundary of the stripe
+                 * \return void
+                 *
+                 */
+                void PlaneSweepStripe(int iStripe, double mindy)
+                {
+                    COUNT_SEARCH(stripesVisited, 1);
+                    auto& stripe = stripes.stripes[iStripe];
+                    size_t numPoints = stripe.x.size();
+
+                    if (numPoints == 0)
+                        return;
+
+                    float mindyUnits = float(mindy*stripes.scaleSquared*(1.0 - ROUNDING));
+
+                    //the conversion is monotonic, so the compact array is sorted like the stripe points
+                    size_t high = std::lower_bound(stripe.x.cbegin(), stripe.x.cend(), x,
+                                [](Coordinate value1, Coordinate value2) { COUNT_SEARCH(binarySearchSteps, 1); return value1 < value2; }) - stripe.x.cbegin();
+                    size_t low = high;
+                    bool lowStop = low == 0;
+                    bool highStop = high == numPoints;
+
+                    //the sweep in each direction stops before a block whose nearest point is farther than the k-th upper bound,
+                    //the block to lower x ends at the current low end and the block to higher x starts at the current high end
+                    while (!lowStop || !highStop)
+                    {
+                        if (!lowStop)
+                        {
+                            lowStop = IsSweepCompleted(CompactCoordinates<Coordinate>::Difference(x, stripe.x[low - 1]), mindyUnits);
+
+                            if (!lowStop)
+                            {
+                                size_t count = std::min(low, BLOCK_SIZE);
+                                low -= count;
+                                AddCandidates(stripe, low, count, true);
+                                lowStop = low == 0;
+                            }
+                        }
+
+                        if (!highStop)
+                        {
+                            highStop = IsSweepCompleted(CompactCoordinates<Coordinate>::Difference(stripe.x[high], x), mindyUnits);
+
+                            if (!highStop)
+                            {
+                                size_t count = std::min(numPoints - high, BLOCK_SIZE);
+                                AddCandidates(stripe, high, count, false);
+                                high += count;
+                                highStop = high == numPoints;
+                            }
+                        }
+                    }
+                }
+
+                /** \brief Completes the search of the input point, the candidates whose lower bound does not exceed the k-th upper bound
+                 *          are rechecked with the double coordinates and added to the heap of neighbors
+                 * \param inputPointIter point_vector_iterator_t iterator pointing to the input point
+                 * \param neighbors PointNeighbors<neighbors_priority_queue_t>& object containing the max heap of neighbors for the given input point
+                 * \return void
+                 *
+                 */
+                void Finish(point_vector_iterator_t inputPointIter, PointNeighbors<neighbors_priority_queue_t>& neighbors)
+                {
+                    for (size_t i = 0; i < numCandidates; ++i)
+                    {
+                        if (candidateLowerBounds[i] <= threshold)
+                        {
+                            auto trainingPointIter = stripes.trainingDataset.cbegin() + candidatePositions[i];
+                            double dx = trainingPointIter->x - inputPointIter->x;
+                            double dy = trainingPointIter->y - inputPointIter->y;
+                            COUNT_SEARCH(distanceEvaluations, 1);
+                            neighbors.Add(trainingPointIter, dx*dx + dy*dy);
+                        }
+                    }
+                }
+
+            private:
+                const CompactStripes& stripes;
+                size_t numNeighbors = 0;
+                Coordinate x = Coordinate();
+                Coordinate y = Coordinate();
+                float threshold = INFINITY;     /**< the k-th smallest upper bound, the top of upperBounds when it holds k bounds */
+                std::vector<float> upperBounds; /**< max heap of the k smallest upper bounds */
+                //the candidates are all examined points, their lower bounds are compared with the threshold only when the list is full
+                //and when the search has been completed
+                std::vector<float> candidateLowerBounds;
+                std::vector<uint32_t> candidatePositions;
+                size_t numCandidates = 0;
+
+                /** \brief Adds an upper bound to the heap of the k smallest upper bounds
+                 *
+                 * \param upperBound float
+                 * \return void
+                 *
+                 */
+                inline void AddUpperBound(float upperBound)
+                {
+                    if (upperBounds.size() < numNeighbors)
+                    {
+                        upperBounds.push_back(upperBound);
+                        std::push_heap(upperBounds.begin(), upperBounds.end());
+                    }
+                    else
+                    {
+                        //replace the top and sift it down in one pass
+                        size_t numBounds = upperBounds.size();
+                        size_t i = 0;
+                        size_t child = 1;
+
+                        while (child < numBounds)
+                        {
+                            if (child + 1 < numBounds && upperBounds[child + 1] > upperBounds[child])
+                                ++child;
+
+                            if (upperBounds[child] <= upperBound)
+                                break;
+
+                            upperBounds[i] = upperBounds[child];
+                            i = child;
+                            child = 2*i + 1;
+                        }
+
+                        upperBounds[i] = upperBound;
+                    }
+
+                    if (upperBounds.size() == numNeighbors)
+                        threshold = upperBounds.front();
+                }
+
+                /** \brief Examines a block of points, the points are added to the candidates and their upper bounds to the heap of upper bounds
+                 *
+                 * \param stripe const Stripe& the stripe
+                 * \param start size_t the first point of the block
+                 * \param count size_t the number of points of the block, up to eight
+                 * \param reverse bool true to add the upper bounds from the last point of the block to the first
+                 * \return void
+                 *
+                 */
+                inline void AddCandidates(const Stripe& stripe, size_t start, size_t count, bool reverse)
+                {
+                    COUNT_SEARCH(candidatesExamined, count);
+
+                    if (numCandidates + BLOCK_SIZE > candidateLowerBounds.size())
+                    {
+                        RemoveCandidates();
+
+                        if (numCandidates + BLOCK_SIZE > candidateLowerBounds.size())
+                        {
+                            candidateLowerBounds.resize(2*candidateLowerBounds.size());
+                            candidatePositions.resize(2*candidatePositions.size());
+                        }
+                    }
+
+                    float blockUpperBounds[BLOCK_SIZE];
+                    int mask = GetBounds(stripe, start, count, &candidateLowerBounds[numCandidates], blockUpperBounds);
+                    std::copy_n(stripe.position.cbegin() + start, count, candidatePositions.begin() + numCandidates);
+                    numCandidates += count;
+
+                    while (mask != 0)
+                    {
+                        int j;
+                        if (reverse)
+                        {
+                            j = 31 - __builtin_clz(mask);
+                            mask &= ~(1 << j);
+                        }
+                        else
+                        {
+                            j = __builtin_ctz(mask);
+                            mask &= mask - 1;
+                        }
+
+                        //the threshold may have been lowered by the previous points of the block
+                        if (blockUpperBounds[j] < threshold)
+                        {
+                            AddUpperBound(blockUpperBounds[j]);
+
+                            //the point is probably one of the neighbors, so its double coordinates are requested long before the recheck
+                            __builtin_prefetch(&stripes.trainingDataset[stripe.position[start + j]]);
+                        }
+                    }
+                }
+
+                /** \brief Calculates the bounds of the squared distances of a block of points in units of the compact coordinates
+                 *          A full block of eight points is examined with AVX2 instructions, if they are available.
+                 * \param stripe const Stripe& the stripe
+                 * \param start size_t the first point of the block
+                 * \param count size_t the number of points of the block, up to eight
+                 * \param lowerBounds float* the lower bounds
+                 * \param upperBounds float* the upper bounds
+                 * \return int bit j is set if the upper bound of point start+j is less than the threshold
+                 *
+                 */
+                inline int GetBounds(const Stripe& stripe, size_t start, size_t count, float* lowerBounds, float* upperBounds) const
+                {
+                    const float errorBound = stripes.coordinates.errorBound;
+
+#ifdef __AVX2__
+                    if (count == BLOCK_SIZE)
+                    {
+                        const __m256 signMask = _mm256_set1_ps(-0.0f);
+                        const __m256 zero = _mm256_setzero_ps();
+                        const __m256 bound = _mm256_set1_ps(errorBound);
+                        const __m256 lowFactor = _mm256_set1_ps(1.0f - ROUNDING);
+                        const __m256 highFactor = _mm256_set1_ps(1.0f + ROUNDING);
+
+                        __m256 dx = _mm256_andnot_ps(signMask, CompactCoordinates<Coordinate>::Difference(&stripe.x[start], x));
+                        __m256 dy = _mm256_andnot_ps(signMask, CompactCoordinates<Coordinate>::Difference(&stripe.y[start], y));
+
+                        __m256 lowX = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(dx, lowFactor), bound), zero);
+                        __m256 lowY = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(dy, lowFactor), bound), zero);
+                        __m256 highX = _mm256_add_ps(_mm256_mul_ps(dx, highFactor), bound);
+                        __m256 highY = _mm256_add_ps(_mm256_mul_ps(dy, highFactor), bound);
+
+                        __m256 lowerBound = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(lowX, lowX), _mm256_mul_ps(lowY, lowY)), lowFactor);
+                        __m256 upperBound = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(highX, highX), _mm256_mul_ps(highY, highY)), highFactor);
+
+                        _mm256_storeu_ps(lowerBounds, lowerBound);
+                        _mm256_storeu_ps(upperBounds, upperBound);
+                        return _mm256_movemask_ps(_mm256_cmp_ps(upperBound, _mm256_set1_ps(threshold), _CMP_LT_OQ));
+                    }
+#endif
+
+                    int mask = 0;
+
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        float dx = std::fabs(CompactCoordinates<Coordinate>::Difference(stripe.x[start + j], x));
+                        float dy = std::fabs(CompactCoordinates<Coordinate>::Difference(stripe.y[start + j], y));
+                        float lowX = std::max(dx*(1.0f - ROUNDING) - errorBound, 0.0f);
+                        float lowY = std::max(dy*(1.0f - ROUNDING) - errorBound, 0.0f);
+                        float highX = dx*(1.0f + ROUNDING) + errorBound;
+                        float highY = dy*(1.0f + ROUNDING) + errorBound;
+
+                        lowerBounds[j] = (lowX*lowX + lowY*lowY)*(1.0f - ROUNDING);
+                        upperBounds[j] = (highX*highX + highY*highY)*(1.0f + ROUNDING);
+
+                        if (upperBounds[j] < threshold)
+                            mask |= 1 << j;
+                    }
+
+                    return mask;
+                }
+
+                /** \brief Checks if the sweep in one direction can stop, because all remaining points are farther than the k-th upper bound
+                 *
+                 * \param dx float the difference of x in units
+                 * \param mindyUnits float the lower bound of the squared distance of input point from the nearest boundary of the stripe in units
+                 * \return bool
+                 *
+                 */
+                inline bool IsSweepCompleted(float dx, float mindyUnits) const
+                {
+                    float lowX = std::max(std::fabs(dx)*(1.0f - ROUNDING) - stripes.coordinates.errorBound, 0.0f);
+                    bool isCompleted = lowX*lowX*(1.0f - ROUNDING) + mindyUnits > threshold;
+                    COUNT_SEARCH(dxTerminations, isCompleted ? 1 : 0);
+                    return isCompleted;
+                }
+
+                /** \brief Removes the candidates whose lower bound exceeds the threshold, they cannot be among the k nearest points
+                 *
+                 * \return void
+                 *
+                 */
+                void RemoveCandidates()
+                {
+                    size_t numRemaining = 0;
+
+                    for (size_t i = 0; i < numCandidates; ++i)
+                    {
+                        candidateLowerBounds[numRemaining] = candidateLowerBounds[i];
+                        candidatePositions[numRemaining] = candidatePositions[i];
+                        numRemaining += candidateLowerBounds[i] <= threshold ? 1 : 0;
+                    }
+
+                    numCandidates = numRemaining;
+                }
+        };
+
+        /** \brief Constructor
+         *
+         * \param trainingDataset const point_vector_t& the training dataset, its points are read for the exact recheck of candidates
+         * \param boundingBox const BoundingBox_t& the bounding box of both datasets
+         * \param numStripes size_t the number of stripes
+         */
+        CompactStripes(const point_vector_t& trainingDataset, const BoundingBox_t& boundingBox, size_t numStripes)
+            : trainingDataset(trainingDataset), coordinates(boundingBox), stripes(numStripes)
+        {
+            if (trainingDataset.size() > std::numeric_limits<uint32_t>::max())
+                throw ApplicationException("Compact stripes support training datasets of up to 2^32-1 points.");
+
+            scaleSquared = coordinates.scale*coordinates.scale;
+            unitSquared = 1.0/scaleSquared;
+        }
+
+        virtual ~CompactStripes() {}
+
+        /** \brief Converts the training points of a stripe to compact coordinates, the points of the stripe are not needed afterwards
+         *
+         * \param iStripe size_t the index of the stripe
+         * \param trainingStripe const point_vector_t& the training points of the stripe sorted by x
+         * \param positionsById const std::vector<point_id_t>& the positions of the training points in the training dataset by point id
+         * \return void
+         *
+         */
+        void AddStripe(size_t iStripe, const point_vector_t& trainingStripe, const std::vector<point_id_t>& positionsById)
+        {
+            auto& stripe = stripes[iStripe];
+            size_t numPoints = trainingStripe.size();
+            stripe.x.resize(numPoints);
+            stripe.y.resize(numPoints);
+            stripe.position.resize(numPoints);
+
+            for (size_t i=0; i < numPoints; ++i)
+            {
+                stripe.x[i] = coordinates.ConvertX(trainingStripe[i].x);
+                stripe.y[i] = coordinates.ConvertY(trainingStripe[i].y);
+                stripe.position[i] = uint32_t(positionsById[trainingStripe[i].id - 1]);
+            }
+        }
+
+    private:
+        //relative error of the single precision differences, squares and sums, with a wide margin
+        static constexpr float ROUNDING = 1.0f/(1 << 20);
+        static constexpr size_t BLOCK_SIZE = 8;
+        //the list of candidates holds four times k plus this number before the candidates beyond the threshold are removed
+        static constexpr size_t MIN_CANDIDATES = 64;
+
+        const point_vector_t& trainingDataset;
+        CompactCoordinates<Coordinate> coordinates;
+        double scaleSquared = 1.0;
+        double unitSquared = 1.0;
+        std::vector<Stripe> stripes;
+};
+
+#endif // COMPACTSTRIPES_H
@@ -0,0 +1,216 @@
+/* Class definition for the preprocessing transform that selects the axis used for splitting datasets into stripes
+    Stripes are always horizontal bands in y and the sweep is always performed in x,
+    so instead of changing the algorithms we change the coordinates of both datasets.
+    The transform is orthonormal, an axis swap preserves all distances exactly and a rotation preserves them up to the rounding
+    of the rotated coordinates (see GetDistanceTolerance). The rotation is applied about the mean of the data, so the rounding
+    grows with the spread of the data and not with its distance from the origin.
+ */
+#ifndef DATASETTRANSFORM_H
+#define DATASETTRANSFORM_H
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <sstream>
+#include "PlaneSweepParallel.h"
+
+/** \brief Mode of selecting the stripe axis
+ */
+enum class StripeAxisMode
+{
+    Y = 0,      /**< stripes in y, sweep in x (no transform) */
+    Auto = 1,   /**< swap x and y if the data spread in y is greater than the spread in x */
+    Pca = 2     /**< rotate coordinates onto the principal axes of the data */
+};
+
+/** \brief Orthonormal transform of coordinates applied to input and training datasets
+ */
+class DatasetTransform
+{
+    public:
+        DatasetTransform(StripeAxisMode mode) : mode(mode)
+        {
+        }
+
+        virtual ~DatasetTransform() {}
+
+        /** \brief Accumulates the statistics (mean and covariance) of a dataset
+         *
+         * \param dataset const PointVector& the internal or external memory vector of points
+         * \return void
+         *
+         */
+        template<class PointVector>
+        void AddDataset(const PointVector& dataset)
+        {
+            for (auto iter = dataset.cbegin(); iter != dataset.cend(); ++iter)
+            {
+                AddPoint(*iter);
+            }
+        }
+
+        /** \brief Accumulates the statistics of a single point (Welford's online algorithm)
+         *
+         * \param point const Point&
+         * \return void
+         *
+         */
+        void AddPoint(const Point& point)
+        {
+            ++count;
+            double dx = point.x - meanX;
+            meanX += dx/count;
+            double dy = point.y - meanY;
+            meanY += dy/count;
+            m2X += dx*(point.x - meanX);
+            m2Y += dy*(point.y - meanY);
+            coMoment += dx*(point.y - meanY);
+        }
+
+        /** \brief Combines the statistics accumulated by another transform (parallel algorithm of Chan et al.)
+         *
+         * \param other const DatasetTransform& the transform that accumulated the statistics of other points
+         * \return void
+         *
+         */
+        void Merge(const DatasetTransform& other)
+        {
+            if (other.count == 0)
+                return;
+
+            size_t total = count + other.count;
+            double dx = other.meanX - meanX;
+            double dy = other.meanY - meanY;
+            double weight = double(count)*double(other.count)/double(total);
+
+            m2X += other.m2X + dx*dx*weight;
+            m2Y += other.m2Y + dy*dy*weight;
+            coMoment += other.coMoment + dx*dy*weight;
+            meanX += dx*double(other.count)/double(total);
+            meanY += dy*double(other.count)/double(total);
+            count = total;
+        }
+
+        /** \brief Returns true if the transform needs the statistics of the datasets, without them it stays the identity
+         *
+         * \return bool
+         *
+         */
+        bool NeedsStatistics() const
+        {
+            return mode != StripeAxisMode::Y;
+        }
+
+        /** \brief Calculates the transform matrix from the accumulated statistics
+         *
+         * \return void
+         *
+         */
+        void Fit()
+        {
+            //identity by default
+            a11 = 1.0; a12 = 0.0;
+            a21 = 0.0; a22 = 1.0;
+            centerX = 0.0; centerY = 0.0;
+
+            if (count < 2)
+                return;
+
+            double varX = m2X/count;
+            double varY = m2Y/count;
+            double covXY = coMoment/count;
+
+            if (mode == StripeAxisMode::Auto)
+            {
+                //the sweep should run along the axis with the largest spread, so stripes cut across the smallest one
+                if (varY > varX)
+                {
+                    a11 = 0.0; a12 = 1.0;
+                    a21 = 1.0; a22 = 0.0;
+                }
+            }
+            else if (mode == StripeAxisMode::Pca)
+            {
+                //angle of the first principal axis, the new x axis is aligned with the direction of largest variance
+                angle = 0.5*atan2(2.0*covXY, varX - varY);
+                double c = cos(angle);
+                double s = sin(angle);
+                a11 = c; a12 = s;
+                a21 = -s; a22 = c;
+                centerX = meanX; centerY = meanY;
+            }
+        }
+
+        /** \brief Returns true if the transform does not change the coordinates
+         *
+         * \return bool
+         *
+         */
+        bool IsIdentity() const
+        {
+            return a11 == 1.0 && a12 == 0.0 && a21 == 0.0 && a22 == 1.0 && centerX == 0.0 && centerY == 0.0;
+        }
+
+        /** \brief Transforms the coordinates of a point
+         *
+         * \param point Point& the point to transform
+         * \return void
+         *
+         */
+        inline void Apply(Point& point) const
+        {
+            double x = point.x - centerX;
+            double y = point.y - centerY;
+            point.x = a11*x + a12*y;
+            point.y = a21*x + a22*y;
+        }
+
+        /** \brief Returns the largest change of a squared distance caused by the transform
+         *          Each rotated coordinate has a rounding error of a few ulps of the largest coordinate, so a squared distance
+         *          changes by at most about 128 ulps of the squared extent of the data. It is zero for the identity and the axis swap.
+         *          Results of rotated datasets differ from results of the original coordinates by up to this value
+         * \param extent double the largest absolute transformed coordinate of the datasets
+         * \return double
+         *
+         */
+        double GetDistanceTolerance(double extent) const
+        {
+            if (IsIdentity() || mode != StripeAxisMode::Pca)
+                return 0.0;
+
+            return 128.0*std::numeric_limits<double>::epsilon()*extent*extent;
+        }
+
+        /** \brief Returns a description of the transform for reporting purposes
+         *
+         * \return string
+         *
+         */
+        std::string GetDescription() const
+        {
+            std::stringstream ss;
+
+            if (IsIdentity())
+                ss << "stripes in y";
+            else if (mode == StripeAxisMode::Auto)
+                ss << "stripes in x (x and y swapped)";
+            else
+                ss << "stripes on principal axes (rotation " << angle*180.0/M_PI << " degrees)";
+
+            return ss.str();
+        }
+
+    private:
+        StripeAxisMode mode = StripeAxisMode::Y;
+        size_t count = 0;
+        double meanX = 0.0;
+        double meanY = 0.0;
+        double m2X = 0.0;
+        double m2Y = 0.0;
+        double coMoment = 0.0;
+        double angle = 0.0;
+        double centerX = 0.0, centerY = 0.0;   /**< the point subtracted before the rotation */
+        double a11 = 1.0, a12 = 0.0, a21 = 0.0, a22 = 1.0;
+};
+
+#endif // DATASETTRANSFORM_H
@@ -0,0 +1,257 @@
+/* Class definitions for reading the hardware performance counters of the threads
+    The counters (cycles, instructions, last level cache misses, data TLB misses and branch mispredictions) are opened by perf_event_open
+    for each thread that reads them, as one group of the user space events of the thread. They are compiled only on Linux and when
+    HARDWARE_COUNTERS is defined, e.g. make DEFINES=-DHARDWARE_COUNTERS, otherwise all the values are 0.
+    If the kernel does not allow the counters (e.g. perf_event_paranoid or a virtual machine without a PMU), the values are 0 and the run continues.
+ */
+#ifndef HARDWARECOUNTERS_H
+#define HARDWARECOUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <atomic>
+
+#if defined(HARDWARE_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define NUM_HARDWARE_COUNTERS 5
+
+/** \brief Values of the hardware counters of a thread
+ */
+struct HardwareCounterValues
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llcMisses = 0;         /**< last level cache read misses */
+    uint64_t dtlbMisses = 0;        /**< data TLB read misses */
+    uint64_t branchMisses = 0;      /**< mispredicted branches */
+
+    HardwareCounterValues& operator+=(const HardwareCounterValues& other)
+    {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        llcMisses += other.llcMisses;
+        dtlbMisses += other.dtlbMisses;
+        branchMisses += other.branchMisses;
+        return *this;
+    }
+
+    /** \brief Returns the difference from earlier values of the same thread, the counters never decrease
+     *
+     * \param start const HardwareCounterValues& the earlier values
+     * \return HardwareCounterValues
+     *
+     */
+    HardwareCounterValues Since(const HardwareCounterValues& start) const
+    {
+        HardwareCounterValues diff;
+        diff.cycles = Difference(cycles, start.cycles);
+        diff.instructions = Difference(instructions, start.instructions);
+        diff.llcMisses = Difference(llcMisses, start.llcMisses);
+        diff.dtlbMisses = Difference(dtlbMisses, start.dtlbMisses);
+        diff.branchMisses = Difference(branchMisses, start.branchMisses);
+        return diff;
+    }
+
+    /** \brief Returns the instructions per cycle, 0 if no cycles have been counted
+     *
+     * \return double
+     *
+     */
+    double GetIpc() const
+    {
+        return cycles > 0 ? (1.0*instructions)/cycles : 0.0;
+    }
+
+    private:
+        //the values scaled for multiplexing may be slightly lower than earlier values
+        static uint64_t Difference(uint64_t value, uint64_t start)
+        {
+            return value > start ? value - start : 0;
+        }
+};
+
+/** \brief Hardware counters of the threads
+ */
+class HardwareCounters
+{
+    public:
+        /** \brief Returns true if the counters have been compiled
+         *
+         * \return bool
+         *
+         */
+        static constexpr bool IsEnabled()
+        {
+#if defined(HARDWARE_COUNTERS) && defined(__linux__)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /** \brief Opens the counters of the calling thread and describes the counters that are not available
+         *
+         * \param message std::string& the description, empty if all counters are available
+         * \return bool true if at least the cycles are counted
+         *
+         */
+        static bool Probe(std::string& message)
+        {
+            message.clear();
+
+            if (!IsEnabled())
+            {
+                message = "the hardware counters have not been compiled, define HARDWARE_COUNTERS on Linux to use them";
+                return false;
+            }
+
+            Read();
+
+            for (int iCounter = 0; iCounter < NUM_HARDWARE_COUNTERS; ++iCounter)
+            {
+                int error = GetOpenErrors()[iCounter].load();
+                if (error != 0)
+                    message += std::string(message.empty() ? "" : ", ") + COUNTER_NAMES[iCounter] + " not available (" + strerror(error) + ")";
+            }
+
+            return GetOpenErrors()[0].load() == 0;
+        }
+
+        /** \brief Returns true if the counters have been compiled and the cycles could be opened by the threads that have read the counters
+         *
+         * \return bool
+         *
+         */
+        static bool IsAvailable()
+        {
+            return IsEnabled() && GetOpenErrors()[0].load() == 0;
+        }
+
+        /** \brief Reads the counters of the calling thread, they are opened at the first call of each thread
+         *
+         * \return HardwareCounterValues all values are 0 if the counters are not available
+         *
+         */
+        static HardwareCounterValues Read()
+        {
+#if defined(HARDWARE_COUNTERS) && defined(__linux__)
+            thread_local ThreadCounters counters;
+            return counters.Read();
+#else
+            return HardwareCounterValues();
+#endif
+        }
+
+    private:
+        static constexpr const char* COUNTER_NAMES[NUM_HARDWARE_COUNTERS] = { "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses" };
+
+        /** \brief Errors of the first failed open of each counter, 0 if it has not failed
+         */
+        static std::atomic<int>* GetOpenErrors()
+        {
+            static std::atomic<int> openErrors[NUM_HARDWARE_COUNTERS] = {};
+            return openErrors;
+        }
+
+#if defined(HARDWARE_COUNTERS) && defined(__linux__)
+        /** \brief The group of counters of a thread, the cycles are the leader of the group
+         */
+        class ThreadCounters
+        {
+            public:
+                ThreadCounters()
+                {
+                    const uint32_t types[NUM_HARDWARE_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+                    const uint64_t configs[NUM_HARDWARE_COUNTERS] = {
+                        PERF_COUNT_HW_CPU_CYCLES,
+                        PERF_COUNT_HW_INSTRUCTIONS,
+                        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                        PERF_COUNT_HW_BRANCH_MISSES };
+
+                    for (int iCounter = 0; iCounter < NUM_HARDWARE_COUNTERS; ++iCounter)
+                    {
+                        perf_event_attr attr;
+                        memset(&attr, 0, sizeof(attr));
+                        attr.size = sizeof(attr);
+                        attr.type = types[iCounter];
+                        attr.config = configs[iCounter];
+                        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                        attr.exclude_kernel = 1;
+                        attr.exclude_hv = 1;
+
+                        //the members cannot be opened without the leader
+                        if (iCounter > 0 && leaderFd < 0)
+                            break;
+
+                        //the counters of the calling thread on any cpu
+                        int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, iCounter == 0 ? -1 : leaderFd, 0));
+
+                        if (fd < 0)
+                        {
+                            int expected = 0;
+                            GetOpenErrors()[iCounter].compare_exchange_strong(expected, errno);
+                            continue;
+                        }
+
+                        if (iCounter == 0)
+                            leaderFd = fd;
+
+                        fds[iCounter] = fd;
+                        positions[iCounter] = numOpened++;
+                    }
+                }
+
+                ~ThreadCounters()
+                {
+                    for (int iCounter = NUM_HARDWARE_COUNTERS - 1; iCounter >= 0; --iCounter)
+                    {
+                        if (fds[iCounter] >= 0)
+                            close(fds[iCounter]);
+                    }
+                }
+
+                ThreadCounters(const ThreadCounters&) = delete;
+                ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+                HardwareCounterValues Read() const
+                {
+                    HardwareCounterValues values;
+
+                    if (leaderFd < 0)
+                        return values;
+
+                    //number of counters, time enabled, time running and the values in the order the counters have been opened
+                    uint64_t buffer[3 + NUM_HARDWARE_COUNTERS] = {};
+                    if (read(leaderFd, buffer, sizeof(buffer)) < ssize_t(3*sizeof(uint64_t)))
+                        return values;
+
+                    //the values are scaled if the counters have been multiplexed with other events
+                    double scale = buffer[2] > 0 ? double(buffer[1])/buffer[2] : 0.0;
+                    uint64_t* pValues[NUM_HARDWARE_COUNTERS] = { &values.cycles, &values.instructions, &values.llcMisses, &values.dtlbMisses, &values.branchMisses };
+
+                    for (int iCounter = 0; iCounter < NUM_HARDWARE_COUNTERS; ++iCounter)
+                    {
+                        if (positions[iCounter] >= 0 && size_t(positions[iCounter]) < buffer[0])
+                            *pValues[iCounter] = uint64_t(buffer[3 + positions[iCounter]]*scale);
+                    }
+
+                    return values;
+                }
+
+            private:
+                int leaderFd = -1;
+                int numOpened = 0;
+                int fds[NUM_HARDWARE_COUNTERS] = { -1, -1, -1, -1, -1 };
+                int positions[NUM_HARDWARE_COUNTERS] = { -1, -1, -1, -1, -1 };  /**< position of the value of each counter in the group */
+        };
+#endif
+};
+
+#endif // HARDWARECOUNTERS_H
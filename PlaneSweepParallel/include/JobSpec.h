@@ -0,0 +1,318 @@
+/* Class definition for the job specifications of parameter sweeps
+    A job runs named algorithms for every combination of a grid of parameters in one process, so the datasets are loaded once.
+    The specification is a list of settings "key = value" or "key = value1, value2, ..." that are read from a file
+    (one setting per line, lines starting with # are comments) or given in the command line. A key may be repeated,
+    the values of the grid keys are appended and the other keys keep the last value.
+
+    Keys of the grid: dataset (input and training file separated by space), algorithms (names of AlgorithmFactory.h), k, threads, stripes,
+    memory (MB, external memory algorithms only)
+    Other keys: input, training, accuracy, compare (0/1/2), sample, save (0-3), axis (0-2), prefetch (0/1), output,
+    warmup (unmeasured runs of each combination), repetitions (measured runs of each combination),
+    weak (0/1, 1 pairs the datasets with the thread counts in order for weak scaling instead of running every combination)
+ */
+#ifndef JOBSPEC_H
+#define JOBSPEC_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include "AllKnnProblem.h"
+#include "AlgorithmFactory.h"
+#include "ApplicationException.h"
+
+/** \brief A combination of the parameters of a job
+ */
+struct JobRun
+{
+    size_t dataset;         /**< index of the dataset */
+    int algorithm;          /**< index of the algorithm */
+    size_t numNeighbors;    /**< k */
+    int numThreads;         /**< 0 to let the system decide */
+    int numStripes;         /**< 0 to calculate the number of stripes from the datasets */
+    size_t memoryLimitMB;   /**< 0 for internal memory algorithms */
+};
+
+/** \brief Job specification of a parameter sweep
+ */
+class JobSpec
+{
+    public:
+        JobSpec() {}
+
+        virtual ~JobSpec() {}
+
+        /** \brief Reads the settings of a job file
+         *
+         * \param filename const std::string& the job file
+         * \return void
+         *
+         */
+        void ParseFile(const std::string& filename)
+        {
+            std::ifstream inFile(filename, std::ios_base::in);
+            if (!inFile.is_open())
+                throw ApplicationException("Cannot open job file " + filename);
+
+            std::string line;
+            while (std::getline(inFile, line))
+            {
+                line = Trim(line);
+                if (!line.empty() && line[0] != '#')
+                    ParseSetting(line);
+            }
+        }
+
+        /** \brief Reads a setting "key = value1, value2, ..."
+         *
+         * \param setting const std::string& the setting
+         * \return void
+         *
+         */
+        void ParseSetting(const std::string& setting)
+        {
+            size_t separator = setting.find('=');
+            if (separator == std::string::npos)
+                throw ApplicationException("Invalid job setting " + setting);
+
+            std::string key = Trim(setting.substr(0, separator));
+            std::vector<std::string> values;
+
+            std::stringstream ss(setting.substr(separator + 1));
+            std::string value;
+            while (std::getline(ss, value, ','))
+            {
+                value = Trim(value);
+                if (!value.empty())
+                    values.push_back(value);
+            }
+
+            if (values.empty())
+                throw ApplicationException("Missing value of job setting " + key);
+
+            if (key == "dataset")
+            {
+                for (auto& pair : values)
+                {
+                    std::istringstream ssPair(pair);
+                    std::string inputFile, trainingFile, extra;
+
+                    if (!(ssPair >> inputFile >> trainingFile) || (ssPair >> extra))
+                        throw ApplicationException("Invalid dataset " + pair + ", enter the input and the training file separated by space");
+
+                    datasets.push_back({inputFile, trainingFile});
+                }
+            }
+            else if (key == "algorithms")
+            {
+                for (auto& name : values)
+                {
+                    int index = FindAlgorithm(name);
+                    if (index < 0)
+                        throw ApplicationException("Unknown algorithm " + name);
+
+                    algorithms.push_back(index);
+                }
+            }
+            else if (key == "k")
+                AppendValues(key, values, numNeighbors);
+            else if (key == "threads")
+                AppendValues(key, values, numThreads);
+            else if (key == "stripes")
+                AppendValues(key, values, numStripes);
+            else if (key == "memory")
+                AppendValues(key, values, memoryLimitsMB);
+            else if (key == "input")
+                inputFilename = values.back();
+            else if (key == "training")
+                trainingFilename = values.back();
+            else if (key == "output")
+                outputFilename = values.back();
+            else if (key == "accuracy")
+                accuracy = ParseValue<double>(key, values.back());
+            else if (key == "compare")
+                compare = ParseValue<int>(key, values.back());
+            else if (key == "sample")
+                sampleSize = ParseValue<size_t>(key, values.back());
+            else if (key == "save")
+                saveToFile = ParseValue<int>(key, values.back());
+            else if (key == "axis")
+                stripeAxis = ParseValue<int>(key, values.back());
+            else if (key == "prefetch")
+                prefetchWindows = ParseValue<int>(key, values.back()) != 0;
+            else if (key == "warmup")
+                numWarmupRuns = ParseValue<int>(key, values.back());
+            else if (key == "repetitions")
+                numRepetitions = ParseValue<int>(key, values.back());
+            else if (key == "weak")
+                weakScaling = ParseValue<int>(key, values.back()) != 0;
+            else
+                throw ApplicationException("Unknown job setting " + key);
+        }
+
+        /** \brief Checks that the required settings are present and sets the defaults of the grid
+         *
+         * \return void
+         *
+         */
+        void Validate()
+        {
+            //the datasets of the keys input and training are the first ones
+            if (!inputFilename.empty() || !trainingFilename.empty())
+            {
+                if (inputFilename.empty() || trainingFilename.empty())
+                    throw ApplicationException("The job does not specify both the input and the training dataset");
+
+                datasets.insert(datasets.begin(), {inputFilename, trainingFilename});
+                inputFilename.clear();
+                trainingFilename.clear();
+            }
+
+            if (datasets.empty())
+                throw ApplicationException("The job does not specify the input and training datasets");
+
+            if (algorithms.empty())
+                throw ApplicationException("The job does not specify any algorithms");
+
+            if (numNeighbors.empty())
+                throw ApplicationException("The job does not specify the number of neighbors (k)");
+
+            if (numThreads.empty())
+                numThreads.push_back(0);
+
+            if (numStripes.empty())
+                numStripes.push_back(0);
+
+            if (memoryLimitsMB.empty())
+                memoryLimitsMB.push_back(1024);
+
+            if (numWarmupRuns < 0 || numRepetitions < 1)
+                throw ApplicationException("The job needs at least one repetition and no negative warmup runs");
+
+            if (weakScaling && numThreads.size() != datasets.size())
+                throw ApplicationException("Weak scaling needs one thread count for each dataset");
+        }
+
+        /** \brief Returns all combinations of the grid
+         *          The runs are ordered by dataset, k, memory, stripes, threads and algorithm, so all the runs of the same dataset and k are consecutive.
+         *          Internal memory algorithms do not depend on the memory limit, so they run only with the first one.
+         *          For weak scaling each dataset runs only with its own thread count
+         * \return std::vector<JobRun>
+         *
+         */
+        std::vector<JobRun> GetRuns() const
+        {
+            std::vector<JobRun> runs;
+
+            for (size_t iDataset = 0; iDataset < datasets.size(); ++iDataset)
+            {
+                for (auto k : numNeighbors)
+                {
+                    for (size_t iMemory = 0; iMemory < memoryLimitsMB.size(); ++iMemory)
+                    {
+                        for (auto stripes : numStripes)
+                        {
+                            for (size_t iThreads = 0; iThreads < numThreads.size(); ++iThreads)
+                            {
+                                if (weakScaling && iThreads != iDataset)
+                                    continue;
+
+                                for (auto algorithm : algorithms)
+                                {
+                                    bool usesExternalMemory = CreateAlgorithm(algorithm, AlgorithmParameters())->UsesExternalMemory();
+
+                                    if (usesExternalMemory)
+                                        runs.push_back({iDataset, algorithm, k, numThreads[iThreads], stripes, memoryLimitsMB[iMemory]});
+                                    else if (iMemory == 0)
+                                        runs.push_back({iDataset, algorithm, k, numThreads[iThreads], stripes, 0});
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            return runs;
+        }
+
+        const std::vector<int>& GetAlgorithms() const { return algorithms; }
+        const std::vector<size_t>& GetMemoryLimitsMB() const { return memoryLimitsMB; }
+        const std::vector<std::pair<std::string, std::string>>& GetDatasets() const { return datasets; }
+        const std::string& GetOutputFilename() const { return outputFilename; }
+        double GetAccuracy() const { return accuracy; }
+        int GetCompare() const { return compare; }
+        size_t GetSampleSize() const { return sampleSize; }
+        int GetSaveToFile() const { return saveToFile; }
+        bool GetPrefetchWindows() const { return prefetchWindows; }
+        int GetNumWarmupRuns() const { return numWarmupRuns; }
+        int GetNumRepetitions() const { return numRepetitions; }
+        bool IsWeakScaling() const { return weakScaling; }
+
+        StripeAxisMode GetStripeAxisMode() const
+        {
+            if (stripeAxis == 1)
+                return StripeAxisMode::Auto;
+            else if (stripeAxis == 2)
+                return StripeAxisMode::Pca;
+
+            return StripeAxisMode::Y;
+        }
+
+    private:
+        std::vector<std::pair<std::string, std::string>> datasets;  /**< input and training file of each dataset */
+        std::vector<int> algorithms;
+        std::vector<size_t> numNeighbors;
+        std::vector<int> numThreads;
+        std::vector<int> numStripes;
+        std::vector<size_t> memoryLimitsMB;
+        std::string inputFilename;
+        std::string trainingFilename;
+        std::string outputFilename;
+        double accuracy = 1.0E-15;
+        int compare = 0;
+        size_t sampleSize = 10000;
+        int saveToFile = 0;
+        int stripeAxis = 0;
+        bool prefetchWindows = true;
+        int numWarmupRuns = 0;
+        int numRepetitions = 1;
+        bool weakScaling = false;
+
+        static std::string Trim(const std::string& text)
+        {
+            size_t first = text.find_first_not_of(" \t\r\n");
+            if (first == std::string::npos)
+                return std::string();
+
+            size_t last = text.find_last_not_of(" \t\r\n");
+            return text.substr(first, last - first + 1);
+        }
+
+        /** \brief Converts the value of a setting, the whole value must be a number
+         *
+         * \param key const std::string& the key of the setting, used in the error message
+         * \param value const std::string& the value
+         * \return T
+         *
+         */
+        template<class T>
+        static T ParseValue(const std::string& key, const std::string& value)
+        {
+            std::istringstream ss(value);
+            T result;
+
+            if (!(ss >> result) || !(ss >> std::ws).eof())
+                throw ApplicationException("Invalid value " + value + " of job setting " + key);
+
+            return result;
+        }
+
+        template<class T>
+        static void AppendValues(const std::string& key, const std::vector<std::string>& values, std::vector<T>& target)
+        {
+            for (auto& value : values)
+                target.push_back(ParseValue<T>(key, value));
+        }
+};
+
+#endif // JOBSPEC_H
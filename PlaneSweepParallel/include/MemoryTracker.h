@@ -0,0 +1,290 @@
+/* Class definitions for measuring the memory used by the algorithms
+    MemoryTracker counts the bytes allocated by containers that use TrackingAllocator and reads the resident set size of the process.
+    The size of each allocation includes the slack of the allocator where it can be queried (glibc), so the counters are close to the memory actually used.
+    Each thread counts its own allocations and deallocations without atomic read-modify-write operations, the counters of all threads are summed on read.
+    The peak is checked each time a thread has allocated another chunk of memory, so it is exact within one chunk per thread.
+ */
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+//the peak of the tracked memory is checked each time a thread has allocated this many bytes since its last check
+#define MEMORY_TRACKER_PEAK_CHUNK (1024*1024)
+
+/** \brief Counters of the bytes allocated by tracked containers and of the resident set size of the process
+ */
+class MemoryTracker
+{
+    public:
+        /** \brief Records an allocation
+         *
+         * \param bytes size_t
+         * \return void
+         *
+         */
+        static void Allocate(size_t bytes)
+        {
+            ThreadCounter& counter = GetThreadCounter();
+
+            //only the owning thread writes its counter, the other threads may read it
+            long long current = counter.allocated.load(std::memory_order_relaxed) + (long long)bytes;
+            counter.allocated.store(current, std::memory_order_relaxed);
+
+            if (current >= counter.lastPeakCheck + MEMORY_TRACKER_PEAK_CHUNK)
+            {
+                counter.lastPeakCheck = current;
+                UpdatePeak(GetAllocatedBytes());
+            }
+        }
+
+        /** \brief Records a deallocation
+         *
+         * \param bytes size_t
+         * \return void
+         *
+         */
+        static void Deallocate(size_t bytes)
+        {
+            ThreadCounter& counter = GetThreadCounter();
+
+            //memory allocated by another thread may be released, so the counter of a thread may become negative
+            long long current = counter.allocated.load(std::memory_order_relaxed) - (long long)bytes;
+            counter.allocated.store(current, std::memory_order_relaxed);
+            counter.lastPeakCheck = std::min(counter.lastPeakCheck, current);
+        }
+
+        /** \brief Returns the bytes currently allocated by tracked containers, it is the sum of the counters of all threads
+         *          The peak is also updated, so it is never below a value that has been read
+         * \return size_t
+         *
+         */
+        static size_t GetAllocatedBytes()
+        {
+            CounterRegistry& registry = GetRegistry();
+            long long allocated = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                for (auto& counter : registry.counters)
+                    allocated += counter.allocated.load(std::memory_order_relaxed);
+            }
+
+            size_t bytes = allocated > 0 ? size_t(allocated) : 0;
+            UpdatePeak(bytes);
+            return bytes;
+        }
+
+        /** \brief Returns the maximum bytes allocated by tracked containers since the last reset
+         *          It may be lower than the actual maximum by up to one chunk (MEMORY_TRACKER_PEAK_CHUNK) for each thread
+         * \return size_t
+         *
+         */
+        static size_t GetPeakAllocatedBytes()
+        {
+            return GetPeakCounter().load(std::memory_order_relaxed);
+        }
+
+        /** \brief Resets the peak of tracked bytes and the peak resident set size of the process (Linux only)
+         *
+         * \return void
+         *
+         */
+        static void ResetPeak()
+        {
+            GetPeakCounter().store(GetAllocatedBytes(), std::memory_order_relaxed);
+#ifdef __linux__
+            //writing 5 to clear_refs resets the peak resident set size (VmHWM)
+            std::ofstream clearRefs("/proc/self/clear_refs");
+            if (clearRefs)
+                clearRefs << "5";
+#endif
+        }
+
+        /** \brief Returns the peak resident set size of the process in bytes
+         *
+         * \return size_t
+         *
+         */
+        static size_t GetPeakRSS()
+        {
+#ifdef __linux__
+            //VmHWM can be reset, unlike the maximum of getrusage
+            std::ifstream status("/proc/self/status");
+            std::string line;
+            while (std::getline(status, line))
+            {
+                if (line.compare(0, 6, "VmHWM:") == 0)
+                    return std::stoull(line.substr(6))*1024;
+            }
+#endif
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) != 0)
+                return 0;
+#ifdef __APPLE__
+            return usage.ru_maxrss;
+#else
+            return usage.ru_maxrss*1024;
+#endif
+        }
+
+        /** \brief Returns the bytes used by a heap allocation of a given size, including the slack of the allocator
+         *
+         * \param p void* the allocated memory
+         * \param bytes size_t the requested size
+         * \return size_t
+         *
+         */
+        static size_t GetAllocationSize(void* p, size_t bytes)
+        {
+#ifdef __GLIBC__
+            //each chunk also has a header of one word, the usable size already includes the requested size
+            (void)bytes;
+            return malloc_usable_size(p) + sizeof(size_t);
+#else
+            return bytes;
+#endif
+        }
+
+        /** \brief Returns the bytes that an allocation of a given size would use, it is measured by a test allocation
+         *
+         * \param bytes size_t the requested size
+         * \return size_t
+         *
+         */
+        static size_t MeasureAllocationSize(size_t bytes)
+        {
+            void* p = ::operator new(bytes);
+            size_t size = GetAllocationSize(p, bytes);
+            ::operator delete(p);
+            return size;
+        }
+
+    private:
+        /** \brief The counter of a thread, it is aligned to a cache line so the threads do not share the lines of their counters
+         */
+        struct alignas(64) ThreadCounter
+        {
+            std::atomic<long long> allocated{0};
+            long long lastPeakCheck = 0; /**< the value of the counter at the last check of the peak, it is used by the owning thread only */
+        };
+
+        /** \brief The counters of all threads, a counter is given back when its thread exits and it is reused with its value by the next thread
+         */
+        struct CounterRegistry
+        {
+            std::mutex mutex;
+            std::deque<ThreadCounter> counters;
+            std::vector<ThreadCounter*> freeCounters;
+        };
+
+        /** \brief Holds the counter of a thread for the lifetime of the thread
+         */
+        struct ThreadCounterLease
+        {
+            ThreadCounter* pCounter;
+
+            ThreadCounterLease()
+            {
+                CounterRegistry& registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+
+                if (registry.freeCounters.empty())
+                {
+                    registry.counters.emplace_back();
+                    pCounter = &registry.counters.back();
+                }
+                else
+                {
+                    pCounter = registry.freeCounters.back();
+                    registry.freeCounters.pop_back();
+                }
+            }
+
+            ~ThreadCounterLease()
+            {
+                CounterRegistry& registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.freeCounters.push_back(pCounter);
+            }
+        };
+
+        static CounterRegistry& GetRegistry()
+        {
+            //the registry is never destroyed, the threads give back their counters after the static objects have been destroyed
+            static CounterRegistry* pRegistry = new CounterRegistry();
+            return *pRegistry;
+        }
+
+        static ThreadCounter& GetThreadCounter()
+        {
+            thread_local ThreadCounterLease lease;
+            return *lease.pCounter;
+        }
+
+        static void UpdatePeak(size_t current)
+        {
+            auto& peak = GetPeakCounter();
+            size_t prevPeak = peak.load(std::memory_order_relaxed);
+            while (current > prevPeak && !peak.compare_exchange_weak(prevPeak, current, std::memory_order_relaxed));
+        }
+
+        static std::atomic<size_t>& GetPeakCounter()
+        {
+            static std::atomic<size_t> peak(0);
+            return peak;
+        }
+};
+
+/** \brief Allocator that records its allocations in MemoryTracker
+ */
+template<class T>
+class TrackingAllocator
+{
+    public:
+        typedef T value_type;
+
+        TrackingAllocator() noexcept {}
+
+        template<class U>
+        TrackingAllocator(const TrackingAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n)
+        {
+            T* p = static_cast<T*>(::operator new(n*sizeof(T)));
+            MemoryTracker::Allocate(MemoryTracker::GetAllocationSize(p, n*sizeof(T)));
+            return p;
+        }
+
+        void deallocate(T* p, size_t n) noexcept
+        {
+            MemoryTracker::Deallocate(MemoryTracker::GetAllocationSize(p, n*sizeof(T)));
+            ::operator delete(p);
+        }
+};
+
+template<class T, class U>
+bool operator==(const TrackingAllocator<T>&, const TrackingAllocator<U>&)
+{
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const TrackingAllocator<T>&, const TrackingAllocator<U>&)
+{
+    return false;
+}
+
+#endif // MEMORYTRACKER_H
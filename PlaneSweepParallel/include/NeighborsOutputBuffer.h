@@ -0,0 +1,220 @@
+/* Class definition for the buffer of the neighbors written to the output vector of the external memory algorithm
+    The neighbors of the input point with id i are stored at positions (i-1)*k to i*k-1 of the output vector. The input is striped by y,
+    so the points completed by a window are scattered over the whole output. The buffer keeps the neighbors of the completed points
+    by the block of the output vector they belong to, and a block is written at once when all its positions have been filled,
+    so it is written once and it is never read back. The buffered neighbors are kept in the packed layout of the output vector.
+    If the buffered neighbors exceed their memory limit, the blocks with the most buffered neighbors are written to their positions
+    without waiting for the rest of their points.
+ */
+#ifndef NEIGHBORSOUTPUTBUFFER_H
+#define NEIGHBORSOUTPUTBUFFER_H
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <stxxl/vector>
+#include "PlaneSweepParallel.h"
+
+/** \brief A run of consecutive neighbors of a block, the neighbors of a point are split into two pieces if the point crosses the end of a block
+ */
+struct NeighborsPiece
+{
+    size_t offset;  /**< position of the first neighbor from the start of the block */
+    size_t count;
+};
+
+/** \brief The buffered neighbors of a block of the output vector, the neighbors of pieces[i] follow the neighbors of the previous pieces
+ */
+struct NeighborsBlockBuffer
+{
+    std::vector<NeighborsPiece, TrackingAllocator<NeighborsPiece>> pieces;
+    std::vector<NeighborRecord, TrackingAllocator<NeighborRecord>> neighbors;
+};
+
+/** \brief Buffer of the neighbors of the completed points of the external memory algorithm
+ */
+class NeighborsOutputBuffer
+{
+    public:
+        /** \brief Creates the buffer of an output vector
+         *
+         * \param outputVector ext_neighbors_vector_t& the output vector, it holds k neighbors for every input point
+         * \param maxBufferedNeighbors size_t the number of buffered neighbors that triggers the writing of incomplete blocks
+         *
+         */
+        NeighborsOutputBuffer(ext_neighbors_vector_t& outputVector, size_t maxBufferedNeighbors)
+            : outputVector(outputVector), blockSize(ext_neighbors_vector_t::block_size/sizeof(NeighborRecord)),
+              maxBufferedNeighbors(std::max(maxBufferedNeighbors, blockSize)), blocks((outputVector.size() + blockSize - 1)/blockSize),
+              blockFilled(blocks.size(), 0)
+        {
+        }
+
+        virtual ~NeighborsOutputBuffer() {}
+
+        /** \brief Adds the neighbors of a completed point and writes its blocks if they have been filled
+         *
+         * \param pointId point_id_t the id of the point
+         * \param neighbors const Neighbor* the k neighbors of the point
+         * \param numNeighbors size_t k
+         * \return void
+         *
+         */
+        void Add(point_id_t pointId, const Neighbor* neighbors, size_t numNeighbors)
+        {
+            size_t position = (pointId - 1)*numNeighbors;
+            size_t endPosition = position + numNeighbors;
+
+            while (position < endPosition)
+            {
+                size_t iBlock = position/blockSize;
+                size_t blockStart = iBlock*blockSize;
+                size_t count = std::min(endPosition, blockStart + blockSize) - position;
+
+                NeighborsBlockBuffer& block = blocks[iBlock];
+                block.pieces.push_back({position - blockStart, count});
+                block.neighbors.insert(block.neighbors.end(), neighbors, neighbors + count);
+                blockFilled[iBlock] += count;
+                numBufferedNeighbors += count;
+
+                if (blockFilled[iBlock] == GetBlockLength(iBlock))
+                    WriteBlock(iBlock);
+
+                neighbors += count;
+                position += count;
+            }
+
+            if (numBufferedNeighbors > maxBufferedNeighbors)
+                WriteFullestBlocks();
+        }
+
+        /** \brief Writes all buffered neighbors, all blocks are complete once every input point has been added
+         *
+         * \return void
+         *
+         */
+        void Flush()
+        {
+            for (size_t iBlock = 0; iBlock < blocks.size(); ++iBlock)
+            {
+                if (!blocks[iBlock].pieces.empty())
+                    WriteBlock(iBlock);
+            }
+        }
+
+        /** \brief Returns the number of blocks written before they were complete
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumPartialWrites() const
+        {
+            return numPartialWrites;
+        }
+
+        /** \brief Returns the memory that the buffer may still allocate before it writes incomplete blocks
+         *
+         * \return size_t
+         *
+         */
+        size_t GetRemainingMemory() const
+        {
+            return (maxBufferedNeighbors - std::min(maxBufferedNeighbors, numBufferedNeighbors))*(sizeof(NeighborRecord) + sizeof(NeighborsPiece));
+        }
+
+    private:
+        ext_neighbors_vector_t& outputVector;
+        size_t blockSize = 0;   /**< number of neighbors in a block of the output vector */
+        size_t maxBufferedNeighbors = 0;
+        size_t numBufferedNeighbors = 0;
+        size_t numPartialWrites = 0;
+        std::vector<NeighborsBlockBuffer> blocks;
+        std::vector<size_t> blockFilled;    /**< number of positions of each block that have been filled */
+
+        size_t GetBlockLength(size_t iBlock) const
+        {
+            return std::min(blockSize, outputVector.size() - iBlock*blockSize);
+        }
+
+        /** \brief Writes the buffered neighbors of a block in order of position and releases their memory
+         *          A complete block is written sequentially from its start, the pieces of an incomplete block are written at their positions.
+         * \param iBlock size_t the index of the block
+         * \return void
+         *
+         */
+        void WriteBlock(size_t iBlock)
+        {
+            NeighborsBlockBuffer& block = blocks[iBlock];
+            size_t numPieces = block.pieces.size();
+
+            //the start of each piece in the buffered neighbors
+            std::vector<size_t> pieceStart(numPieces);
+            for (size_t iPiece = 1; iPiece < numPieces; ++iPiece)
+                pieceStart[iPiece] = pieceStart[iPiece - 1] + block.pieces[iPiece - 1].count;
+
+            std::vector<size_t> order(numPieces);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](size_t piece1, size_t piece2)
+                {
+                    return block.pieces[piece1].offset < block.pieces[piece2].offset;
+                });
+
+            auto blockBegin = outputVector.begin() + iBlock*blockSize;
+
+            if (block.neighbors.size() == GetBlockLength(iBlock))
+            {
+                //the buffered pieces cover all positions of the block
+                stxxl::vector_bufwriter<ext_neighbors_vector_t> writer(blockBegin);
+                for (auto iPiece : order)
+                {
+                    for (size_t iNeighbor = 0; iNeighbor < block.pieces[iPiece].count; ++iNeighbor)
+                        writer << block.neighbors[pieceStart[iPiece] + iNeighbor];
+                }
+
+                writer.finish();
+            }
+            else
+            {
+                for (auto iPiece : order)
+                {
+                    auto neighborsBegin = block.neighbors.cbegin() + pieceStart[iPiece];
+                    std::copy(neighborsBegin, neighborsBegin + block.pieces[iPiece].count, blockBegin + block.pieces[iPiece].offset);
+                }
+
+                ++numPartialWrites;
+            }
+
+            //the memory of the block is released, so the memory tracker does not count it any more
+            numBufferedNeighbors -= block.neighbors.size();
+            block = NeighborsBlockBuffer();
+        }
+
+        /** \brief Writes the blocks with the most buffered neighbors until half of the limit of the buffer is free
+         *
+         * \return void
+         *
+         */
+        void WriteFullestBlocks()
+        {
+            std::vector<size_t> bufferedBlocks;
+            for (size_t iBlock = 0; iBlock < blocks.size(); ++iBlock)
+            {
+                if (!blocks[iBlock].pieces.empty())
+                    bufferedBlocks.push_back(iBlock);
+            }
+
+            std::sort(bufferedBlocks.begin(), bufferedBlocks.end(), [&](size_t block1, size_t block2)
+                {
+                    return blocks[block1].neighbors.size() > blocks[block2].neighbors.size();
+                });
+
+            for (auto iBlock : bufferedBlocks)
+            {
+                if (numBufferedNeighbors <= maxBufferedNeighbors/2)
+                    break;
+
+                WriteBlock(iBlock);
+            }
+        }
+};
+
+#endif // NEIGHBORSOUTPUTBUFFER_H
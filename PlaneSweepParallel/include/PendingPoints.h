@@ -0,0 +1,470 @@
+/* Class definition for the pending points of the external memory algorithm
+    Pending points are input points whose search for neighbors continues in later windows.
+    They are kept in buckets by the next stripe they need to search, together with their heaps of neighbors,
+    so each window takes only the buckets of its own stripes.
+    When the memory limit is tight, buckets that are needed later are written to external memory and they are read back by the window that takes them.
+    Each written bucket has its own external vectors, which are written and read by buffered streams and released as soon as they have been read back.
+ */
+#ifndef PENDINGPOINTS_H
+#define PENDINGPOINTS_H
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <limits>
+#include <cmath>
+#include <omp.h>
+#include <stxxl/vector>
+#include "PlaneSweepParallel.h"
+#include "PointNeighbors.h"
+
+/** \brief A pending point written to external memory, its k neighbors are stored separately in the order they were popped from the heap
+ *          It is packed like NeighborRecord, so the id takes only its own width
+ */
+#pragma pack(push, 1)
+struct SpilledPendingPoint
+{
+    point_id_t id;
+    double x;
+    double y;
+    size_t lowStripe;
+    size_t highStripe;
+    size_t numAdditions;
+};
+#pragma pack(pop)
+
+//external memory vectors for spilled pending points, they use the small cache of the other external vectors
+typedef stxxl::VECTOR_GENERATOR<SpilledPendingPoint, EXT_VECTOR_PAGE_SIZE, EXT_VECTOR_NUM_PAGES, EXT_VECTOR_BLOCK_SIZE>::result ext_spilled_point_vector_t;
+typedef stxxl::VECTOR_GENERATOR<NeighborRecord, EXT_VECTOR_PAGE_SIZE, EXT_VECTOR_NUM_PAGES, EXT_VECTOR_BLOCK_SIZE>::result ext_spilled_neighbors_vector_t;
+
+/** \brief The pending points of a bucket written to external memory at once
+ */
+struct SpilledSegment
+{
+    std::unique_ptr<ext_spilled_point_vector_t> pPoints;
+    std::unique_ptr<ext_spilled_neighbors_vector_t> pNeighbors; /**< k neighbors of each point */
+};
+
+/** \brief A pending point collected by a thread, it refers to the point and to its neighbors found so far
+ */
+typedef std::pair<const Point*, PointNeighbors<neighbors_priority_queue_t>*> pending_point_t;
+
+/** \brief A list of pending points and their neighbors, the neighbors of points[i] are stored in neighbors[i]
+ */
+struct PendingPointsBucket
+{
+    point_vector_t points;
+    pointNeighbors_vector_t neighbors;
+
+    size_t size() const
+    {
+        return points.size();
+    }
+
+    void Add(const Point& point, PointNeighbors<neighbors_priority_queue_t>&& pointNeighbors)
+    {
+        points.push_back(point);
+        neighbors.push_back(std::move(pointNeighbors));
+    }
+};
+
+/** \brief Pending points of the external memory algorithm bucketed by the next stripe they need to search
+ */
+class PendingPoints
+{
+    public:
+        /** \brief Constructor
+         *
+         * \param numStripes size_t the number of stripes
+         * \param numNeighbors size_t the number of nearest neighbors (k)
+         *
+         */
+        PendingPoints(size_t numStripes, size_t numNeighbors) : numStripes(numStripes), numNeighbors(numNeighbors),
+            upBuckets(numStripes), downBuckets(numStripes), upSpilled(numStripes), downSpilled(numStripes),
+            downMinY(numStripes, std::numeric_limits<double>::max())
+        {
+        }
+
+        virtual ~PendingPoints() {}
+
+        /** \brief Adds a point whose search of neighbors has not been completed
+         *          Points that have not completed the search to higher y are added to the bucket of the stripe above the highest stripe searched,
+         *          otherwise they are added to the bucket of the stripe below the lowest stripe searched (second phase)
+         * \param point const Point& the input point
+         * \param pointNeighbors PointNeighbors<neighbors_priority_queue_t>&& the neighbors found so far
+         * \return void
+         *
+         */
+        void Add(const Point& point, PointNeighbors<neighbors_priority_queue_t>&& pointNeighbors)
+        {
+            size_t iBucket = GetBucketIndex(pointNeighbors);
+
+            if (iBucket >= numStripes)
+                downMinY[iBucket - numStripes] = std::min(downMinY[iBucket - numStripes], GetMinY(point, pointNeighbors));
+
+            GetBucket(iBucket).Add(point, std::move(pointNeighbors));
+            ++numPoints;
+        }
+
+        /** \brief Adds the points of several lists concurrently, each list is added by its own thread
+         *          The points of each list are counted by bucket and a prefix sum over the lists gives each list its own range of positions in every bucket,
+         *          so the threads move their points to the buckets without locking and the points of a bucket keep the order of the lists
+         * \param lists const std::vector<std::vector<pending_point_t>>& the lists of points, their neighbors are moved to the buckets
+         * \return void
+         *
+         */
+        void AddParallel(const std::vector<std::vector<pending_point_t>>& lists)
+        {
+            int numLists = int(lists.size());
+            size_t numBuckets = 2*numStripes;
+
+            //the number of points of each list in each bucket, it is replaced by the position of the first point of the list in the bucket
+            std::vector<size_t> listPositions(numLists*numBuckets, 0);
+            //the lowest y of the points of each list in each bucket of the search to lower y
+            std::vector<double> listMinY(numLists*numStripes, std::numeric_limits<double>::max());
+
+            #pragma omp parallel for schedule(static, 1) num_threads(numLists)
+            for (int iList = 0; iList < numLists; ++iList)
+            {
+                size_t* counts = &listPositions[iList*numBuckets];
+                double* minY = &listMinY[iList*numStripes];
+
+                for (auto& pendingPoint : lists[iList])
+                {
+                    size_t iBucket = GetBucketIndex(*pendingPoint.second);
+                    ++counts[iBucket];
+
+                    if (iBucket >= numStripes)
+                        minY[iBucket - numStripes] = std::min(minY[iBucket - numStripes], GetMinY(*pendingPoint.first, *pendingPoint.second));
+                }
+            }
+
+            size_t numAdded = 0;
+
+            //each bucket is grown by the points of all lists, the new heaps are empty until the points are moved in
+            #pragma omp parallel for schedule(dynamic, 16) reduction(+:numAdded)
+            for (size_t iBucket = 0; iBucket < numBuckets; ++iBucket)
+            {
+                auto& bucket = GetBucket(iBucket);
+                size_t position = bucket.size();
+
+                for (int iList = 0; iList < numLists; ++iList)
+                {
+                    size_t count = listPositions[iList*numBuckets + iBucket];
+                    listPositions[iList*numBuckets + iBucket] = position;
+                    position += count;
+
+                    if (iBucket >= numStripes)
+                        downMinY[iBucket - numStripes] = std::min(downMinY[iBucket - numStripes], listMinY[iList*numStripes + iBucket - numStripes]);
+                }
+
+                numAdded += position - bucket.size();
+
+                if (position > bucket.size())
+                {
+                    bucket.points.resize(position);
+                    bucket.neighbors.reserve(position);
+                    while (bucket.neighbors.size() < position)
+                        bucket.neighbors.emplace_back(numNeighbors);
+                }
+            }
+
+            #pragma omp parallel for schedule(static, 1) num_threads(numLists)
+            for (int iList = 0; iList < numLists; ++iList)
+            {
+                size_t* positions = &listPositions[iList*numBuckets];
+
+                for (auto& pendingPoint : lists[iList])
+                {
+                    size_t iBucket = GetBucketIndex(*pendingPoint.second);
+                    auto& bucket = GetBucket(iBucket);
+                    size_t position = positions[iBucket]++;
+
+                    bucket.points[position] = *pendingPoint.first;
+                    bucket.neighbors[position] = std::move(*pendingPoint.second);
+                }
+            }
+
+            numPoints += numAdded;
+        }
+
+        /** \brief Moves out all the points that need to search a range of stripes, spilled points are read back from external memory
+         *          The points are still counted as pending until they are released by the commit of the window
+         * \param startStripe size_t the first stripe of the range
+         * \param endStripe size_t the last stripe of the range
+         * \param secondPass bool true for the search to lower y (second phase)
+         * \return unique_ptr<PendingPointsBucket> the points and their neighbors
+         *
+         */
+        std::unique_ptr<PendingPointsBucket> Take(size_t startStripe, size_t endStripe, bool secondPass)
+        {
+            auto& buckets = secondPass ? downBuckets : upBuckets;
+            auto& spilled = secondPass ? downSpilled : upSpilled;
+            std::unique_ptr<PendingPointsBucket> pBucket(new PendingPointsBucket());
+
+            size_t numBucketPoints = 0;
+            for (size_t iStripe = startStripe; iStripe <= endStripe; ++iStripe)
+                numBucketPoints += buckets[iStripe].size() + GetNumSpilledPoints(iStripe, secondPass);
+
+            pBucket->points.reserve(numBucketPoints);
+            pBucket->neighbors.reserve(numBucketPoints);
+
+            for (size_t iStripe = startStripe; iStripe <= endStripe; ++iStripe)
+            {
+                auto& bucket = buckets[iStripe];
+
+                std::copy(bucket.points.cbegin(), bucket.points.cend(), std::back_inserter(pBucket->points));
+                std::move(bucket.neighbors.begin(), bucket.neighbors.end(), std::back_inserter(pBucket->neighbors));
+
+                //release the memory of the bucket
+                point_vector_t().swap(bucket.points);
+                pointNeighbors_vector_t().swap(bucket.neighbors);
+
+                //read back the spilled points of the bucket, their external vectors are released
+                for (auto& segment : spilled[iStripe])
+                    ReadSegment(segment, *pBucket);
+
+                numPointsOnDisk -= GetNumSpilledPoints(iStripe, secondPass);
+                std::vector<SpilledSegment>().swap(spilled[iStripe]);
+            }
+
+            return pBucket;
+        }
+
+        /** \brief Writes the points of a bucket and their neighbors to external memory and releases their memory
+         *
+         * \param stripe size_t the stripe of the bucket
+         * \param secondPass bool true for the bucket of the search to lower y (second phase)
+         * \return void
+         *
+         */
+        void Spill(size_t stripe, bool secondPass)
+        {
+            auto& bucket = (secondPass ? downBuckets : upBuckets)[stripe];
+            size_t count = bucket.size();
+
+            if (count == 0)
+                return;
+
+            SpilledSegment segment = {std::unique_ptr<ext_spilled_point_vector_t>(new ext_spilled_point_vector_t(count)),
+                                      std::unique_ptr<ext_spilled_neighbors_vector_t>(new ext_spilled_neighbors_vector_t(count*numNeighbors))};
+
+            stxxl::vector_bufwriter<ext_spilled_point_vector_t> pointWriter(*segment.pPoints);
+            stxxl::vector_bufwriter<ext_spilled_neighbors_vector_t> neighborWriter(*segment.pNeighbors);
+
+            for (size_t iPoint = 0; iPoint < count; ++iPoint)
+            {
+                auto& pointNeighbors = bucket.neighbors[iPoint];
+                auto& point = bucket.points[iPoint];
+                pointWriter << SpilledPendingPoint{point.id, point.x, point.y, pointNeighbors.getLowStripe(), pointNeighbors.getHighStripe(), pointNeighbors.GetNumAdditions()};
+
+                //Next() returns exactly k neighbors, including the empty ones
+                while (pointNeighbors.HasNext())
+                    neighborWriter << pointNeighbors.Next();
+            }
+
+            pointWriter.finish();
+            neighborWriter.finish();
+
+            (secondPass ? downSpilled : upSpilled)[stripe].push_back(std::move(segment));
+            numPointsOnDisk += count;
+            numSpilledPoints += count;
+
+            //release the memory of the bucket
+            point_vector_t().swap(bucket.points);
+            pointNeighbors_vector_t().swap(bucket.neighbors);
+        }
+
+        /** \brief Releases points taken by a window, after they have been either completed or added again
+         *
+         * \param count size_t the number of points
+         * \return void
+         *
+         */
+        void Release(size_t count)
+        {
+            numPoints -= count;
+        }
+
+        /** \brief Returns the number of pending points, including points taken by the window in process
+         *
+         * \return size_t
+         *
+         */
+        size_t size() const
+        {
+            return numPoints;
+        }
+
+        /** \brief Returns the number of pending points that are held in RAM
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumPointsInMemory() const
+        {
+            return numPoints - numPointsOnDisk;
+        }
+
+        /** \brief Returns the number of points of a bucket that are held in RAM
+         *
+         * \param stripe size_t the stripe of the bucket
+         * \param secondPass bool true for the bucket of the search to lower y (second phase)
+         * \return size_t
+         *
+         */
+        size_t GetNumPointsInMemory(size_t stripe, bool secondPass) const
+        {
+            return (secondPass ? downBuckets : upBuckets)[stripe].size();
+        }
+
+        /** \brief Returns the number of points of a bucket that are stored in external memory
+         *
+         * \param stripe size_t the stripe of the bucket
+         * \param secondPass bool true for the bucket of the search to lower y (second phase)
+         * \return size_t
+         *
+         */
+        size_t GetNumSpilledPoints(size_t stripe, bool secondPass) const
+        {
+            size_t count = 0;
+            for (auto& segment : (secondPass ? downSpilled : upSpilled)[stripe])
+                count += segment.pPoints->size();
+
+            return count;
+        }
+
+        /** \brief Finds the highest stripe, up to a given stripe, whose bucket of the search to lower y is not empty
+         *
+         * \param fromStripe size_t the stripe to start from
+         * \param stripe size_t& the stripe found
+         * \return bool false if there are no points that need to search to lower y from these stripes
+         *
+         */
+        bool FindDownStripe(size_t fromStripe, size_t& stripe) const
+        {
+            for (size_t iStripe = fromStripe + 1; iStripe > 0; --iStripe)
+            {
+                if (downBuckets[iStripe - 1].size() > 0 || !downSpilled[iStripe - 1].empty())
+                {
+                    stripe = iStripe - 1;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /** \brief Returns the lowest y that points added to the bucket of the search to lower y may need to search
+         *          The value is not reset when the bucket is taken, so it is an upper bound for points that continue from the bucket to lower stripes
+         * \param stripe size_t the stripe of the bucket
+         * \return double
+         *
+         */
+        double GetDownMinY(size_t stripe) const
+        {
+            return downMinY[stripe];
+        }
+
+        /** \brief Returns the total number of points written to external memory, a point is counted each time it is written
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumSpilledPoints() const
+        {
+            return numSpilledPoints;
+        }
+
+        /** \brief Returns the memory used by the buffers of the external vectors, it is zero if no points are stored in external memory
+         *          A bucket is written or read by one pair of buffered streams at a time, so the memory of a pair is reserved
+         * \return size_t
+         *
+         */
+        size_t GetCacheMemory() const
+        {
+            if (numPointsOnDisk == 0)
+                return 0;
+
+            return GetExtVectorCacheBytes<ext_spilled_point_vector_t>() + GetExtVectorCacheBytes<ext_spilled_neighbors_vector_t>();
+        }
+
+    private:
+
+        size_t numStripes = 0;
+        size_t numNeighbors = 0;
+        size_t numPoints = 0;
+        size_t numPointsOnDisk = 0;
+        size_t numSpilledPoints = 0;
+        std::vector<PendingPointsBucket> upBuckets;
+        std::vector<PendingPointsBucket> downBuckets;
+        std::vector<std::vector<SpilledSegment>> upSpilled;
+        std::vector<std::vector<SpilledSegment>> downSpilled;
+        std::vector<double> downMinY;
+
+        /** \brief Returns the bucket of a pending point, the buckets of the search to higher y come first and the buckets of the search to lower y follow
+         *          Points that have not completed the search to higher y go to the bucket of the stripe above the highest stripe searched,
+         *          otherwise they go to the bucket of the stripe below the lowest stripe searched
+         * \param pointNeighbors const PointNeighbors<neighbors_priority_queue_t>& the neighbors found so far
+         * \return size_t the index of the bucket, from 0 to 2*numStripes-1
+         *
+         */
+        size_t GetBucketIndex(const PointNeighbors<neighbors_priority_queue_t>& pointNeighbors) const
+        {
+            size_t highStripe = pointNeighbors.getHighStripe();
+
+            if (highStripe < numStripes - 1)
+                return highStripe + 1;
+            else
+                return numStripes + pointNeighbors.getLowStripe() - 1;
+        }
+
+        PendingPointsBucket& GetBucket(size_t iBucket)
+        {
+            return iBucket < numStripes ? upBuckets[iBucket] : downBuckets[iBucket - numStripes];
+        }
+
+        /** \brief Returns the lowest y that a point may need to search, it cannot search lower than its distance from the k-th neighbor found so far
+         *
+         * \param point const Point& the input point
+         * \param pointNeighbors const PointNeighbors<neighbors_priority_queue_t>& the neighbors found so far
+         * \return double
+         *
+         */
+        static double GetMinY(const Point& point, const PointNeighbors<neighbors_priority_queue_t>& pointNeighbors)
+        {
+            auto& maxNeighbor = pointNeighbors.MaxDistanceElement();
+            return maxNeighbor.pointId != 0 ? point.y - sqrt(maxNeighbor.distanceSquared) : std::numeric_limits<double>::lowest();
+        }
+
+        /** \brief Reads the spilled points of a segment from external memory and rebuilds their heaps
+         *
+         * \param segment const SpilledSegment& the spilled points
+         * \param bucket PendingPointsBucket& the bucket to add the points to
+         * \return void
+         *
+         */
+        void ReadSegment(const SpilledSegment& segment, PendingPointsBucket& bucket)
+        {
+            stxxl::vector_bufreader<ext_spilled_point_vector_t> pointReader(*segment.pPoints);
+            stxxl::vector_bufreader<ext_spilled_neighbors_vector_t> neighborReader(*segment.pNeighbors);
+            std::vector<Neighbor> neighbors(numNeighbors);
+
+            for (; !pointReader.empty(); ++pointReader)
+            {
+                const SpilledPendingPoint& spilledPoint = *pointReader;
+
+                for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor, ++neighborReader)
+                    neighbors[iNeighbor] = *neighborReader;
+
+                PointNeighbors<neighbors_priority_queue_t> pointNeighbors(numNeighbors);
+                pointNeighbors.setLowStripe(spilledPoint.lowStripe);
+                pointNeighbors.setHighStripe(spilledPoint.highStripe);
+                pointNeighbors.Restore(neighbors, spilledPoint.numAdditions);
+
+                bucket.Add(Point{spilledPoint.id, spilledPoint.x, spilledPoint.y}, std::move(pointNeighbors));
+            }
+        }
+};
+
+#endif // PENDINGPOINTS_H
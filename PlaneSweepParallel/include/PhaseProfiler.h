@@ -0,0 +1,424 @@
+/* Class definitions for profiling the phases of the algorithms
+    The algorithms record the phases they run (allocation of the containers of neighbors, sorting by y, splitting into stripes,
+    sorting by x, search and finalizing the result) and the result is checked in the verification phase. Each stripe searched by a thread
+    is recorded as a task of the thread, so the busy time of every thread and the compute time of every stripe are known.
+    The events are kept in thread local buffers while profiling is active, then they are summarized in the load imbalance of the threads
+    and written to a trace file in the Chrome trace event format, which is opened by chrome://tracing or https://ui.perfetto.dev
+    If the hardware counters have been compiled (HardwareCounters.h), each event also keeps the counts of its thread during the event.
+    The external memory algorithms also record each window of stripes: the time waiting for it, its loading and its computation.
+    Windows loaded in the background are shown in a separate row of the trace.
+ */
+#ifndef PHASEPROFILER_H
+#define PHASEPROFILER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <locale>
+#include <algorithm>
+#include "ApplicationException.h"
+#include "HardwareCounters.h"
+
+/** \brief Phases of the algorithms, StripeTask is the search of a stripe by a thread, the Window phases are recorded for each window of stripes
+ */
+enum class ProfilePhase { Allocation, SortY, SplitStripes, SortX, Search, Finalize, Verification, StripeTask, WindowIOWait, WindowLoad, WindowCompute };
+
+#define NUM_PROFILE_PHASES 11
+
+//thread index of the events recorded for background work, e.g. the loading of the next window of stripes
+#define PROFILE_BACKGROUND_THREAD 1000
+
+/** \brief The time in seconds since the start of the profiler and the hardware counters of the calling thread
+ */
+struct ProfileSample
+{
+    double time = 0.0;
+    HardwareCounterValues counters;
+};
+
+/** \brief A phase or a task run by a thread, the times are in seconds since the start of the profiler
+ */
+struct ProfileEvent
+{
+    ProfilePhase phase;
+    int thread;                         /**< index of the thread in the order it recorded its first event */
+    long stripe;                        /**< index of the stripe of a task or the first stripe of a window, -1 for the phases */
+    double start;
+    double finish;
+    HardwareCounterValues counters;     /**< counts of the thread during the event */
+};
+
+/** \brief Thread local buffers of the events of the phases
+ */
+class PhaseProfiler
+{
+    public:
+        /** \brief Returns the name of a phase
+         *
+         * \param phase ProfilePhase the phase
+         * \return const char*
+         *
+         */
+        static const char* GetPhaseName(ProfilePhase phase)
+        {
+            static const char* names[NUM_PROFILE_PHASES] = { "Allocation", "Sort Y", "Split Stripes", "Sort X", "Search", "Finalize", "Verification", "Stripe",
+                                                             "Window IO Wait", "Window Load", "Window Compute" };
+            return names[static_cast<int>(phase)];
+        }
+
+        /** \brief Discards the events of all threads and starts recording, it must be called while no algorithm is running
+         *
+         * \return void
+         *
+         */
+        static void Start()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+
+            for (auto& pBuffer : GetBuffers())
+                pBuffer->events.clear();
+
+            GetActive() = true;
+        }
+
+        /** \brief Stops recording, the events are kept until the next start
+         *
+         * \return void
+         *
+         */
+        static void Stop()
+        {
+            GetActive() = false;
+        }
+
+        static bool IsActive()
+        {
+            return GetActive().load(std::memory_order_relaxed);
+        }
+
+        /** \brief Returns the current time in seconds since the start of the profiler, and the hardware counters of the calling thread while profiling is active
+         *
+         * \return ProfileSample
+         *
+         */
+        static ProfileSample Now()
+        {
+            static const auto epoch = std::chrono::steady_clock::now();
+            ProfileSample sample;
+
+            if (HardwareCounters::IsEnabled() && IsActive())
+                sample.counters = HardwareCounters::Read();
+
+            sample.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+            return sample;
+        }
+
+        /** \brief Records a phase or a task of the calling thread, nothing is recorded if profiling is not active
+         *
+         * \param phase ProfilePhase the phase
+         * \param start const ProfileSample& the start returned by Now()
+         * \param finish const ProfileSample& the finish returned by Now()
+         * \param stripe long the index of the stripe of a task, -1 for the phases
+         * \return void
+         *
+         */
+        static void Record(ProfilePhase phase, const ProfileSample& start, const ProfileSample& finish, long stripe = -1)
+        {
+            if (!IsActive())
+                return;
+
+            ThreadBuffer& buffer = Local();
+            buffer.events.push_back({phase, buffer.thread, stripe, start.time, finish.time, finish.counters.Since(start.counters)});
+        }
+
+        /** \brief Records a phase that was run in the background by another thread, it is recorded by the calling thread when the work is received
+         *          so the background threads do not need their own buffers
+         * \param phase ProfilePhase the phase
+         * \param start const ProfileSample& the start returned by Now() in the background thread
+         * \param finish const ProfileSample& the finish returned by Now() in the background thread
+         * \param stripe long the index of the stripe or the first stripe of a window
+         * \return void
+         *
+         */
+        static void RecordBackground(ProfilePhase phase, const ProfileSample& start, const ProfileSample& finish, long stripe)
+        {
+            if (!IsActive())
+                return;
+
+            Local().events.push_back({phase, PROFILE_BACKGROUND_THREAD, stripe, start.time, finish.time, finish.counters.Since(start.counters)});
+        }
+
+        /** \brief Returns the events of all threads in the order of their start, it must be called while no algorithm is running
+         *
+         * \return std::vector<ProfileEvent>
+         *
+         */
+        static std::vector<ProfileEvent> Collect()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+            std::vector<ProfileEvent> events;
+
+            for (auto& pBuffer : GetBuffers())
+                events.insert(events.end(), pBuffer->events.cbegin(), pBuffer->events.cend());
+
+            std::sort(events.begin(), events.end(), [](const ProfileEvent& e1, const ProfileEvent& e2) { return e1.start < e2.start; });
+            return events;
+        }
+
+    private:
+        struct ThreadBuffer
+        {
+            int thread = 0;
+            std::vector<ProfileEvent> events;
+        };
+
+        static ThreadBuffer& Local()
+        {
+            thread_local ThreadBuffer* pLocal = Register();
+            return *pLocal;
+        }
+
+        static ThreadBuffer* Register()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+
+            auto& buffers = GetBuffers();
+            buffers.emplace_back(new ThreadBuffer());
+            buffers.back()->thread = int(buffers.size()) - 1;
+            return buffers.back().get();
+        }
+
+        static std::vector<std::unique_ptr<ThreadBuffer>>& GetBuffers()
+        {
+            static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+            return buffers;
+        }
+
+        static std::mutex& GetMutex()
+        {
+            static std::mutex buffersMutex;
+            return buffersMutex;
+        }
+
+        static std::atomic<bool>& GetActive()
+        {
+            static std::atomic<bool> active(false);
+            return active;
+        }
+};
+
+/** \brief Records a phase or a task from its construction until it goes out of scope
+ */
+class ProfileScope
+{
+    public:
+        ProfileScope(ProfilePhase phase, long stripe = -1) : phase(phase), stripe(stripe), start(PhaseProfiler::IsActive() ? PhaseProfiler::Now() : ProfileSample())
+        {
+        }
+
+        ~ProfileScope()
+        {
+            if (PhaseProfiler::IsActive())
+                PhaseProfiler::Record(phase, start, PhaseProfiler::Now(), stripe);
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        ProfilePhase phase;
+        long stripe;
+        ProfileSample start;
+};
+
+/** \brief Durations of the phases and load imbalance of the threads of a run
+ */
+struct ProfileSummary
+{
+    double phaseDurations[NUM_PROFILE_PHASES] = {};     /**< durations of the events of each phase, summed over the threads */
+    HardwareCounterValues phaseCounters[NUM_PROFILE_PHASES];    /**< hardware counts of the events of each phase, summed over the threads */
+    size_t numThreads = 0;                              /**< threads that searched at least one stripe */
+    size_t numStripeTasks = 0;
+    double minThreadBusy = 0.0;                         /**< seconds spent by the threads in stripe tasks */
+    double maxThreadBusy = 0.0;
+    double avgThreadBusy = 0.0;
+    double imbalance = 0.0;                             /**< maximum divided by average busy time, 1 for perfect balance */
+    double maxStripeCompute = 0.0;                      /**< seconds of the slowest stripe task */
+    double avgStripeCompute = 0.0;
+
+    /** \brief Summarizes the events of a run
+     *
+     * \param events const std::vector<ProfileEvent>& the events
+     * \return ProfileSummary
+     *
+     */
+    static ProfileSummary Compute(const std::vector<ProfileEvent>& events)
+    {
+        ProfileSummary summary;
+        std::vector<double> threadBusy;
+
+        for (auto& event : events)
+        {
+            double duration = event.finish - event.start;
+            summary.phaseDurations[static_cast<int>(event.phase)] += duration;
+            summary.phaseCounters[static_cast<int>(event.phase)] += event.counters;
+
+            if (event.phase == ProfilePhase::StripeTask)
+            {
+                if (threadBusy.size() <= size_t(event.thread))
+                    threadBusy.resize(event.thread + 1, -1.0);
+
+                threadBusy[event.thread] = std::max(threadBusy[event.thread], 0.0) + duration;
+                summary.maxStripeCompute = std::max(summary.maxStripeCompute, duration);
+                ++summary.numStripeTasks;
+            }
+        }
+
+        //threads that did not search any stripe are not counted, they may belong to another thread pool
+        threadBusy.erase(std::remove(threadBusy.begin(), threadBusy.end(), -1.0), threadBusy.end());
+
+        if (!threadBusy.empty())
+        {
+            summary.numThreads = threadBusy.size();
+            summary.minThreadBusy = *std::min_element(threadBusy.cbegin(), threadBusy.cend());
+            summary.maxThreadBusy = *std::max_element(threadBusy.cbegin(), threadBusy.cend());
+            summary.avgThreadBusy = summary.phaseDurations[static_cast<int>(ProfilePhase::StripeTask)]/threadBusy.size();
+            summary.imbalance = summary.avgThreadBusy > 0.0 ? summary.maxThreadBusy/summary.avgThreadBusy : 1.0;
+            summary.avgStripeCompute = summary.phaseDurations[static_cast<int>(ProfilePhase::StripeTask)]/summary.numStripeTasks;
+        }
+
+        return summary;
+    }
+
+    double GetDuration(ProfilePhase phase) const
+    {
+        return phaseDurations[static_cast<int>(phase)];
+    }
+
+    const HardwareCounterValues& GetCounters(ProfilePhase phase) const
+    {
+        return phaseCounters[static_cast<int>(phase)];
+    }
+};
+
+/** \brief Trace of the runs in the Chrome trace event format, each run is shown as a separate process
+ */
+class ProfileTrace
+{
+    public:
+        ProfileTrace() {}
+
+        virtual ~ProfileTrace() {}
+
+        /** \brief Adds the events of a run
+         *
+         * \param title const std::string& the title of the run
+         * \param events const std::vector<ProfileEvent>& the events of the run
+         * \return void
+         *
+         */
+        void AddRun(const std::string& title, const std::vector<ProfileEvent>& events)
+        {
+            runs.push_back({title, events});
+        }
+
+        /** \brief Writes the trace to a JSON file
+         *
+         * \param filename const std::string& the file to create
+         * \return void
+         *
+         */
+        void WriteJson(const std::string& filename) const
+        {
+            std::ofstream outFile(filename, std::ios_base::out);
+            if (!outFile.is_open())
+                throw ApplicationException("Cannot create trace file " + filename);
+
+            //JSON numbers need the classic format, the timestamps are in microseconds
+            outFile.imbue(std::locale::classic());
+            outFile << std::fixed << std::setprecision(3);
+            outFile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+            bool first = true;
+            for (size_t iRun = 0; iRun < runs.size(); ++iRun)
+            {
+                int pid = int(iRun) + 1;
+                outFile << (first ? "\n" : ",\n") << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+                    << ", \"tid\": 0, \"args\": {\"name\": " << Quote(std::to_string(pid) + ". " + runs[iRun].title) << "}}";
+                first = false;
+
+                bool hasBackground = std::any_of(runs[iRun].events.cbegin(), runs[iRun].events.cend(),
+                                                 [](const ProfileEvent& event) { return event.thread == PROFILE_BACKGROUND_THREAD; });
+                if (hasBackground)
+                    outFile << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << PROFILE_BACKGROUND_THREAD
+                        << ", \"args\": {\"name\": \"Background\"}}";
+
+                for (auto& event : runs[iRun].events)
+                {
+                    bool isTask = event.phase == ProfilePhase::StripeTask;
+                    bool isWindow = event.phase >= ProfilePhase::WindowIOWait;
+                    std::string name = isTask ? "Stripe " + std::to_string(event.stripe) : PhaseProfiler::GetPhaseName(event.phase);
+
+                    outFile << ",\n{\"name\": " << Quote(name) << ", \"cat\": \"" << (isTask ? "stripe" : isWindow ? "window" : "phase") << "\", \"ph\": \"X\""
+                        << ", \"pid\": " << pid << ", \"tid\": " << event.thread
+                        << ", \"ts\": " << event.start*1.0E6 << ", \"dur\": " << (event.finish - event.start)*1.0E6;
+
+                    //the arguments are shown in the details of the event
+                    std::string separator = ", \"args\": {";
+
+                    if (event.stripe >= 0)
+                    {
+                        outFile << separator << "\"stripe\": " << event.stripe;
+                        separator = ", ";
+                    }
+
+                    if (event.counters.cycles > 0)
+                    {
+                        const HardwareCounterValues& c = event.counters;
+                        outFile << separator << "\"cycles\": " << c.cycles << ", \"instructions\": " << c.instructions << ", \"ipc\": " << c.GetIpc()
+                            << ", \"llcMisses\": " << c.llcMisses << ", \"dtlbMisses\": " << c.dtlbMisses << ", \"branchMisses\": " << c.branchMisses;
+                        separator = ", ";
+                    }
+
+                    if (separator == ", ")
+                        outFile << "}";
+
+                    outFile << "}";
+                }
+            }
+
+            outFile << "\n]}\n";
+            outFile.close();
+        }
+
+    private:
+        struct TraceRun
+        {
+            std::string title;
+            std::vector<ProfileEvent> events;
+        };
+
+        std::vector<TraceRun> runs;
+
+        static std::string Quote(const std::string& text)
+        {
+            std::string quoted = "\"";
+
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                    quoted += '\\';
+
+                quoted += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+            }
+
+            return quoted + "\"";
+        }
+};
+
+#endif // PHASEPROFILER_H
@@ -1,6 +1,7 @@
 /* Serial plane sweep algorithm implementation
     This implementation operates on indexes of points so it has some performance overhead in comparison to the copy algorithm.
-    The advantage is that it needs less memory
+    The advantage is that it needs less memory. Indexes are 32-bit positions in the datasets, unless a dataset
+    has more than 2^32-1 points in which case 64-bit positions are used
  */
 
 #ifndef PLANESWEEPALGORITHM_H
@@ -8,6 +9,8 @@
 
 #include "AbstractAllKnnAlgorithm.h"
 #include <cmath>
+#include <cstdint>
+#include <limits>
 
 /** \brief Serial plane sweep algorithm using indexes to points
  */
@@ -28,6 +31,24 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
         }
 
         std::unique_ptr<AllKnnResult> Process(AllKnnProblem& problem) override
+        {
+            //use the smallest index type that can address both datasets
+            if (problem.GetInputDataset().size() <= std::numeric_limits<uint32_t>::max() &&
+                problem.GetTrainingDataset().size() <= std::numeric_limits<uint32_t>::max())
+                return ProcessIndex<uint32_t>(problem);
+            else
+                return ProcessIndex<size_t>(problem);
+        }
+
+    private:
+        /** \brief Runs the algorithm using a specific type for the indexes of points
+         *
+         * \param problem AllKnnProblem& The definition of AkNN problem
+         * \return unique_ptr<AllKnnResult> A smart pointer to the result of the algorithm
+         *
+         */
+        template<class Index>
+        std::unique_ptr<AllKnnResult> ProcessIndex(AllKnnProblem& problem)
         {
             size_t numNeighbors = problem.GetNumNeighbors();
 
@@ -39,13 +60,14 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
             auto& trainingDataset = problem.GetTrainingDataset();
 
             auto start = std::chrono::high_resolution_clock::now();
+            ProfileSample sortStart = PhaseProfiler::Now();
 
-            //copy the datasets
-            point_vector_index_t inputDatasetIndex(inputDataset.size());
-            point_vector_index_t trainingDatasetIndex(trainingDataset.size());
+            //create the indexes of the datasets
+            std::vector<Index> inputDatasetIndex(inputDataset.size());
+            std::vector<Index> trainingDatasetIndex(trainingDataset.size());
 
-            point_vector_iterator_t m = inputDataset.cbegin();
-            point_vector_iterator_t n = trainingDataset.cbegin();
+            Index m = 0;
+            Index n = 0;
 
             //fill vectors with indexes of points
             generate(inputDatasetIndex.begin(), inputDatasetIndex.end(), [&m] { return m++; } );
@@ -53,18 +75,23 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
 
             //sort the indexes
             sort(inputDatasetIndex.begin(), inputDatasetIndex.end(),
-                 [&](const point_vector_iterator_t& iter1, const point_vector_iterator_t& iter2)
+                 [&](const Index& index1, const Index& index2)
                  {
-                     return iter1->x < iter2->x;
+                     return inputDataset[index1].x < inputDataset[index2].x;
                  });
 
             sort(trainingDatasetIndex.begin(), trainingDatasetIndex.end(),
-                 [&](const point_vector_iterator_t& iter1, const point_vector_iterator_t& iter2)
+                 [&](const Index& index1, const Index& index2)
                  {
-                     return iter1->x < iter2->x;
+                     return trainingDataset[index1].x < trainingDataset[index2].x;
                  });
 
+            auto inputDatasetBegin = inputDataset.cbegin();
+            auto trainingDatasetBegin = trainingDataset.cbegin();
+
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
+            PhaseProfiler::Record(ProfilePhase::SortX, sortStart, searchStart);
 
             auto startSearchPos = trainingDatasetIndex.cbegin();
             auto trainingDatasetIndexBegin = trainingDatasetIndex.cbegin();
@@ -75,19 +102,19 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
             //loop through all input points
             for (auto inputPointIndex = inputDatasetIndexBegin; inputPointIndex < inputDatasetIndexEnd; ++inputPointIndex)
             {
-                auto& inputPointIter = *inputPointIndex;
+                auto inputPointIter = inputDatasetBegin + *inputPointIndex;
                 auto& neighbors = pNeighborsContainer->at(inputPointIter->id - 1);
 
                 //find the training point with x greater or equal to input point
-                point_vector_index_iterator_t nextTrainingPointIndex = startSearchPos;
-                while (nextTrainingPointIndex < trainingDatasetIndexEnd && (*nextTrainingPointIndex)->x < inputPointIter->x)
+                auto nextTrainingPointIndex = startSearchPos;
+                while (nextTrainingPointIndex < trainingDatasetIndexEnd && trainingDataset[*nextTrainingPointIndex].x < inputPointIter->x)
                 {
                     ++nextTrainingPointIndex;
                 }
 
                 startSearchPos = nextTrainingPointIndex;
                 //find the previous training point
-                point_vector_index_iterator_t prevTrainingPointIndex = nextTrainingPointIndex;
+                auto prevTrainingPointIndex = nextTrainingPointIndex;
                 if (prevTrainingPointIndex > trainingDatasetIndexBegin)
                 {
                     --prevTrainingPointIndex;
@@ -103,7 +130,7 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
                     if (!lowStop)
                     {
                         //check distance and add neighbor to heap
-                        if (CheckAddNeighbor(inputPointIter, *prevTrainingPointIndex, neighbors))
+                        if (CheckAddNeighbor(inputPointIter, trainingDatasetBegin + *prevTrainingPointIndex, neighbors))
                         {
                             if (prevTrainingPointIndex > trainingDatasetIndexBegin)
                             {
@@ -127,7 +154,7 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
                     if (!highStop)
                     {
                          //check distance and add neighbor to heap
-                        if (CheckAddNeighbor(inputPointIter, *nextTrainingPointIndex, neighbors))
+                        if (CheckAddNeighbor(inputPointIter, trainingDatasetBegin + *nextTrainingPointIndex, neighbors))
                         {
                             if (nextTrainingPointIndex < trainingDatasetIndexEnd)
                             {
@@ -150,6 +177,8 @@ class PlaneSweepAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -43,6 +43,7 @@ class PlaneSweepCopyAlgorithm : public AbstractAllKnnAlgorithm
             auto& trainingDataset = pResult->GetTrainingDatasetSorted();
 
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -116,6 +117,8 @@ class PlaneSweepCopyAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -52,6 +52,7 @@ class PlaneSweepCopyParallelAlgorithm : public AbstractAllKnnAlgorithm
             auto& trainingDataset = pResult->GetTrainingDatasetSorted();
 
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -67,7 +68,7 @@ class PlaneSweepCopyParallelAlgorithm : public AbstractAllKnnAlgorithm
                 //in the parallel algorithm we have to do a binary search to find the next training point
                 //this is in contrast to the serial version of the algorithm where we can use the value from the previous repetition of the loop
                 auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                                    [&](const Point& point, const double& value) { return point.x < value; } );
+                                    [&](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
                 auto prevTrainingPointIter = nextTrainingPointIter;
                 if (prevTrainingPointIter > trainingDatasetBegin)
@@ -122,6 +123,8 @@ class PlaneSweepCopyParallelAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
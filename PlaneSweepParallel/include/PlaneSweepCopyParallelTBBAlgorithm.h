@@ -59,6 +59,7 @@ class PlaneSweepCopyParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
             auto& trainingDataset = pResult->GetTrainingDatasetSorted();
 
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
             auto trainingDatasetEnd = trainingDataset.cend();
@@ -78,7 +79,7 @@ class PlaneSweepCopyParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
 
 
                         auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                                            [&](const Point& point, const double& value) { return point.x < value; } );
+                                            [&](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
                         auto prevTrainingPointIter = nextTrainingPointIter;
                         if (prevTrainingPointIter > trainingDatasetBegin)
@@ -135,6 +136,8 @@ class PlaneSweepCopyParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
                 }
             );
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -6,13 +6,27 @@
 #include <vector>
 #include <deque>
 #include <fstream>
+#include <cstdint>
 #include <stxxl/vector>
+#include "MemoryTracker.h"
+
+/* Point ids are 64-bit by default. Building with COMPACT_POINT_IDS defined uses 32-bit ids. The width is chosen at build time only,
+    there is no fallback to 64-bit ids: datasets with more than 2^32-1 points are rejected when loading.
+    Point and Neighbor are not packed, they keep the alignment of their coordinates and distances, so in RAM they take 24 and 16 bytes
+    with either width and the 32-bit ids save no memory there. The saving is in the data written to disk: the neighbors in the external
+    memory vectors (NeighborRecord) and in the binary result files take 12 bytes instead of 16, and so do the neighbors buffered for the output vector.
+    The Makefile passes the DEFINES variable to the compiler, e.g. make DEFINES=-DCOMPACT_POINT_IDS */
+#ifdef COMPACT_POINT_IDS
+typedef uint32_t point_id_t;
+#else
+typedef unsigned long point_id_t;
+#endif
 
 /** \brief Definition of point structure
  */
 struct Point
 {
-    unsigned long id;
+    point_id_t id;
     double x;
     double y;
 };
@@ -21,18 +35,33 @@ struct Point
  */
 struct Neighbor
 {
-    unsigned long pointId;
+    point_id_t pointId;
     double distanceSquared;
 };
 
-/** \brief Definition of neighbor for external memory algorithm
- *          We need also the input point id and rank of neighbor so we can sort the list of neighbors
+/** \brief Layout of a neighbor in the external memory vectors, it is packed so it takes 12 bytes with 32-bit ids and 16 bytes with 64-bit ids
+ *          It converts to and from Neighbor, so the external vectors are read and written with neighbors
  */
-struct NeighborExt : public Neighbor
+#pragma pack(push, 1)
+struct NeighborRecord
 {
-    unsigned long inputPointId;
-    unsigned int position;
+    point_id_t pointId;
+    double distanceSquared;
+
+    NeighborRecord() : pointId(0), distanceSquared(0.0)
+    {
+    }
+
+    NeighborRecord(const Neighbor& neighbor) : pointId(neighbor.pointId), distanceSquared(neighbor.distanceSquared)
+    {
+    }
+
+    operator Neighbor() const
+    {
+        return Neighbor{pointId, distanceSquared};
+    }
 };
+#pragma pack(pop)
 
 /** \brief Comparer for neighbors based on distance
  */
@@ -52,21 +81,28 @@ struct StripePoint : public Point
     size_t stripe;
 };
 
+/** \brief Layout of a point in binary dataset files, it does not depend on the type of point ids
+ */
+struct PointRecord
+{
+    unsigned long id;
+    double x;
+    double y;
+};
+
 bool endsWith(const std::string& str, const std::string& suffix)
 {
     return str.size() >= suffix.size() &&
            str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
 }
 
-//Definitions of vector types
-typedef std::vector<Neighbor> neighbors_vector_t;
+//Definitions of vector types, the memory of points and heaps of neighbors is recorded by MemoryTracker
+typedef std::vector<Neighbor, TrackingAllocator<Neighbor>> neighbors_vector_t;
 typedef std::deque<Neighbor> neighbors_deque_t;
 typedef std::priority_queue<Neighbor, neighbors_vector_t, NeighborComparer> neighbors_priority_queue_t;
-typedef std::vector<Point> point_vector_t;
+typedef std::vector<Point, TrackingAllocator<Point>> point_vector_t;
 typedef std::vector<point_vector_t> point_vector_vector_t;
 typedef point_vector_t::const_iterator point_vector_iterator_t;
-typedef std::vector<point_vector_iterator_t> point_vector_index_t;
-typedef point_vector_index_t::const_iterator point_vector_index_iterator_t;
 
 //class used for output of numbers in greek format
 template <class charT, charT decimalSeparator, charT thousandsSeparator>
@@ -77,9 +113,24 @@ protected:
     std::string do_grouping() const { return "\03"; }
 };
 
+/* The caches of the external memory vectors are taken from the memory limit of the external algorithm. The default cache
+    of STXXL (8 pages of 4 blocks of 2MB) takes 64MB for each vector, so the vectors use a cache of 2 pages of 1 block of 1MB.
+    Most of their accesses are sequential and go through buffered readers and writers, which have their own buffers. */
+#define EXT_VECTOR_PAGE_SIZE 1
+#define EXT_VECTOR_NUM_PAGES 2
+#define EXT_VECTOR_BLOCK_SIZE (1024*1024)
+
 //Definitions for external memory vectors
-typedef stxxl::VECTOR_GENERATOR<Point>::result ext_point_vector_t;
-typedef stxxl::VECTOR_GENERATOR<NeighborExt>::result ext_neighbors_vector_t;
-typedef stxxl::VECTOR_GENERATOR<size_t>::result ext_size_vector_t;
+typedef stxxl::VECTOR_GENERATOR<Point, EXT_VECTOR_PAGE_SIZE, EXT_VECTOR_NUM_PAGES, EXT_VECTOR_BLOCK_SIZE>::result ext_point_vector_t;
+typedef stxxl::VECTOR_GENERATOR<NeighborRecord, EXT_VECTOR_PAGE_SIZE, EXT_VECTOR_NUM_PAGES, EXT_VECTOR_BLOCK_SIZE>::result ext_neighbors_vector_t;
+typedef stxxl::VECTOR_GENERATOR<size_t, EXT_VECTOR_PAGE_SIZE, EXT_VECTOR_NUM_PAGES, EXT_VECTOR_BLOCK_SIZE>::result ext_size_vector_t;
+
+/** \brief Returns the memory of the cache of an external memory vector type (pages x blocks per page x block size)
+ */
+template<class ExtVector>
+constexpr size_t GetExtVectorCacheBytes()
+{
+    return size_t(ExtVector::block_size)*ExtVector::page_size*ExtVector::n_pages;
+}
 
 #endif // PLANESWEEPPARALLEL_H_INCLUDED
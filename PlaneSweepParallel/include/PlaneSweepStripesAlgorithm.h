@@ -45,10 +45,13 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
             int numStripesLocal = stripeData.InputDatasetStripe.size();
             //record the time used for splitting stripes
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             //serial loop through all input points
             for (int iStripeInput = 0; iStripeInput < numStripesLocal; ++iStripeInput)
             {
+                ProfileScope profileScope(ProfilePhase::StripeTask, iStripeInput);
+
                 auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput];
                 auto inputDatasetBegin = inputDataset.cbegin();
                 auto inputDatasetEnd = inputDataset.cend();
@@ -86,6 +89,7 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
                             else
                             {
                                 //distance from boundary is greater than top of the heap, stop looking to lower stripes
+                                COUNT_SEARCH(dyTerminations, 1);
                                 lowStripeEnd = true;
                             }
                         }
@@ -106,6 +110,7 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
                             else
                             {
                                 //distance from boundary is greater than top of the heap, stop looking to lower stripes
+                                COUNT_SEARCH(dyTerminations, 1);
                                 highStripeEnd = true;
                             }
                         }
@@ -113,6 +118,8 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -140,6 +147,7 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
         void PlaneSweepStripe(point_vector_iterator_t inputPointIter, StripeData stripeData, int iStripeTraining,
                               PointNeighbors<neighbors_priority_queue_t>& neighbors, double mindy) const
         {
+            COUNT_SEARCH(stripesVisited, 1);
             auto& trainingDataset = stripeData.TrainingDatasetStripe[iStripeTraining];
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
@@ -147,7 +155,7 @@ class PlaneSweepStripesAlgorithm : public AbstractAllKnnAlgorithm
 
             //do a binary search to find the next training point in x axis
             auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                        [](const Point& point, const double& value) { return point.x < value; } );
+                        [](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
             //find the previous training point
             auto prevTrainingPointIter = nextTrainingPointIter;
@@ -42,6 +42,11 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
             return ss.str();
         }
 
+        bool SupportsResultSink() const override
+        {
+            return true;
+        }
+
         std::unique_ptr<AllKnnResult> Process(AllKnnProblem& problem) override
         {
             //the implementation is similar to PlaneSweepStripesAlgorithm
@@ -75,12 +80,15 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
             numStripes = stripeData.InputDatasetStripe.size();
 
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             //parallel loop through all stripes
             //we use dynamic scheduling so thread scheduling is based on the workload of each stripe
             #pragma omp parallel for schedule(dynamic)
             for (int iStripeInput = 0; iStripeInput < numStripes; ++iStripeInput)
             {
+                ProfileScope profileScope(ProfilePhase::StripeTask, iStripeInput);
+
                 auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput];
                 auto inputDatasetBegin = inputDataset.cbegin();
                 auto inputDatasetEnd = inputDataset.cend();
@@ -114,6 +122,7 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
                             }
                             else
                             {
+                                COUNT_SEARCH(dyTerminations, 1);
                                 lowStripeEnd = true;
                             }
                         }
@@ -130,13 +139,20 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
                             }
                             else
                             {
+                                COUNT_SEARCH(dyTerminations, 1);
                                 highStripeEnd = true;
                             }
                         }
                     }
+
+                    //pass the neighbors to the result sink as soon as the search of the point has been completed
+                    if (pResultSink != nullptr)
+                        ConsumeNeighbors(inputPointIter->id, neighbors);
                 }
             }
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -148,14 +164,6 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
             return pResult;
         }
     protected:
-
-    private:
-        int numStripes = 0;
-        int numThreads = 0;
-        bool parallelSort = false;
-        bool parallelSplit = false;
-        bool splitByT = false;
-
         /** \brief Searches for neighbors of an input point in a specific stripe
          *
          * \param inputPointIter point_vector_iterator_t iterator pointing to input point
@@ -169,6 +177,7 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
         void PlaneSweepStripe(point_vector_iterator_t inputPointIter, StripeData stripeData, int iStripeTraining,
                               PointNeighbors<neighbors_priority_queue_t>& neighbors, double mindy) const
         {
+            COUNT_SEARCH(stripesVisited, 1);
             //the implementation is the same as PlaneSweepStripesAlgorithm
             auto& trainingDataset = stripeData.TrainingDatasetStripe[iStripeTraining];
 
@@ -179,7 +188,7 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
                 return;
 
             auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                        [](const Point& point, const double& value) { return point.x < value; } );
+                        [](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
             auto prevTrainingPointIter = nextTrainingPointIter;
             if (prevTrainingPointIter > trainingDatasetBegin)
@@ -232,6 +241,13 @@ class PlaneSweepStripesParallelAlgorithm : public AbstractAllKnnAlgorithm
                 }
             }
         }
+
+    private:
+        int numStripes = 0;
+        int numThreads = 0;
+        bool parallelSort = false;
+        bool parallelSplit = false;
+        bool splitByT = false;
 };
 
 #endif // PLANESWEEPSTRIPESPARALLELALGORITHM_H
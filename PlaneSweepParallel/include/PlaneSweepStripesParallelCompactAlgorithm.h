@@ -0,0 +1,224 @@
+/* Parallel plane sweep algorithm with compact stripes (OpenMP and Intel TBB implementation)
+    The algorithm is the same as PlaneSweepStripesParallelAlgorithm, but the training stripes are converted to 32-bit coordinates
+    (see CompactStripes.h) and the double coordinates of the training dataset are read only to recheck the candidates of each input point.
+    The coordinate type and the parallel library are template parameters.
+*/
+#ifndef PLANESWEEPSTRIPESPARALLELCOMPACTALGORITHM_H
+#define PLANESWEEPSTRIPESPARALLELCOMPACTALGORITHM_H
+
+#include "AbstractAllKnnAlgorithm.h"
+#include "AllKnnResultStripesParallel.h"
+#include "AllKnnResultStripesParallelTBB.h"
+#include "CompactStripes.h"
+
+/** \brief Parallel plane sweep with stripes of compact coordinates
+ *
+ * \tparam Coordinate the coordinate type of the stripes, it must have a CompactCoordinates specialization
+ * \tparam useTBB true to use Intel TBB, false to use OpenMP
+ */
+template<class Coordinate, bool useTBB>
+class PlaneSweepStripesParallelCompactAlgorithm : public AbstractAllKnnAlgorithm
+{
+    public:
+        /** \brief Constructor
+         *
+         * \param numStripes int number of stripes to use
+         * \param numThreads int number of threads to use
+         * \param splitByT bool true if we want to split stripes by using the training dataset
+         */
+        PlaneSweepStripesParallelCompactAlgorithm(int numStripes, int numThreads, bool splitByT) : numStripes(numStripes),
+            numThreads(numThreads), splitByT(splitByT)
+        {
+        }
+
+        virtual ~PlaneSweepStripesParallelCompactAlgorithm() {}
+
+        std::string GetTitle() const
+        {
+            std::stringstream ss;
+
+            ss << "Plane sweep stripes parallel " << CompactCoordinates<Coordinate>::TITLE << (useTBB ? " TBB" : "") << ", splitByTraining=" << splitByT;
+            return ss.str();
+        }
+
+        std::string GetPrefix() const
+        {
+            std::stringstream ss;
+
+            ss << "planesweep_stripes_parallel_" << CompactCoordinates<Coordinate>::PREFIX << (useTBB ? "_TBB" : "") << "_splitByT_" << splitByT;
+            return ss.str();
+        }
+
+        bool SupportsResultSink() const override
+        {
+            return true;
+        }
+
+        std::unique_ptr<AllKnnResult> Process(AllKnnProblem& problem) override
+        {
+            size_t numNeighbors = problem.GetNumNeighbors();
+
+            //allocate vector of neighbors for all input points
+            auto pNeighborsContainer =
+                this->CreateNeighborsContainer<pointNeighbors_priority_queue_vector_t>(problem.GetInputDataset(), numNeighbors);
+
+            tbb::task_scheduler_init scheduler(tbb::task_scheduler_init::deferred);
+
+            //if numThreads=0, let the system decide the number of threads based on number of cores
+            if (useTBB)
+                scheduler.initialize(numThreads > 0 ? numThreads : tbb::task_scheduler_init::automatic);
+            else if (numThreads > 0)
+                omp_set_num_threads(numThreads);
+
+            auto start = std::chrono::high_resolution_clock::now();
+
+            //stripes are always created with parallel splitting and sorting
+            std::unique_ptr<AllKnnResultStripes> pResult;
+            if (useTBB)
+                pResult.reset(new AllKnnResultStripesParallelTBB(problem, GetPrefix(), true, splitByT));
+            else
+                pResult.reset(new AllKnnResultStripesParallel(problem, GetPrefix(), true, splitByT));
+
+            //split datasets into stripes
+            auto stripeData = pResult->GetStripeData(numStripes);
+
+            //get the actual number of stripes (may be slightly more than the desired number)
+            numStripes = stripeData.InputDatasetStripe.size();
+
+            //convert the training stripes to compact coordinates, it is counted in the sorting time as part of preprocessing
+            CompactStripes<Coordinate> compactStripes(problem.GetTrainingDataset(), problem.GetBoundingBox(), numStripes);
+
+            {
+                //the positions by id are needed only while the stripes are converted
+                auto positionsById = GetPositionsById(problem.GetTrainingDataset());
+
+                //the double precision points of each stripe are released as soon as it has been converted
+                ParallelFor(numStripes, [&](int iStripe)
+                    {
+                        compactStripes.AddStripe(iStripe, stripeData.TrainingDatasetStripe[iStripe], positionsById);
+                        pResult->ReleaseTrainingStripe(iStripe);
+                    });
+            }
+
+            auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
+
+            //parallel loop through all stripes
+            ParallelFor(numStripes, [&](int iStripeInput)
+                {
+                    ProfileScope profileScope(ProfilePhase::StripeTask, iStripeInput);
+
+                    typename CompactStripes<Coordinate>::PointSearch search(compactStripes, numNeighbors);
+                    auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput];
+                    auto inputDatasetBegin = inputDataset.cbegin();
+                    auto inputDatasetEnd = inputDataset.cend();
+
+                    //loop through all points of current stripe
+                    for (auto inputPointIter = inputDatasetBegin; inputPointIter < inputDatasetEnd; ++inputPointIter)
+                    {
+                        int iStripeTraining = iStripeInput;
+                        auto& neighbors = pNeighborsContainer->at(inputPointIter->id - 1);
+
+                        //first check for candidates in the same stripe
+                        search.Start(*inputPointIter);
+                        search.PlaneSweepStripe(iStripeTraining, 0.0);
+
+                        int iStripeTrainingPrev = iStripeTraining - 1;
+                        int iStripeTrainingNext = iStripeTraining + 1;
+                        bool lowStripeEnd = iStripeTrainingPrev < 0;
+                        bool highStripeEnd = iStripeTrainingNext >= numStripes;
+
+                        //now check for candidates in other stripes moving alternately to higher and lower y
+                        //the upper bound of the k-th distance replaces the distance of the farthest neighbor
+                        while (!lowStripeEnd || !highStripeEnd)
+                        {
+                            if (!lowStripeEnd)
+                            {
+                                double dyLow = inputPointIter->y - stripeData.StripeBoundaries[iStripeTrainingPrev].maxY;
+                                double dySquaredLow = dyLow*dyLow;
+                                if (dySquaredLow < search.GetMaxDistanceSquared())
+                                {
+                                    search.PlaneSweepStripe(iStripeTrainingPrev, dySquaredLow);
+                                    --iStripeTrainingPrev;
+                                    lowStripeEnd = iStripeTrainingPrev < 0;
+                                }
+                                else
+                                {
+                                    COUNT_SEARCH(dyTerminations, 1);
+                                    lowStripeEnd = true;
+                                }
+                            }
+
+                            if (!highStripeEnd)
+                            {
+                                double dyHigh = stripeData.StripeBoundaries[iStripeTrainingNext].minY - inputPointIter->y;
+                                double dySquaredHigh = dyHigh*dyHigh;
+                                if (dySquaredHigh < search.GetMaxDistanceSquared())
+                                {
+                                    search.PlaneSweepStripe(iStripeTrainingNext, dySquaredHigh);
+                                    ++iStripeTrainingNext;
+                                    highStripeEnd = iStripeTrainingNext >= numStripes;
+                                }
+                                else
+                                {
+                                    COUNT_SEARCH(dyTerminations, 1);
+                                    highStripeEnd = true;
+                                }
+                            }
+                        }
+
+                        //recheck the candidates with the double coordinates
+                        search.Finish(inputPointIter, neighbors);
+
+                        //pass the neighbors to the result sink as soon as the search of the point has been completed
+                        if (pResultSink != nullptr)
+                            ConsumeNeighbors(inputPointIter->id, neighbors);
+                    }
+                });
+
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
+            auto finish = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> elapsed = finish - start;
+            std::chrono::duration<double> elapsedSorting = finishSorting - start;
+
+            pResult->setDuration(elapsed);
+            pResult->setDurationSorting(elapsedSorting);
+            pResult->setNeighborsContainer(pNeighborsContainer);
+
+            return pResult;
+        }
+
+    private:
+        int numStripes = 0;
+        int numThreads = 0;
+        bool splitByT = false;
+
+        /** \brief Calls a function for each stripe in parallel
+         *          OpenMP uses dynamic scheduling so thread scheduling is based on the workload of each stripe
+         * \param count int the number of stripes
+         * \param function const Function& the function to call with the index of a stripe
+         * \return void
+         *
+         */
+        template<class Function>
+        void ParallelFor(int count, const Function& function) const
+        {
+            if (useTBB)
+            {
+                parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range)
+                    {
+                        for (int i = range.begin(); i < range.end(); ++i)
+                            function(i);
+                    });
+            }
+            else
+            {
+                #pragma omp parallel for schedule(dynamic)
+                for (int i = 0; i < count; ++i)
+                    function(i);
+            }
+        }
+};
+
+#endif // PLANESWEEPSTRIPESPARALLELCOMPACTALGORITHM_H
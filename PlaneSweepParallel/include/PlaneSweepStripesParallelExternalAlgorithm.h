@@ -18,9 +18,12 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
          * \param numThreads int number of threads to use
          * \param parallelSort bool true if we want to use parallel sorting of stripe points by x
          * \param splitByT bool true if we want to split stripes by using the training dataset
+         * \param prefetchWindows bool true if we want to load the next window of stripes in the background
+         * \param haloWindows bool true if we want to load training stripes below each window in the first phase, to reduce the second phase
          */
-        PlaneSweepStripesParallelExternalAlgorithm(size_t numStripes, int numThreads, bool parallelSort, bool splitByT) : numStripes(numStripes),
-            numThreads(numThreads), parallelSort(parallelSort), splitByT(splitByT)
+        PlaneSweepStripesParallelExternalAlgorithm(size_t numStripes, int numThreads, bool parallelSort, bool splitByT, bool prefetchWindows, bool haloWindows)
+            : numStripes(numStripes), numThreads(numThreads), parallelSort(parallelSort), splitByT(splitByT), prefetchWindows(prefetchWindows),
+              haloWindows(haloWindows)
         {
         }
         virtual ~PlaneSweepStripesParallelExternalAlgorithm() {}
@@ -30,8 +33,21 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
             return true;
         }
 
+        bool SupportsResultSink() const override
+        {
+            return true;
+        }
+
         std::string GetTitle() const
         {
+            if (haloWindows)
+            {
+                if (splitByT)
+                    return parallelSort ? "Plane sweep stripes parallel external (parallel sorting, split by training, halo windows)" : "Plane sweep stripes parallel external (split by training, halo windows)";
+                else
+                    return parallelSort ? "Plane sweep stripes parallel external (parallel sorting, halo windows)" : "Plane sweep stripes parallel external (halo windows)";
+            }
+
             if (splitByT)
                 return parallelSort ? "Plane sweep stripes parallel external (parallel sorting, split by training)" : "Plane sweep stripes parallel external (split by training)";
             else
@@ -40,6 +56,14 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
 
         std::string GetPrefix() const
         {
+            if (haloWindows)
+            {
+                if (splitByT)
+                    return parallelSort ? "planesweep_stripes_parallel_external_psort_splitByT_halo" : "planesweep_stripes_parallel_external_splitByT_halo";
+                else
+                    return parallelSort ? "planesweep_stripes_parallel_external_psort_halo" : "planesweep_stripes_parallel_external_halo";
+            }
+
             if (splitByT)
                 return parallelSort ? "planesweep_stripes_parallel_external_psort_splitByT" : "planesweep_stripes_parallel_external_splitByT";
             else
@@ -63,40 +87,26 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
             //create result object
             auto pResult = std::unique_ptr<AllKnnResultStripesParallelExternal>(
                                 new AllKnnResultStripesParallelExternal(static_cast<AllKnnProblemExternal&>(problem),
-                                                GetPrefix(), parallelSort, splitByT));
+                                                GetPrefix(), parallelSort, splitByT, prefetchWindows, haloWindows));
+
+            //the completed points are passed to the result sink by the commit of each window
+            pResult->SetResultSink(pResultSink);
 
             std::cout << "split stripes start" << std::endl;
             numStripes = pResult->SplitStripes(numStripes);
             std::cout << "split stripes end" << std::endl;
             auto finishSorting = std::chrono::high_resolution_clock::now();
 
-            size_t startStripe = 0;
-            size_t endStripe = 0;
-            size_t nextStripe = 0;
-
             std::cout << "first pass started" << std::endl;
 
-            //first phase of the algorithm
-            do
-            {
-                //load a window of stripes that fits into RAM
-                auto pWindow = pResult->GetWindow(nextStripe, false);
-
-                if (pWindow != nullptr)
-                {
-                    startStripe = pWindow->GetStartStripe();
-                    endStripe = pWindow->GetEndStripe();
-                    nextStripe = endStripe + 1;
-                    std::cout << "got window " << startStripe << " " << endStripe << std::endl;
-                    //run the plane sweep algorithm for this window
-                    PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
-                    std::cout << "processed window" << std::endl;
-                }
-                else
-                    //no more windows available
-                    break;
+            //first phase of the algorithm, load the first window of stripes that fits into RAM
+            auto pWindow = pResult->GetWindow(0, false);
 
-            } while (endStripe < numStripes - 1);
+            //the next window is loaded in the background while the current one is processed
+            while (pWindow != nullptr)
+            {
+                ProcessWindow(pWindow, pResult, numThreadsToUse);
+            }
 
             std::cout << "first pass ended" << std::endl;
 
@@ -105,34 +115,21 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
             {
                 std::cout << "second pass started" << std::endl;
 
-                bool hasPrevStripe = startStripe > 0;
+                //get the first window of stripes (training points only), it starts from the highest stripe that pending points need to search
+                pWindow = pResult->GetWindow(numStripes - 1, true);
 
-                while (hasPrevStripe)
+                while (pWindow != nullptr)
                 {
-                    //get next window of stripes (training points only)
-                    auto pWindow = pResult->GetWindow(startStripe-1, true);
-
-                    if (pWindow != nullptr)
-                    {
-                        startStripe = pWindow->GetStartStripe();
-                        endStripe = pWindow->GetEndStripe();
-                        hasPrevStripe = startStripe > 0;
-                        std::cout << "got window " << startStripe << " " << endStripe << std::endl;
-                        //run the plane sweep algorithm for this window
-                        PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
-                        std::cout << "processed window" << std::endl;
-                    }
-                    else
-                        break;
+                    ProcessWindow(pWindow, pResult, numThreadsToUse);
                 }
 
                 std::cout << "second pass ended" << std::endl;
 
-                std::cout << "neighbors sort start" << std::endl;
+                std::cout << "neighbors flush start" << std::endl;
 
-                //sort the final result by input point id and neighbor position
-                pResult->SortNeighbors();
-                std::cout << "neighbors sort end" << std::endl;
+                //the neighbors are already in their final position, write the cached blocks of the result
+                pResult->FlushNeighbors();
+                std::cout << "neighbors flush end" << std::endl;
             }
 
             auto finish = std::chrono::high_resolution_clock::now();
@@ -151,6 +148,36 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
         int numThreads = 0;
         bool parallelSort = false;
         bool splitByT = false;
+        bool prefetchWindows = true;
+        bool haloWindows = false;
+
+        /** \brief Processes a window of stripes while the next window of the same phase is loaded in the background
+         *          On return pWindow holds the next window, or nullptr if there are no more windows in this phase
+         * \param pWindow unique_ptr<StripesWindow>& window of stripes
+         * \param pResult unique_ptr<AllKnnResultStripesParallelExternal>& result object that holds all pointers to data structures
+         * \param numThreadsToUse unsigned int number of threads to use
+         * \return void
+         *
+         */
+        void ProcessWindow(std::unique_ptr<StripesWindow>& pWindow, std::unique_ptr<AllKnnResultStripesParallelExternal>& pResult, unsigned int numThreadsToUse)
+        {
+            size_t startStripe = pWindow->GetStartStripe();
+            size_t endStripe = pWindow->GetEndStripe();
+            bool isSecondPass = pWindow->IsSecondPass();
+
+            pResult->PrefetchNextWindow(*pWindow);
+
+            ProfileSample computeStart = PhaseProfiler::Now();
+            //run the plane sweep algorithm for this window
+            PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
+            ProfileSample computeFinish = PhaseProfiler::Now();
+
+            pResult->RecordWindowTimes(*pWindow, computeStart, computeFinish);
+
+            //the processed window is released before the next one is loaded, in case it has not been prefetched
+            pWindow.reset();
+            pWindow = pResult->GetNextWindow(startStripe, endStripe, isSecondPass);
+        }
 
         /** \brief Runs the plane sweep algorithm in a window of stripes
          *
@@ -162,6 +189,8 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
          */
         void PlaneSweepWindow(std::unique_ptr<StripesWindow>& pWindow, std::unique_ptr<AllKnnResultStripesParallelExternal>& pResult, unsigned int numThreadsToUse)
         {
+            ProfileSample searchStart = PhaseProfiler::Now();
+
             //check if this is the second phase of the algorithm
             bool isSecondPass = pWindow->IsSecondPass();
             size_t windowStartStripe = pWindow->GetStartStripe();
@@ -172,20 +201,19 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
 
             //get pending points that are of interest to this window
             auto pPendingPointsContainer = pResult->GetPendingPointsForWindow(*pWindow);
-            auto pendingPointsIterBegin = pPendingPointsContainer->cbegin();
-            auto pendingPointsIterEnd = pPendingPointsContainer->cend();
+            auto pendingPointsIterBegin = pPendingPointsContainer->points.cbegin();
+            auto pendingPointsIterEnd = pPendingPointsContainer->points.cend();
 
-            //get container of neighbors
-            //in this case it is a hash table (a mapping between input point id and heap of neighbors)
-            auto& pendingNeighborsContainer = pResult->GetPendingNeighborsContainer();
+            //get container of neighbors, the neighbors of each pending point are stored at the same position as the point
+            auto& pendingNeighborsContainer = pPendingPointsContainer->neighbors;
 
             //parallel loop through all pending points, each chunk of work contains 10 pending points
             #pragma omp parallel for schedule(dynamic, 10)
             for (auto inputPointIter = pendingPointsIterBegin; inputPointIter < pendingPointsIterEnd; ++inputPointIter)
             {
                 bool exit = false;
-                //get the neighbors by using the map
-                auto& neighbors = pendingNeighborsContainer.at(inputPointIter->id);
+                //get the neighbors of the pending point
+                auto& neighbors = pendingNeighborsContainer[std::distance(pendingPointsIterBegin, inputPointIter)];
                 size_t lowStripe = neighbors.getLowStripe();
                 size_t highStripe = neighbors.getHighStripe();
                 size_t currentStripe = isSecondPass ? lowStripe - 1 : highStripe + 1;
@@ -242,6 +270,8 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
                 #pragma omp parallel for schedule(dynamic) if (numWindowStripes >= numThreadsToUse)
                 for (size_t iStripeInput = windowStartStripe; iStripeInput <= windowEndStripe; ++iStripeInput)
                 {
+                    ProfileSample stripeStart = PhaseProfiler::Now();
+
                     auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput - windowStartStripe];
                     auto inputDatasetBegin = inputDataset.cbegin();
                     auto inputDatasetEnd = inputDataset.cend();
@@ -295,6 +325,7 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
                                 }
                                 else
                                 {
+                                    COUNT_SEARCH(dyTerminations, 1);
                                     lowStripeEnd = true;
                                     neighbors.setLowStripe(0);
                                 }
@@ -316,21 +347,25 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
                                 }
                                 else
                                 {
+                                    COUNT_SEARCH(dyTerminations, 1);
                                     highStripeEnd = true;
                                     neighbors.setHighStripe(numStripes - 1);
                                 }
                             }
                         }
                     }
+
+                    //a stripe is a task of a thread only if the outer loop runs in parallel, otherwise all threads share it
+                    if (numWindowStripes >= numThreadsToUse)
+                        PhaseProfiler::Record(ProfilePhase::StripeTask, stripeStart, PhaseProfiler::Now(), long(iStripeInput));
                 }
             }
 
-            std::cout << "commit window started" << std::endl;
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
 
             //commit the window: check for any completed points and transfer their neighbors to external memory vectors
             //and update the list of pending points
             pResult->CommitWindow(*pWindow, *pPendingPointsContainer);
-            std::cout << "commit window ended" << std::endl;
         }
 
         /** \brief Searches for neighbors of an input point in a specific stripe
@@ -346,6 +381,7 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
         void PlaneSweepStripe(point_vector_iterator_t inputPointIter, StripeData stripeData, size_t iStripeTraining,
                               PointNeighbors<neighbors_priority_queue_t>& neighbors, double mindy) const
         {
+            COUNT_SEARCH(stripesVisited, 1);
             auto& trainingDataset = stripeData.TrainingDatasetStripe[iStripeTraining];
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
@@ -355,7 +391,7 @@ class PlaneSweepStripesParallelExternalAlgorithm : public AbstractAllKnnAlgorith
                 return;
 
             auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                        [](const Point& point, const double& value) { return point.x < value; } );
+                        [](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
             auto prevTrainingPointIter = nextTrainingPointIter;
             if (prevTrainingPointIter > trainingDatasetBegin)
@@ -14,8 +14,9 @@
 class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgorithm
 {
     public:
-        PlaneSweepStripesParallelExternalTBBAlgorithm(size_t numStripes, int numThreads, bool parallelSort, bool splitByT) : numStripes(numStripes),
-            numThreads(numThreads), parallelSort(parallelSort), splitByT(splitByT)
+        PlaneSweepStripesParallelExternalTBBAlgorithm(size_t numStripes, int numThreads, bool parallelSort, bool splitByT, bool prefetchWindows, bool haloWindows)
+            : numStripes(numStripes), numThreads(numThreads), parallelSort(parallelSort), splitByT(splitByT), prefetchWindows(prefetchWindows),
+              haloWindows(haloWindows)
         {
         }
 
@@ -26,8 +27,21 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
             return true;
         }
 
+        bool SupportsResultSink() const override
+        {
+            return true;
+        }
+
         std::string GetTitle() const
         {
+            if (haloWindows)
+            {
+                if (splitByT)
+                    return parallelSort ? "Plane sweep stripes parallel external TBB (parallel sorting, split by training, halo windows)" : "Plane sweep stripes parallel external TBB (split by training, halo windows)";
+                else
+                    return parallelSort ? "Plane sweep stripes parallel external TBB (parallel sorting, halo windows)" : "Plane sweep stripes parallel external TBB (halo windows)";
+            }
+
             if (splitByT)
                 return parallelSort ? "Plane sweep stripes parallel external TBB (parallel sorting, split by training)" : "Plane sweep stripes parallel external TBB (split by training)";
             else
@@ -36,6 +50,14 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
 
         std::string GetPrefix() const
         {
+            if (haloWindows)
+            {
+                if (splitByT)
+                    return parallelSort ? "planesweep_stripes_parallel_external_TBB_psort_splitByT_halo" : "planesweep_stripes_parallel_external_TBB_splitByT_halo";
+                else
+                    return parallelSort ? "planesweep_stripes_parallel_external_TBB_psort_halo" : "planesweep_stripes_parallel_external_TBB_halo";
+            }
+
             if (splitByT)
                 return parallelSort ? "planesweep_stripes_parallel_external_TBB_psort_splitByT" : "planesweep_stripes_parallel_external_TBB_splitByT";
             else
@@ -57,36 +79,23 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
 
             auto pResult = std::unique_ptr<AllKnnResultStripesParallelExternal>(
                                 new AllKnnResultStripesParallelExternal(static_cast<AllKnnProblemExternal&>(problem),
-                                                GetPrefix(), parallelSort, splitByT));
+                                                GetPrefix(), parallelSort, splitByT, prefetchWindows, haloWindows));
+
+            pResult->SetResultSink(pResultSink);
 
             std::cout << "split stripes start" << std::endl;
             numStripes = pResult->SplitStripes(numStripes);
             std::cout << "split stripes end" << std::endl;
             auto finishSorting = std::chrono::high_resolution_clock::now();
 
-            size_t startStripe = 0;
-            size_t endStripe = 0;
-            size_t nextStripe = 0;
-
             std::cout << "first pass started" << std::endl;
 
-            do
-            {
-                auto pWindow = pResult->GetWindow(nextStripe, false);
-
-                if (pWindow != nullptr)
-                {
-                    startStripe = pWindow->GetStartStripe();
-                    endStripe = pWindow->GetEndStripe();
-                    nextStripe = endStripe + 1;
-                    std::cout << "got window " << startStripe << " " << endStripe << std::endl;
-                    PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
-                    std::cout << "processed window" << std::endl;
-                }
-                else
-                    break;
+            auto pWindow = pResult->GetWindow(0, false);
 
-            } while (endStripe < numStripes - 1);
+            while (pWindow != nullptr)
+            {
+                ProcessWindow(pWindow, pResult, numThreadsToUse);
+            }
 
             std::cout << "first pass ended" << std::endl;
 
@@ -94,30 +103,18 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
             {
                 std::cout << "second pass started" << std::endl;
 
-                bool hasPrevStripe = startStripe > 0;
+                pWindow = pResult->GetWindow(numStripes - 1, true);
 
-                while (hasPrevStripe)
+                while (pWindow != nullptr)
                 {
-                    auto pWindow = pResult->GetWindow(startStripe-1, true);
-
-                    if (pWindow != nullptr)
-                    {
-                        startStripe = pWindow->GetStartStripe();
-                        endStripe = pWindow->GetEndStripe();
-                        hasPrevStripe = startStripe > 0;
-                        std::cout << "got window " << startStripe << " " << endStripe << std::endl;
-                        PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
-                        std::cout << "processed window" << std::endl;
-                    }
-                    else
-                        break;
+                    ProcessWindow(pWindow, pResult, numThreadsToUse);
                 }
 
                 std::cout << "second pass ended" << std::endl;
 
-                std::cout << "neighbors sort start" << std::endl;
-                pResult->SortNeighbors();
-                std::cout << "neighbors sort end" << std::endl;
+                std::cout << "neighbors flush start" << std::endl;
+                pResult->FlushNeighbors();
+                std::cout << "neighbors flush end" << std::endl;
             }
 
             auto finish = std::chrono::high_resolution_clock::now();
@@ -136,9 +133,31 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
         int numThreads = 0;
         bool parallelSort = false;
         bool splitByT = false;
+        bool prefetchWindows = true;
+        bool haloWindows = false;
+
+        void ProcessWindow(std::unique_ptr<StripesWindow>& pWindow, std::unique_ptr<AllKnnResultStripesParallelExternal>& pResult, unsigned int numThreadsToUse)
+        {
+            size_t startStripe = pWindow->GetStartStripe();
+            size_t endStripe = pWindow->GetEndStripe();
+            bool isSecondPass = pWindow->IsSecondPass();
+
+            pResult->PrefetchNextWindow(*pWindow);
+
+            ProfileSample computeStart = PhaseProfiler::Now();
+            PlaneSweepWindow(pWindow, pResult, numThreadsToUse);
+            ProfileSample computeFinish = PhaseProfiler::Now();
+
+            pResult->RecordWindowTimes(*pWindow, computeStart, computeFinish);
+
+            pWindow.reset();
+            pWindow = pResult->GetNextWindow(startStripe, endStripe, isSecondPass);
+        }
 
         void PlaneSweepWindow(std::unique_ptr<StripesWindow>& pWindow, std::unique_ptr<AllKnnResultStripesParallelExternal>& pResult, unsigned int numThreadsToUse)
         {
+            ProfileSample searchStart = PhaseProfiler::Now();
+
             bool isSecondPass = pWindow->IsSecondPass();
             size_t windowStartStripe = pWindow->GetStartStripe();
             size_t windowEndStripe = pWindow->GetEndStripe();
@@ -146,10 +165,10 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
             auto stripeData = pWindow->GetStripeData();
 
             auto pPendingPointsContainer = pResult->GetPendingPointsForWindow(*pWindow);
-            auto pendingPointsIterBegin = pPendingPointsContainer->cbegin();
-            auto pendingPointsIterEnd = pPendingPointsContainer->cend();
+            auto pendingPointsIterBegin = pPendingPointsContainer->points.cbegin();
+            auto pendingPointsIterEnd = pPendingPointsContainer->points.cend();
 
-            auto& pendingNeighborsContainer = pResult->GetPendingNeighborsContainer();
+            auto& pendingNeighborsContainer = pPendingPointsContainer->neighbors;
 
             typedef tbb::blocked_range<point_vector_t::const_iterator> point_range_t;
 
@@ -161,7 +180,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                     for (auto inputPointIter = rangeBegin; inputPointIter < rangeEnd; ++inputPointIter)
                     {
                         bool exit = false;
-                        auto& neighbors = pendingNeighborsContainer.at(inputPointIter->id);
+                        auto& neighbors = pendingNeighborsContainer[std::distance(pendingPointsIterBegin, inputPointIter)];
                         size_t lowStripe = neighbors.getLowStripe();
                         size_t highStripe = neighbors.getHighStripe();
                         size_t currentStripe = isSecondPass ? lowStripe - 1 : highStripe + 1;
@@ -216,6 +235,8 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
 
                             for (size_t iStripeInput = rangeBegin; iStripeInput < rangeEnd; ++iStripeInput)
                             {
+                                ProfileScope profileScope(ProfilePhase::StripeTask, long(iStripeInput));
+
                                 auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput - windowStartStripe];
                                 auto inputDatasetBegin = inputDataset.cbegin();
                                 auto inputDatasetEnd = inputDataset.cend();
@@ -263,6 +284,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                                             }
                                             else
                                             {
+                                                COUNT_SEARCH(dyTerminations, 1);
                                                 lowStripeEnd = true;
                                                 neighbors.setLowStripe(0);
                                             }
@@ -284,6 +306,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                                             }
                                             else
                                             {
+                                                COUNT_SEARCH(dyTerminations, 1);
                                                 highStripeEnd = true;
                                                 neighbors.setHighStripe(numStripes - 1);
                                             }
@@ -350,6 +373,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                                             }
                                             else
                                             {
+                                                COUNT_SEARCH(dyTerminations, 1);
                                                 lowStripeEnd = true;
                                                 neighbors.setLowStripe(0);
                                             }
@@ -371,6 +395,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                                             }
                                             else
                                             {
+                                                COUNT_SEARCH(dyTerminations, 1);
                                                 highStripeEnd = true;
                                                 neighbors.setHighStripe(numStripes - 1);
                                             }
@@ -383,14 +408,15 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                 }
             }
 
-            std::cout << "commit window started" << std::endl;
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             pResult->CommitWindow(*pWindow, *pPendingPointsContainer);
-            std::cout << "commit window ended" << std::endl;
         }
 
         void PlaneSweepStripe(point_vector_iterator_t inputPointIter, StripeData stripeData, size_t iStripeTraining,
                               PointNeighbors<neighbors_priority_queue_t>& neighbors, double mindy) const
         {
+            COUNT_SEARCH(stripesVisited, 1);
             auto& trainingDataset = stripeData.TrainingDatasetStripe[iStripeTraining];
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
@@ -400,7 +426,7 @@ class PlaneSweepStripesParallelExternalTBBAlgorithm : public AbstractAllKnnAlgor
                 return;
 
             auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                        [](const Point& point, const double& value) { return point.x < value; } );
+                        [](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
             auto prevTrainingPointIter = nextTrainingPointIter;
             if (prevTrainingPointIter > trainingDatasetBegin)
@@ -36,6 +36,11 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
             return ss.str();
         }
 
+        bool SupportsResultSink() const override
+        {
+            return true;
+        }
+
         std::unique_ptr<AllKnnResult> Process(AllKnnProblem& problem) override
         {
             size_t numNeighbors = problem.GetNumNeighbors();
@@ -68,6 +73,7 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
             numStripes = stripeData.InputDatasetStripe.size();
 
             auto finishSorting = std::chrono::high_resolution_clock::now();
+            ProfileSample searchStart = PhaseProfiler::Now();
 
             parallel_for(tbb::blocked_range<int>(0, numStripes), [&](tbb::blocked_range<int>& range)
                 {
@@ -76,6 +82,8 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
 
                     for (int iStripeInput = rangeBegin; iStripeInput < rangeEnd; ++iStripeInput)
                     {
+                        ProfileScope profileScope(ProfilePhase::StripeTask, iStripeInput);
+
                         auto& inputDataset = stripeData.InputDatasetStripe[iStripeInput];
                         auto inputDatasetBegin = inputDataset.cbegin();
                         auto inputDatasetEnd = inputDataset.cend();
@@ -106,6 +114,7 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
                                     }
                                     else
                                     {
+                                        COUNT_SEARCH(dyTerminations, 1);
                                         lowStripeEnd = true;
                                     }
                                 }
@@ -122,14 +131,20 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
                                     }
                                     else
                                     {
+                                        COUNT_SEARCH(dyTerminations, 1);
                                         highStripeEnd = true;
                                     }
                                 }
                             }
+
+                            if (pResultSink != nullptr)
+                                ConsumeNeighbors(inputPointIter->id, neighbors);
                         }
                     }
                 });
 
+            PhaseProfiler::Record(ProfilePhase::Search, searchStart, PhaseProfiler::Now());
+
             auto finish = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> elapsed = finish - start;
             std::chrono::duration<double> elapsedSorting = finishSorting - start;
@@ -151,6 +166,7 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
         void PlaneSweepStripe(point_vector_iterator_t inputPointIter, StripeData stripeData, int iStripeTraining,
                               PointNeighbors<neighbors_priority_queue_t>& neighbors, double mindy) const
         {
+            COUNT_SEARCH(stripesVisited, 1);
             auto& trainingDataset = stripeData.TrainingDatasetStripe[iStripeTraining];
 
             auto trainingDatasetBegin = trainingDataset.cbegin();
@@ -160,7 +176,7 @@ class PlaneSweepStripesParallelTBBAlgorithm : public AbstractAllKnnAlgorithm
                 return;
 
             auto nextTrainingPointIter = lower_bound(trainingDatasetBegin, trainingDatasetEnd, inputPointIter->x,
-                        [](const Point& point, const double& value) { return point.x < value; } );
+                        [](const Point& point, const double& value) { COUNT_SEARCH(binarySearchSteps, 1); return point.x < value; } );
 
             auto prevTrainingPointIter = nextTrainingPointIter;
             if (prevTrainingPointIter > trainingDatasetBegin)
@@ -1,11 +1,15 @@
 /* Class definition for the container of neighbors
     Each instance of this class contains the nearest neighbors of an input point
     The neighbors are stored in a max heap (priority queue)
+    The heap starts empty and accepts the first k neighbors without checking distances. Until it holds k neighbors,
+    the missing ones are considered to be at infinite distance, and they are enumerated as neighbors with id 0 (NULL)
  */
 #ifndef POINTNEIGHBORS_H
 #define POINTNEIGHBORS_H
 
 #include <memory.h>
+#include <limits>
+#include <algorithm>
 #include <unordered_map>
 #include "PlaneSweepParallel.h"
 #include <tbb/tbb.h>
@@ -39,7 +43,7 @@ class PointNeighbors : public NeighborsEnumerator
     private:
         Container container;
         size_t numNeighbors;
-        unsigned long id;
+        point_id_t id;
 };
 
 /** \brief Template specialization for priority queue as holder of neighbors (priority queue is implemented as max heap)
@@ -48,12 +52,12 @@ template<>
 class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
 {
     public:
-        PointNeighbors(size_t numNeighbors) : PointNeighbors(neighbors_vector_t(numNeighbors, {0, std::numeric_limits<double>::max()}))
-        {
-        }
-
-        PointNeighbors(neighbors_vector_t neighborsVector) : numNeighbors(neighborsVector.size()),
-            container(neighborsVector.cbegin(), neighborsVector.cend())
+        /** \brief Constructor, memory for the heap is allocated when the first neighbor is added
+         *
+         * \param numNeighbors size_t the number of nearest neighbors (k)
+         *
+         */
+        PointNeighbors(size_t numNeighbors) : numNeighbors(numNeighbors)
         {
         }
 
@@ -67,6 +71,8 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
             numNeighbors = pointNeighbors.numNeighbors;
             std::swap(container, pointNeighbors.container);
             numAdditions = pointNeighbors.numAdditions;
+            numRemoved = pointNeighbors.numRemoved;
+            numEmptyRemoved = pointNeighbors.numEmptyRemoved;
             lowStripe = pointNeighbors.lowStripe;
             highStripe = pointNeighbors.highStripe;
         }
@@ -84,6 +90,8 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
                 numNeighbors = pointNeighbors.numNeighbors;
                 std::swap(container, pointNeighbors.container);
                 numAdditions = pointNeighbors.numAdditions;
+                numRemoved = pointNeighbors.numRemoved;
+                numEmptyRemoved = pointNeighbors.numEmptyRemoved;
                 lowStripe = pointNeighbors.lowStripe;
                 highStripe = pointNeighbors.highStripe;
             }
@@ -100,18 +108,26 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
          */
         bool HasNext() override
         {
-            return !container.empty();
+            return numEmptyRemoved < GetNumEmpty() || !container.empty();
         }
 
         /** \brief Pops the next neighbor from the heap
-         *
+         *          If less than k neighbors have been found, the missing ones are returned first as empty neighbors,
+         *          so the order is the same as if the heap had been filled with neighbors at infinite distance
          * \return Neighbor
          *
          */
         Neighbor Next() override
         {
+            if (numEmptyRemoved < GetNumEmpty())
+            {
+                ++numEmptyRemoved;
+                return emptyNeighbor;
+            }
+
             Neighbor neighbor = container.top();
             container.pop();
+            ++numRemoved;
             return neighbor;
         }
 
@@ -124,6 +140,13 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
          */
         inline void Add(point_vector_iterator_t pointIter, const double distanceSquared)
         {
+            if (container.size() < numNeighbors)
+            {
+                Push({pointIter->id, distanceSquared});
+                ++numAdditions;
+                return;
+            }
+
             auto& lastNeighbor = container.top();
 
             if (distanceSquared < lastNeighbor.distanceSquared)
@@ -146,10 +169,37 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
         {
             for (int i = neighbors.size() - 1; i >= 0; --i)
             {
-                container.push(neighbors[i]);
+                //empty neighbors are not stored in the heap
+                if (neighbors[i].pointId == 0)
+                {
+                    --numEmptyRemoved;
+                }
+                else
+                {
+                    container.push(neighbors[i]);
+                    --numRemoved;
+                }
             }
         }
 
+        /** \brief Rebuilds an empty heap from the neighbors it returned by Next(), used for heaps that have been written to external memory
+         *
+         * \param neighbors const vector<Neighbor>& the neighbors, empty neighbors are skipped
+         * \param additions size_t the number of heap additions before the heap was written
+         * \return void
+         *
+         */
+        void Restore(const std::vector<Neighbor>& neighbors, size_t additions)
+        {
+            for (auto& neighbor : neighbors)
+            {
+                if (neighbor.pointId != 0)
+                    Push(neighbor);
+            }
+
+            numAdditions = additions;
+        }
+
         size_t GetNumAdditions()
         {
             return numAdditions;
@@ -165,6 +215,13 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
          */
         inline bool CheckAdd(point_vector_iterator_t pointIter, const double& distanceSquared, const double& dx)
         {
+            if (container.size() < numNeighbors)
+            {
+                Push({pointIter->id, distanceSquared});
+                ++numAdditions;
+                return true;
+            }
+
             auto& lastNeighbor = container.top();
             double maxDistance = lastNeighbor.distanceSquared;
 
@@ -194,6 +251,13 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
          */
         inline bool CheckAdd(point_vector_iterator_t pointIter, const double& distanceSquared, const double& dx, const double& mindy)
         {
+            if (container.size() < numNeighbors)
+            {
+                Push({pointIter->id, distanceSquared});
+                ++numAdditions;
+                return true;
+            }
+
             auto& lastNeighbor = container.top();
             double maxDistance = lastNeighbor.distanceSquared;
 
@@ -221,22 +285,96 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
          */
         inline void AddNoCheck(point_vector_iterator_t pointIter, const double& distanceSquared)
         {
-            container.pop();
-            Neighbor newNeighbor = {pointIter->id, distanceSquared};
-            container.push(newNeighbor);
+            if (container.size() < numNeighbors)
+            {
+                Push({pointIter->id, distanceSquared});
+            }
+            else
+            {
+                container.pop();
+                Neighbor newNeighbor = {pointIter->id, distanceSquared};
+                container.push(newNeighbor);
+            }
             ++numAdditions;
         }
 
-        /** \brief Returns top of the max heap
+        /** \brief Returns top of the max heap, or an empty neighbor at infinite distance if less than k neighbors have been found
          *
          * \return const Neighbor&
          *
          */
         inline const Neighbor& MaxDistanceElement() const
         {
+            if (container.size() < numNeighbors)
+                return emptyNeighbor;
+
             return container.top();
         }
 
+        /** \brief Returns the number of nearest neighbors (k)
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumNeighbors() const
+        {
+            return numNeighbors;
+        }
+
+        /** \brief Copies the neighbors sorted by ascending distance without changing the heap
+         *          Missing neighbors are copied last as empty neighbors, the heap must not have removed neighbors
+         * \param neighbors Neighbor* array of k neighbors to fill
+         * \return void
+         *
+         */
+        void CopySortedNeighbors(Neighbor* neighbors) const
+        {
+            const neighbors_vector_t& heap = GetHeapVector(container);
+            std::copy(heap.cbegin(), heap.cend(), neighbors);
+            std::sort_heap(neighbors, neighbors + heap.size(), NeighborComparer());
+            std::fill(neighbors + heap.size(), neighbors + numNeighbors, emptyNeighbor);
+        }
+
+        /** \brief Sorts the heap in place by descending distance, which is the order of Next(), so the neighbors can be read without changing the heap
+         *          A vector sorted by descending distance is still a valid max heap. The heap must not have removed neighbors
+         * \return void
+         *
+         */
+        void Finalize()
+        {
+            neighbors_vector_t& heap = GetHeapVector(container);
+            std::sort_heap(heap.begin(), heap.end(), NeighborComparer());
+            std::reverse(heap.begin(), heap.end());
+        }
+
+        /** \brief Returns a neighbor of a finalized heap in the order of Next(), missing neighbors are returned first as empty neighbors
+         *
+         * \param index size_t the position of the neighbor, from 0 to k-1
+         * \return const Neighbor&
+         *
+         */
+        inline const Neighbor& FinalizedNeighbor(size_t index) const
+        {
+            size_t numEmpty = numNeighbors - container.size();
+
+            if (index < numEmpty)
+                return emptyNeighbor;
+
+            return GetHeapVector(container)[index - numEmpty];
+        }
+
+        /** \brief Frees the memory of the heap after the neighbors have been passed to a result sink
+         *          The number of heap additions is kept for the statistics, no neighbors are returned by Next() afterwards
+         * \return void
+         *
+         */
+        void Release()
+        {
+            container = neighbors_priority_queue_t();
+            numRemoved = numNeighbors;
+            numEmptyRemoved = 0;
+        }
+
         /** \brief Sets the lowest stripe searched so far (used by the external memory algorithm)
          *
          * \param stripe size_t
@@ -270,21 +408,78 @@ class PointNeighbors<neighbors_priority_queue_t> : public NeighborsEnumerator
         }
 
     private:
+        static constexpr Neighbor emptyNeighbor = {0, std::numeric_limits<double>::max()};
+
         size_t numNeighbors = 0;
         neighbors_priority_queue_t container;
         size_t numAdditions = 0;
+        size_t numRemoved = 0; /**< number of neighbors removed by Next() and not put back */
+        size_t numEmptyRemoved = 0; /**< number of empty neighbors returned by Next() and not put back */
         size_t lowStripe = std::numeric_limits<size_t>::max();
         size_t highStripe = 0;
+
+        /** \brief Returns the number of empty neighbors, which is k minus the number of neighbors found
+         *
+         * \return size_t
+         *
+         */
+        inline size_t GetNumEmpty() const
+        {
+            return numNeighbors - container.size() - numRemoved;
+        }
+
+        /** \brief Returns the vector that holds the heap of a priority queue (protected member c of std::priority_queue)
+         *
+         * \param queue const neighbors_priority_queue_t&
+         * \return const neighbors_vector_t&
+         *
+         */
+        static const neighbors_vector_t& GetHeapVector(const neighbors_priority_queue_t& queue)
+        {
+            struct HeapAccess : public neighbors_priority_queue_t
+            {
+                static const neighbors_vector_t& Get(const neighbors_priority_queue_t& queue)
+                {
+                    return queue.*&HeapAccess::c;
+                }
+            };
+
+            return HeapAccess::Get(queue);
+        }
+
+        static neighbors_vector_t& GetHeapVector(neighbors_priority_queue_t& queue)
+        {
+            return const_cast<neighbors_vector_t&>(GetHeapVector(static_cast<const neighbors_priority_queue_t&>(queue)));
+        }
+
+        /** \brief Pushes a neighbor to a heap that holds less than k neighbors
+         *          Memory for k neighbors is reserved when the first neighbor is pushed
+         * \param neighbor const Neighbor&
+         * \return void
+         *
+         */
+        inline void Push(const Neighbor& neighbor)
+        {
+            if (container.empty())
+            {
+                neighbors_vector_t neighborsVector;
+                neighborsVector.reserve(numNeighbors);
+                container = neighbors_priority_queue_t(NeighborComparer(), std::move(neighborsVector));
+            }
+
+            container.push(neighbor);
+        }
 };
 
 //type definitions for neighbor containers
 template<class Container>
-using pointNeighbors_generic_map_t = std::unordered_map<unsigned long, PointNeighbors<Container>>;
+using pointNeighbors_generic_map_t = std::unordered_map<point_id_t, PointNeighbors<Container>>;
 
 template<class Container>
 using pointNeighbors_generic_vector_t = std::vector<PointNeighbors<Container>, tbb::cache_aligned_allocator<PointNeighbors<Container>>>;
 
 typedef pointNeighbors_generic_map_t<neighbors_priority_queue_t> pointNeighbors_priority_queue_map_t;
 typedef pointNeighbors_generic_vector_t<neighbors_priority_queue_t> pointNeighbors_priority_queue_vector_t;
-typedef std::vector<std::vector<PointNeighbors<neighbors_priority_queue_t>>> pointNeighbors_vector_vector_t;
+typedef std::vector<PointNeighbors<neighbors_priority_queue_t>, TrackingAllocator<PointNeighbors<neighbors_priority_queue_t>>> pointNeighbors_vector_t;
+typedef std::vector<pointNeighbors_vector_t> pointNeighbors_vector_vector_t;
 #endif // POINTNEIGHBORS_H
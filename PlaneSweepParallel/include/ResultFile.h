@@ -0,0 +1,201 @@
+/* Definitions of the binary file format of AkNN results
+    The file starts with a header, followed by the k neighbors of each input point in the order of the input point ids (1, 2, ...).
+    The neighbors of a point are sorted by ascending distance. Missing neighbors have id 0 and infinite distance, so they are stored last.
+    Each neighbor is stored as its id (4 or 8 bytes, the size of point ids of the build that wrote the file) followed by the squared distance,
+    without padding. The header depends only on standard headers, so it is shared with the ResultConverter tool.
+ */
+#ifndef RESULTFILE_H
+#define RESULTFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <fstream>
+#include "ApplicationException.h"
+
+/** \brief Header at the beginning of a binary result file
+ */
+struct ResultFileHeader
+{
+    char magic[8];          /**< RESULT_FILE_MAGIC */
+    uint32_t version;       /**< RESULT_FILE_VERSION */
+    uint32_t idBytes;       /**< size of point ids, 4 or 8 bytes */
+    uint64_t numPoints;     /**< number of input points */
+    uint64_t numNeighbors;  /**< number of neighbors of each input point (k) */
+};
+
+const char RESULT_FILE_MAGIC[8] = "AKNNRES";
+const uint32_t RESULT_FILE_VERSION = 1;
+
+/** \brief Stores a neighbor at a position of a buffer
+ *
+ * \param pRecord char* position of the neighbor in the buffer
+ * \param idBytes size_t size of point ids, 4 or 8 bytes
+ * \param id uint64_t id of the neighbor
+ * \param distanceSquared double squared distance of the neighbor
+ * \return void
+ *
+ */
+inline void EncodeResultNeighbor(char* pRecord, size_t idBytes, uint64_t id, double distanceSquared)
+{
+    if (idBytes == sizeof(uint32_t))
+    {
+        uint32_t id32 = uint32_t(id);
+        memcpy(pRecord, &id32, sizeof(uint32_t));
+    }
+    else
+    {
+        memcpy(pRecord, &id, sizeof(uint64_t));
+    }
+
+    memcpy(pRecord + idBytes, &distanceSquared, sizeof(double));
+}
+
+/** \brief Reads a neighbor from a position of a buffer
+ *
+ * \param pRecord const char* position of the neighbor in the buffer
+ * \param idBytes size_t size of point ids, 4 or 8 bytes
+ * \param id uint64_t& id of the neighbor
+ * \param distanceSquared double& squared distance of the neighbor
+ * \return void
+ *
+ */
+inline void DecodeResultNeighbor(const char* pRecord, size_t idBytes, uint64_t& id, double& distanceSquared)
+{
+    if (idBytes == sizeof(uint32_t))
+    {
+        uint32_t id32 = 0;
+        memcpy(&id32, pRecord, sizeof(uint32_t));
+        id = id32;
+    }
+    else
+    {
+        memcpy(&id, pRecord, sizeof(uint64_t));
+    }
+
+    memcpy(&distanceSquared, pRecord + idBytes, sizeof(double));
+}
+
+/** \brief Reads and checks the header of a binary result file
+ *
+ * \param inFile std::istream& the file
+ * \param header ResultFileHeader& the header read
+ * \return bool false if the file is not a binary result file of a supported version
+ *
+ */
+inline bool ReadResultFileHeader(std::istream& inFile, ResultFileHeader& header)
+{
+    inFile.read(reinterpret_cast<char*>(&header), std::streamsize(sizeof(ResultFileHeader)));
+
+    return inFile.good() && memcmp(header.magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC)) == 0
+           && header.version == RESULT_FILE_VERSION && (header.idBytes == sizeof(uint32_t) || header.idBytes == sizeof(uint64_t));
+}
+
+/** \brief Writes the header of a binary result file
+ *
+ * \param outFile std::ostream& the file
+ * \param idBytes size_t size of point ids, 4 or 8 bytes
+ * \param numPoints size_t number of input points
+ * \param numNeighbors size_t number of neighbors of each input point (k)
+ * \return void
+ *
+ */
+inline void WriteResultFileHeader(std::ostream& outFile, size_t idBytes, size_t numPoints, size_t numNeighbors)
+{
+    ResultFileHeader header = {{0}, RESULT_FILE_VERSION, uint32_t(idBytes), numPoints, numNeighbors};
+    memcpy(header.magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC));
+    outFile.write(reinterpret_cast<const char*>(&header), std::streamsize(sizeof(ResultFileHeader)));
+}
+
+/** \brief Writer of binary result files
+ *          The neighbors are encoded by the caller into buffers of consecutive points. Each buffer is written in the background
+ *          while the caller encodes the next one
+ */
+class ResultFileWriter
+{
+    public:
+        /** \brief Constructor, creates the file and writes the header
+         *
+         * \param filename const std::string& the filename
+         * \param idBytes size_t size of point ids, 4 or 8 bytes
+         * \param numPoints size_t number of input points
+         * \param numNeighbors size_t number of neighbors of each input point (k)
+         *
+         */
+        ResultFileWriter(const std::string& filename, size_t idBytes, size_t numPoints, size_t numNeighbors)
+            : outFile(filename, std::ios::out | std::ios::binary), idBytes(idBytes)
+        {
+            if (!outFile.is_open())
+                throw ApplicationException("Cannot create result file " + filename);
+
+            WriteResultFileHeader(outFile, idBytes, numPoints, numNeighbors);
+        }
+
+        virtual ~ResultFileWriter()
+        {
+            if (futureWrite.valid())
+                futureWrite.wait();
+        }
+
+        /** \brief Returns the size of the id of a neighbor
+         *
+         * \return size_t
+         *
+         */
+        size_t GetIdBytes() const
+        {
+            return idBytes;
+        }
+
+        /** \brief Returns the size of a neighbor in the file
+         *
+         * \return size_t
+         *
+         */
+        size_t GetRecordSize() const
+        {
+            return idBytes + sizeof(double);
+        }
+
+        /** \brief Writes a buffer of encoded neighbors in the background, after the previous buffer has been written
+         *
+         * \param pBuffer std::unique_ptr<std::vector<char>>&& the buffer
+         * \return void
+         *
+         */
+        void Write(std::unique_ptr<std::vector<char>>&& pBuffer)
+        {
+            if (futureWrite.valid())
+                futureWrite.get();
+
+            pWriteBuffer = std::move(pBuffer);
+            futureWrite = std::async(std::launch::async, [this]()
+                {
+                    outFile.write(pWriteBuffer->data(), std::streamsize(pWriteBuffer->size()));
+                });
+        }
+
+        /** \brief Waits for the last buffer and closes the file
+         *
+         * \return void
+         *
+         */
+        void Close()
+        {
+            if (futureWrite.valid())
+                futureWrite.get();
+
+            outFile.close();
+        }
+
+    private:
+        std::ofstream outFile;
+        size_t idBytes = sizeof(uint64_t);
+        std::unique_ptr<std::vector<char>> pWriteBuffer;
+        std::future<void> futureWrite;
+};
+
+#endif // RESULTFILE_H
@@ -0,0 +1,196 @@
+/* Definitions of result sinks
+    A result sink receives the neighbors of each input point as soon as the search of the point has been completed,
+    so an algorithm that streams its result does not need to keep the neighbors of all input points until it finishes.
+    The owner of the sink calls Begin before the algorithm runs and End after it returns.
+ */
+#ifndef RESULTSINK_H
+#define RESULTSINK_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <fstream>
+#include "PlaneSweepParallel.h"
+#include "ResultFile.h"
+#include "ApplicationException.h"
+
+/** \brief Interface for the consumers of the neighbors of completed input points
+ */
+class ResultSink
+{
+    public:
+        virtual ~ResultSink() {}
+
+        /** \brief Prepares the sink for a new result
+         *
+         * \param numPoints size_t number of input points
+         * \param numNeighbors size_t number of neighbors of each input point (k)
+         * \return void
+         *
+         */
+        virtual void Begin(size_t numPoints, size_t numNeighbors) {}
+
+        /** \brief Receives the neighbors of an input point, it is called concurrently by the threads of the algorithm
+         *
+         * \param pointId point_id_t the id of the input point
+         * \param neighbors const Neighbor* the k neighbors sorted by ascending distance, missing neighbors have id 0 and are last
+         * \param numNeighbors size_t the number of neighbors (k)
+         * \return void
+         *
+         */
+        virtual void Consume(point_id_t pointId, const Neighbor* neighbors, size_t numNeighbors) = 0;
+
+        /** \brief Completes the result, after all input points have been consumed
+         *
+         * \return void
+         *
+         */
+        virtual void End() {}
+};
+
+/** \brief Points and encoded neighbors collected by a result sink
+ */
+struct ResultBatch
+{
+    std::vector<point_id_t> ids;
+    std::vector<char> buffer;   /**< the encoded neighbors of ids[i] follow the neighbors of the previous points */
+};
+
+/** \brief Sink that writes the neighbors to a binary result file
+ *          The input points are completed in arbitrary order, so they are collected in batches of fixed size.
+ *          Each batch is sorted by point id and written to the positions of its points, points with consecutive ids are written at once.
+ *          A full batch is taken out of the sink and written by the thread that filled it, while the other threads fill the next batch.
+ */
+class FileResultSink : public ResultSink
+{
+    public:
+        FileResultSink(const std::string& filename) : filename(filename)
+        {
+        }
+
+        virtual ~FileResultSink() {}
+
+        void Begin(size_t numPoints, size_t numNeighbors) override
+        {
+            outFile.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!outFile.is_open())
+                throw ApplicationException("Cannot create result file " + filename);
+
+            WriteResultFileHeader(outFile, sizeof(point_id_t), numPoints, numNeighbors);
+
+            this->numNeighbors = numNeighbors;
+            recordSize = sizeof(point_id_t) + sizeof(double);
+            batchPoints = std::max(BATCH_NEIGHBORS/std::max(numNeighbors, size_t(1)), size_t(1));
+            batch = ResultBatch();
+            ReserveBatch();
+        }
+
+        void Consume(point_id_t pointId, const Neighbor* neighbors, size_t numNeighbors) override
+        {
+            ResultBatch fullBatch;
+
+            {
+                std::lock_guard<std::mutex> lock(batchMutex);
+
+                size_t offset = batch.buffer.size();
+                batch.buffer.resize(offset + numNeighbors*recordSize);
+
+                for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
+                    EncodeResultNeighbor(batch.buffer.data() + offset + iNeighbor*recordSize, sizeof(point_id_t), neighbors[iNeighbor].pointId, neighbors[iNeighbor].distanceSquared);
+
+                batch.ids.push_back(pointId);
+
+                if (batch.ids.size() < batchPoints)
+                    return;
+
+                std::swap(batch, fullBatch);
+                ReserveBatch();
+            }
+
+            //the full batch is written without the lock of the batch, so the other threads do not wait for the disk
+            std::lock_guard<std::mutex> lock(writeMutex);
+            WriteBatch(fullBatch);
+        }
+
+        void End() override
+        {
+            if (!outFile.is_open())
+                return;
+
+            ResultBatch lastBatch;
+
+            {
+                std::lock_guard<std::mutex> lock(batchMutex);
+                std::swap(batch, lastBatch);
+            }
+
+            std::lock_guard<std::mutex> lock(writeMutex);
+            WriteBatch(lastBatch);
+            outFile.close();
+        }
+
+        const std::string& GetFilename() const
+        {
+            return filename;
+        }
+
+    private:
+        static constexpr size_t BATCH_NEIGHBORS = 1024*1024;
+
+        std::string filename;
+        std::ofstream outFile;
+        size_t numNeighbors = 0;
+        size_t recordSize = 0;
+        size_t batchPoints = 1;
+        ResultBatch batch;
+        std::vector<char> sortedBuffer;
+        std::mutex batchMutex;      /**< lock of the batch that is filled */
+        std::mutex writeMutex;      /**< lock of the file and the sorted buffer, batches are written by one thread at a time */
+
+        void ReserveBatch()
+        {
+            batch.ids.reserve(batchPoints);
+            batch.buffer.reserve(batchPoints*numNeighbors*recordSize);
+        }
+
+        /** \brief Writes a batch to the file, the caller holds the lock of the file
+         *
+         * \param fullBatch const ResultBatch& the batch
+         * \return void
+         *
+         */
+        void WriteBatch(const ResultBatch& fullBatch)
+        {
+            const std::vector<point_id_t>& batchIds = fullBatch.ids;
+            size_t numPoints = batchIds.size();
+            if (numPoints == 0)
+                return;
+
+            size_t pointSize = numNeighbors*recordSize;
+
+            //order the points of the batch by id
+            std::vector<size_t> order(numPoints);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](size_t i1, size_t i2) { return batchIds[i1] < batchIds[i2]; });
+
+            sortedBuffer.resize(numPoints*pointSize);
+            for (size_t iPoint = 0; iPoint < numPoints; ++iPoint)
+                std::copy_n(fullBatch.buffer.cbegin() + order[iPoint]*pointSize, pointSize, sortedBuffer.begin() + iPoint*pointSize);
+
+            //write each run of consecutive ids to its position in the file
+            size_t runStart = 0;
+            for (size_t iPoint = 1; iPoint <= numPoints; ++iPoint)
+            {
+                if (iPoint == numPoints || batchIds[order[iPoint]] != batchIds[order[iPoint - 1]] + 1)
+                {
+                    outFile.seekp(std::streamoff(sizeof(ResultFileHeader) + (batchIds[order[runStart]] - 1)*pointSize));
+                    outFile.write(sortedBuffer.data() + runStart*pointSize, std::streamsize((iPoint - runStart)*pointSize));
+                    runStart = iPoint;
+                }
+            }
+        }
+};
+
+#endif // RESULTSINK_H
@@ -0,0 +1,312 @@
+/* Class definition for the sampled verification of AkNN results
+    Instead of comparing every result with the result of a reference algorithm, a random sample of input points is selected
+    and their exact neighbors are computed by a parallel brute force pass over the training dataset, for the sample only.
+    Each result is compared with the exact neighbors of the sample and the rate of mismatching points is reported
+    together with the upper bound of its confidence interval (Wilson score interval), which bounds the mismatch rate of all input points.
+ */
+#ifndef SAMPLEDVERIFICATION_H
+#define SAMPLEDVERIFICATION_H
+
+#include <vector>
+#include <memory>
+#include <random>
+#include <unordered_set>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <tbb/tbb.h>
+#include "PlaneSweepParallel.h"
+#include "PointNeighbors.h"
+#include "AllKnnResult.h"
+
+/** \brief Outcome of the verification of a result with the sample
+ */
+struct SampleMismatches
+{
+    std::unique_ptr<std::vector<point_id_t>> pPointIds; /**< ids of the sampled input points whose neighbors are different */
+    double rate = 0.0;                                  /**< fraction of the sampled input points that are different */
+    double upperBound = 1.0;                            /**< upper bound of the confidence interval of the rate */
+};
+
+/** \brief Exact neighbors of a random sample of input points, used to verify results
+ */
+class SampledVerification
+{
+    public:
+        /** \brief Constructor, selects the sample and computes the exact neighbors of the sampled input points
+         *
+         * \param inputDataset const PointVector& the input dataset (point_vector_t or ext_point_vector_t)
+         * \param trainingDataset const PointVector& the training dataset
+         * \param numNeighbors size_t the number of nearest neighbors (k)
+         * \param sampleSize size_t the number of input points to sample, all input points are used if the dataset is smaller
+         * \param seed unsigned long the seed of the random generator, the same seed selects the same sample
+         *
+         */
+        template<class PointVector>
+        SampledVerification(const PointVector& inputDataset, const PointVector& trainingDataset, size_t numNeighbors, size_t sampleSize, unsigned long seed)
+            : numNeighbors(numNeighbors)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+
+            SelectSample(inputDataset.size(), sampleSize, seed);
+            FindSamplePoints(inputDataset);
+            FindExactNeighbors(trainingDataset);
+
+            auto finish = std::chrono::high_resolution_clock::now();
+            elapsed = finish - start;
+        }
+
+        virtual ~SampledVerification() {}
+
+        /** \brief Returns the number of sampled input points
+         *
+         * \return size_t
+         *
+         */
+        size_t GetSampleSize() const
+        {
+            return sampleIds.size();
+        }
+
+        /** \brief Returns the time spent in selecting the sample and computing its exact neighbors
+         *
+         * \return const std::chrono::duration<double>&
+         *
+         */
+        const std::chrono::duration<double>& getDuration() const
+        {
+            return elapsed;
+        }
+
+        /** \brief Compares the neighbors of the sampled input points in a result with their exact neighbors
+         *
+         * \param result const AllKnnResult& the result to verify
+         * \param accuracy double the accuracy to use for comparisons of squared distances
+         * \param confidence double the confidence level of the upper bound of the mismatch rate
+         * \return SampleMismatches
+         *
+         */
+        SampleMismatches Verify(const AllKnnResult& result, double accuracy, double confidence = 0.95) const
+        {
+            size_t numSamples = sampleIds.size();
+            auto pNeighbors = result.GetNeighbors(sampleIds);
+
+            std::vector<char> isDifferent(numSamples, 0);
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, numSamples), [&](const tbb::blocked_range<size_t>& range)
+                {
+                    for (size_t iSample = range.begin(); iSample < range.end(); ++iSample)
+                    {
+                        for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
+                        {
+                            size_t position = iSample*numNeighbors + iNeighbor;
+                            double diff = (*pNeighbors)[position].distanceSquared - exactNeighbors[position].distanceSquared;
+
+                            if (std::abs(diff) > accuracy)
+                            {
+                                isDifferent[iSample] = 1;
+                                break;
+                            }
+                        }
+                    }
+                });
+
+            SampleMismatches mismatches;
+            mismatches.pPointIds.reset(new std::vector<point_id_t>());
+
+            for (size_t iSample = 0; iSample < numSamples; ++iSample)
+            {
+                if (isDifferent[iSample])
+                    mismatches.pPointIds->push_back(sampleIds[iSample]);
+            }
+
+            size_t numMismatches = mismatches.pPointIds->size();
+            mismatches.rate = numSamples > 0 ? (1.0*numMismatches)/numSamples : 0.0;
+            mismatches.upperBound = WilsonUpperBound(numMismatches, numSamples, confidence);
+
+            return mismatches;
+        }
+
+        /** \brief Calculates the upper bound of the Wilson score interval of a proportion
+         *          Unlike the normal approximation, the bound is positive when no mismatches have been found
+         * \param numMismatches size_t the number of mismatching points
+         * \param numSamples size_t the number of sampled points
+         * \param confidence double the confidence level of the two-sided interval (0.90, 0.95 or 0.99)
+         * \return double
+         *
+         */
+        static double WilsonUpperBound(size_t numMismatches, size_t numSamples, double confidence)
+        {
+            if (numSamples == 0)
+                return 1.0;
+
+            //quantile of the standard normal distribution for the confidence level
+            double z = confidence >= 0.99 ? 2.576 : (confidence >= 0.95 ? 1.960 : 1.645);
+
+            double n = numSamples;
+            double p = numMismatches/n;
+            double z2 = z*z;
+
+            double center = p + z2/(2.0*n);
+            double margin = z*sqrt(p*(1.0 - p)/n + z2/(4.0*n*n));
+
+            return std::min(1.0, (center + margin)/(1.0 + z2/n));
+        }
+
+    private:
+        //number of training points read at once by the brute force pass
+        static constexpr size_t BLOCK_POINTS = 64*1024;
+
+        size_t numNeighbors = 0;
+        std::vector<point_id_t> sampleIds;      /**< ids of the sampled input points in ascending order */
+        point_vector_t samplePoints;            /**< the sampled input points, in the order of sampleIds */
+        std::vector<Neighbor> exactNeighbors;   /**< k neighbors of each sampled input point, in the order of Next() */
+        std::chrono::duration<double> elapsed = std::chrono::duration<double>(0.0);
+
+        /** \brief Selects distinct random ids of input points
+         *
+         * \param numInputPoints size_t the number of input points
+         * \param sampleSize size_t the number of ids to select
+         * \param seed unsigned long the seed of the random generator
+         * \return void
+         *
+         */
+        void SelectSample(size_t numInputPoints, size_t sampleSize, unsigned long seed)
+        {
+            if (sampleSize >= numInputPoints)
+            {
+                sampleIds.resize(numInputPoints);
+                std::iota(sampleIds.begin(), sampleIds.end(), 1);
+                return;
+            }
+
+            std::mt19937_64 generator(seed);
+            std::uniform_int_distribution<size_t> distribution(1, numInputPoints);
+            std::unordered_set<point_id_t> selectedIds;
+
+            while (selectedIds.size() < sampleSize)
+                selectedIds.insert(point_id_t(distribution(generator)));
+
+            sampleIds.assign(selectedIds.cbegin(), selectedIds.cend());
+            std::sort(sampleIds.begin(), sampleIds.end());
+        }
+
+        /** \brief Finds the sampled input points in the input dataset, which may be in any order
+         *
+         * \param inputDataset const PointVector& the input dataset
+         * \return void
+         *
+         */
+        template<class PointVector>
+        void FindSamplePoints(const PointVector& inputDataset)
+        {
+            samplePoints.resize(sampleIds.size());
+
+            ForEachPointBlock(inputDataset, [this](point_vector_iterator_t blockBegin, point_vector_iterator_t blockEnd)
+                {
+                    for (auto pointIter = blockBegin; pointIter < blockEnd; ++pointIter)
+                    {
+                        auto idIter = std::lower_bound(sampleIds.cbegin(), sampleIds.cend(), pointIter->id);
+
+                        if (idIter != sampleIds.cend() && *idIter == pointIter->id)
+                            samplePoints[idIter - sampleIds.cbegin()] = *pointIter;
+                    }
+                });
+        }
+
+        /** \brief Computes the exact neighbors of the sampled input points
+         *          The training dataset is read once in blocks, the heaps of the sampled points are updated in parallel for each block
+         * \param trainingDataset const PointVector& the training dataset
+         * \return void
+         *
+         */
+        template<class PointVector>
+        void FindExactNeighbors(const PointVector& trainingDataset)
+        {
+            size_t numSamples = sampleIds.size();
+            pointNeighbors_vector_t heaps;
+            heaps.reserve(numSamples);
+
+            for (size_t iSample = 0; iSample < numSamples; ++iSample)
+                heaps.emplace_back(numNeighbors);
+
+            ForEachPointBlock(trainingDataset, [&](point_vector_iterator_t blockBegin, point_vector_iterator_t blockEnd)
+                {
+                    tbb::parallel_for(tbb::blocked_range<size_t>(0, numSamples), [&](const tbb::blocked_range<size_t>& range)
+                        {
+                            for (size_t iSample = range.begin(); iSample < range.end(); ++iSample)
+                            {
+                                auto& samplePoint = samplePoints[iSample];
+                                auto& neighbors = heaps[iSample];
+
+                                for (auto trainingPointIter = blockBegin; trainingPointIter < blockEnd; ++trainingPointIter)
+                                {
+                                    double dx = trainingPointIter->x - samplePoint.x;
+                                    double dy = trainingPointIter->y - samplePoint.y;
+                                    neighbors.Add(trainingPointIter, dx*dx + dy*dy);
+                                }
+                            }
+                        });
+                });
+
+            //store the neighbors in the order of Next(), which is the order returned by AllKnnResult::GetNeighbors
+            exactNeighbors.resize(numSamples*numNeighbors);
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, numSamples), [&](const tbb::blocked_range<size_t>& range)
+                {
+                    for (size_t iSample = range.begin(); iSample < range.end(); ++iSample)
+                    {
+                        heaps[iSample].Finalize();
+
+                        for (size_t iNeighbor = 0; iNeighbor < numNeighbors; ++iNeighbor)
+                            exactNeighbors[iSample*numNeighbors + iNeighbor] = heaps[iSample].FinalizedNeighbor(iNeighbor);
+                    }
+                });
+        }
+
+        /** \brief Passes the points of an internal memory dataset to a function in blocks
+         *
+         * \param dataset const point_vector_t& the dataset
+         * \param processBlock Function the function, called with the range of each block
+         * \return void
+         *
+         */
+        template<class Function>
+        static void ForEachPointBlock(const point_vector_t& dataset, Function processBlock)
+        {
+            for (size_t blockStart = 0; blockStart < dataset.size(); blockStart += BLOCK_POINTS)
+            {
+                size_t blockEnd = std::min(blockStart + BLOCK_POINTS, dataset.size());
+                processBlock(dataset.cbegin() + blockStart, dataset.cbegin() + blockEnd);
+            }
+        }
+
+        /** \brief Reads the points of an external memory dataset in blocks and passes them to a function
+         *
+         * \param dataset const ext_point_vector_t& the dataset
+         * \param processBlock Function the function, called with the range of each block
+         * \return void
+         *
+         */
+        template<class Function>
+        static void ForEachPointBlock(const ext_point_vector_t& dataset, Function processBlock)
+        {
+            point_vector_t block;
+            block.reserve(BLOCK_POINTS);
+
+            stxxl::vector_bufreader<ext_point_vector_t> reader(dataset);
+
+            while (!reader.empty())
+            {
+                block.clear();
+
+                for (; !reader.empty() && block.size() < BLOCK_POINTS; ++reader)
+                    block.push_back(*reader);
+
+                processBlock(block.cbegin(), block.cend());
+            }
+        }
+};
+
+#endif // SAMPLEDVERIFICATION_H
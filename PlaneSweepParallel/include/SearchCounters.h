@@ -0,0 +1,124 @@
+/* Class definitions for counting the work of the neighbor searches
+    The counters are compiled only when SEARCH_COUNTERS is defined, e.g. make DEFINES=-DSEARCH_COUNTERS,
+    otherwise the COUNT_SEARCH macro expands to nothing and the hot paths are exactly the same.
+    Each thread increments its own accumulator without synchronization, the accumulators are summed after the algorithm returns.
+ */
+#ifndef SEARCHCOUNTERS_H
+#define SEARCHCOUNTERS_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+/** \brief Counters of the work of the neighbor searches
+ */
+struct SearchCounters
+{
+    uint64_t stripesVisited = 0;        /**< stripes swept, summed over all input points */
+    uint64_t candidatesExamined = 0;    /**< training points examined by the sweeps */
+    uint64_t distanceEvaluations = 0;   /**< double precision distances calculated */
+    uint64_t dxTerminations = 0;        /**< sweeps stopped because dx exceeded the k-th distance */
+    uint64_t dyTerminations = 0;        /**< searches of neighboring stripes stopped because dy exceeded the k-th distance */
+    uint64_t binarySearchSteps = 0;     /**< comparisons of the binary searches for the start of the sweeps */
+
+    SearchCounters& operator+=(const SearchCounters& other)
+    {
+        stripesVisited += other.stripesVisited;
+        candidatesExamined += other.candidatesExamined;
+        distanceEvaluations += other.distanceEvaluations;
+        dxTerminations += other.dxTerminations;
+        dyTerminations += other.dyTerminations;
+        binarySearchSteps += other.binarySearchSteps;
+        return *this;
+    }
+};
+
+/** \brief Thread local accumulators of the search counters
+ */
+class SearchCounterAccumulators
+{
+    public:
+        /** \brief Returns true if the counters have been compiled
+         *
+         * \return bool
+         *
+         */
+        static constexpr bool IsEnabled()
+        {
+#ifdef SEARCH_COUNTERS
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /** \brief Returns the accumulator of the calling thread, it is created and registered at the first call of each thread
+         *          The accumulators are owned by the registry, so the counts of the threads that have exited are kept
+         * \return SearchCounters&
+         *
+         */
+        static SearchCounters& Local()
+        {
+            thread_local SearchCounters* pLocal = Register();
+            return *pLocal;
+        }
+
+        /** \brief Resets the accumulators of all threads, it must be called while no search is running
+         *
+         * \return void
+         *
+         */
+        static void Reset()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+
+            for (auto& pAccumulator : GetAccumulators())
+                *pAccumulator = SearchCounters();
+        }
+
+        /** \brief Sums the accumulators of all threads, it must be called while no search is running
+         *
+         * \return SearchCounters
+         *
+         */
+        static SearchCounters Collect()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+            SearchCounters total;
+
+            for (auto& pAccumulator : GetAccumulators())
+                total += *pAccumulator;
+
+            return total;
+        }
+
+    private:
+        static SearchCounters* Register()
+        {
+            std::lock_guard<std::mutex> lock(GetMutex());
+
+            GetAccumulators().emplace_back(new SearchCounters());
+            return GetAccumulators().back().get();
+        }
+
+        static std::vector<std::unique_ptr<SearchCounters>>& GetAccumulators()
+        {
+            static std::vector<std::unique_ptr<SearchCounters>> accumulators;
+            return accumulators;
+        }
+
+        static std::mutex& GetMutex()
+        {
+            static std::mutex accumulatorsMutex;
+            return accumulatorsMutex;
+        }
+};
+
+#ifdef SEARCH_COUNTERS
+#define COUNT_SEARCH(counter, n) (SearchCounterAccumulators::Local().counter += (n))
+#else
+#define COUNT_SEARCH(counter, n) ((void)0)
+#endif
+
+#endif // SEARCHCOUNTERS_H
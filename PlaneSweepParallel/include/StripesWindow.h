@@ -2,6 +2,8 @@
 #ifndef STRIPESWINDOW_H
 #define STRIPESWINDOW_H
 
+#include <chrono>
+#include "PhaseProfiler.h"
 
 /** \brief Window of stripes used by external memory algorithm
  */
@@ -33,9 +35,9 @@ class StripesWindow
                     auto& neighborsVector = pNeighborsContainer->at(i);
                     neighborsVector.reserve(numInputPoints);
 
-                    //initialize neighbors for all input points of the current stripe with a very large distance
+                    //create empty heaps of neighbors for all input points of the current stripe
                     for (size_t iPoint=0; iPoint < numInputPoints; ++iPoint)
-                        neighborsVector.emplace_back(PointNeighbors<neighbors_priority_queue_t>(numNeighbors));
+                        neighborsVector.emplace_back(numNeighbors);
                 }
             }
         }
@@ -95,6 +97,21 @@ class StripesWindow
             return secondPass;
         }
 
+        /** \brief Returns the number of stripes at the start of the window that contain training points only (halo of the first phase)
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumHaloStripes() const
+        {
+            return haloStripes;
+        }
+
+        void SetNumHaloStripes(size_t value)
+        {
+            haloStripes = value;
+        }
+
         /** \brief Returns stripe data for the stripes of this window
          *
          * \return StripeData
@@ -115,6 +132,100 @@ class StripesWindow
             return *pNeighborsContainer;
         }
 
+        /** \brief Returns the estimated memory that the window allocates while it is processed (heaps of neighbors and pending points
+         *          read back from external memory), used when the next window is loaded while this one is in process
+         * \return size_t
+         *
+         */
+        size_t GetMemoryGrowth() const
+        {
+            return memoryGrowth;
+        }
+
+        void SetMemoryGrowth(size_t value)
+        {
+            memoryGrowth = value;
+        }
+
+        /** \brief Returns the time spent in copying the stripes of the window from external memory
+         *
+         * \return const std::chrono::duration<double>&
+         *
+         */
+        const std::chrono::duration<double>& GetDurationLoad() const
+        {
+            return elapsedLoad;
+        }
+
+        /** \brief Sets the start and the finish of the loading of the window, they are recorded by the main thread when it takes the window
+         *
+         * \param start const ProfileSample& the start of the loading
+         * \param finish const ProfileSample& the finish of the loading
+         * \return void
+         *
+         */
+        void SetLoadSamples(const ProfileSample& start, const ProfileSample& finish)
+        {
+            loadStart = start;
+            loadFinish = finish;
+            elapsedLoad = std::chrono::duration<double>(finish.time - start.time);
+        }
+
+        const ProfileSample& GetLoadStart() const
+        {
+            return loadStart;
+        }
+
+        const ProfileSample& GetLoadFinish() const
+        {
+            return loadFinish;
+        }
+
+        /** \brief Returns the number of training points loaded by the window, including the halo stripes
+         *
+         * \return size_t
+         *
+         */
+        size_t GetNumLoadedTrainingPoints() const
+        {
+            return numLoadedTrainingPoints;
+        }
+
+        void SetNumLoadedTrainingPoints(size_t value)
+        {
+            numLoadedTrainingPoints = value;
+        }
+
+        /** \brief Returns the time the algorithm waited for the window to be loaded
+         *
+         * \return const std::chrono::duration<double>&
+         *
+         */
+        const std::chrono::duration<double>& GetDurationIOWait() const
+        {
+            return elapsedIOWait;
+        }
+
+        void SetDurationIOWait(const std::chrono::duration<double>& value)
+        {
+            elapsedIOWait = value;
+        }
+
+        /** \brief Returns the time spent in the plane sweep and the commit of the window
+         *
+         * \return const std::chrono::duration<double>&
+         *
+         */
+        const std::chrono::duration<double>& GetDurationCompute() const
+        {
+            return elapsedCompute;
+        }
+
+        void SetDurationCompute(const std::chrono::duration<double>& value)
+        {
+            elapsedCompute = value;
+        }
+
     private:
         size_t startStripe = 0;
         size_t endStripe = 0;
@@ -124,6 +235,14 @@ class StripesWindow
         std::unique_ptr<std::vector<StripeBoundaries_t>> pStripeBoundaries;
         std::unique_ptr<pointNeighbors_vector_vector_t> pNeighborsContainer;
         size_t numNeighbors = 0;
+        size_t haloStripes = 0;
+        size_t memoryGrowth = 0;
+        size_t numLoadedTrainingPoints = 0;
+        ProfileSample loadStart;
+        ProfileSample loadFinish;
+        std::chrono::duration<double> elapsedLoad = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> elapsedIOWait = std::chrono::duration<double>(0.0);
+        std::chrono::duration<double> elapsedCompute = std::chrono::duration<double>(0.0);
 };
 
 #endif // STRIPESWINDOW_H
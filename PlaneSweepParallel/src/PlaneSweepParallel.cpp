@@ -7,34 +7,619 @@
 #include <chrono>
 #include <omp.h>
 #include <fstream>
-#include "BruteForceAlgorithm.h"
-#include "BruteForceParallelAlgorithm.h"
-#include "BruteForceParallelTBBAlgorithm.h"
 #include "AllKnnProblem.h"
 #include "AllKnnResult.h"
-#include "PlaneSweepAlgorithm.h"
-#include "PlaneSweepCopyAlgorithm.h"
-#include "PlaneSweepCopyParallelAlgorithm.h"
-#include "PlaneSweepCopyParallelTBBAlgorithm.h"
-#include "PlaneSweepStripesAlgorithm.h"
-#include "PlaneSweepStripesParallelAlgorithm.h"
-#include "PlaneSweepStripesParallelTBBAlgorithm.h"
-#include "PlaneSweepStripesParallelExternalAlgorithm.h"
-#include "PlaneSweepStripesParallelExternalTBBAlgorithm.h"
+#include "AlgorithmFactory.h"
+#include "BenchmarkReport.h"
+#include "JobSpec.h"
+#include "MemoryTracker.h"
+#include "PhaseProfiler.h"
+#include "SampledVerification.h"
+#include "SearchCounters.h"
+
+//seed of the random selection of input points for the sampled verification, a fixed seed verifies the same points in every run
+#define SAMPLE_SEED 1
+
+/** \brief Options for saving and verifying the result of each algorithm
+ */
+struct ResultOptions
+{
+    double accuracy = 1.0E-15;          /**< accuracy to use for comparing results */
+    int saveToFile = 1;                 /**< 0=no, 1=text file, 2=binary file, 3=binary file written while the algorithm runs */
+    bool findDifferences = true;        /**< compare with the result of a reference algorithm */
+    bool sampledVerification = false;   /**< compare with the exact neighbors of a sample of input points */
+};
+
+/** \brief Measurements of a run of an algorithm
+ */
+struct RunMeasurement
+{
+    double duration = 0.0;  /**< total duration in seconds */
+    size_t numStripes = 0;  /**< number of stripes used */
+};
+
+/** \brief Writes the columns of the performance statistics to the output file
+ *
+ * \param outFile std::ostream& the output file
+ * \param parameterColumns const std::string& columns written before the statistics, each one followed by ;
+ * \return void
+ *
+ */
+void WriteStatisticsHeader(std::ostream& outFile, const std::string& parameterColumns)
+{
+    outFile << parameterColumns << "Algorithm;Total Duration;Sorting Duration;Total Heap Additions;Min. Heap Additions;Max. Heap Additions;Avg. Heap Additions;NumberOfStripes;HasAllocationError;PendingPoints;SpilledPendingPoints;NumFirstPassWindows;NumSecondPassWindows;LoadedTrainingPoints;CommitWindow Duration;Final Sorting Duration;Output Flush Duration;Window IO Wait Duration;Window Load Duration;Window Compute Duration;Peak RSS MB;Peak Tracked MB;Budget Utilization;Stripes Visited;Stripes per Point;Candidates Examined;Distance Evaluations;DX Terminations;DY Terminations;Binary Search Steps;Differences;First 5 different point ids;Sample Mismatch Rate;Sample Mismatch Upper Bound;Allocation Duration;Sort Y Duration;Split Stripes Duration;Sort X Duration;Search Duration;Finalize Duration;Verification Duration;Busy Threads;Min. Thread Busy;Max. Thread Busy;Avg. Thread Busy;Load Imbalance;Stripe Tasks;Max. Stripe Compute;Avg. Stripe Compute";
+
+    //hardware counters of each phase, summed over the threads
+    for (int iPhase = 0; iPhase < NUM_PROFILE_PHASES; ++iPhase)
+    {
+        std::string phaseName = PhaseProfiler::GetPhaseName(static_cast<ProfilePhase>(iPhase));
+        outFile << ";" << phaseName << " LLC Misses;" << phaseName << " dTLB Misses;" << phaseName << " Branch Misses;" << phaseName << " IPC";
+    }
+
+    outFile << std::endl;
+    outFile.flush();
+}
+
+/** \brief Opens the hardware counters of the main thread and prints a note if they are not available, the run continues without them
+ *
+ * \return void
+ *
+ */
+void CheckHardwareCounters()
+{
+    if (!HardwareCounters::IsEnabled())
+        return;
+
+    std::string message;
+    bool isAvailable = HardwareCounters::Probe(message);
+
+    if (!isAvailable)
+        std::cout << "Note: hardware counters are not available, the run continues without them: " << message << std::endl;
+    else if (!message.empty())
+        std::cout << "Note: some hardware counters are not available: " << message << std::endl;
+}
+
+/** \brief Runs an algorithm, writes its performance statistics to the console and the output file, then saves and verifies its result
+ *
+ * \param algorithm AbstractAllKnnAlgorithm& the algorithm
+ * \param pProblem AllKnnProblem* the internal memory problem, nullptr if it has not been loaded
+ * \param pProblemExternal AllKnnProblemExternal* the external memory problem, nullptr if it has not been loaded
+ * \param options const ResultOptions& the options for saving and verifying the result
+ * \param pSample const SampledVerification* the exact neighbors of the sample, nullptr if sampled verification is not used
+ * \param pResultReference std::unique_ptr<AllKnnResult>& the reference result, if it is empty and differences are checked the result becomes the reference
+ * \param streamFilename const std::string& the file of the result sink, used when options.saveToFile=3
+ * \param outFile std::ostream& the output file, the caller has written the parameter columns of the row
+ * \param trace ProfileTrace& the trace of the phases, the phases of the run are added to it
+ * \return RunMeasurement the measurements of the run
+ *
+ */
+RunMeasurement RunAlgorithm(AbstractAllKnnAlgorithm& algorithm, AllKnnProblem* pProblem, AllKnnProblemExternal* pProblemExternal, const ResultOptions& options,
+                  const SampledVerification* pSample, std::unique_ptr<AllKnnResult>& pResultReference, const std::string& streamFilename, std::ostream& outFile,
+                  ProfileTrace& trace)
+{
+    AllKnnProblem& problem = algorithm.UsesExternalMemory() ? *pProblemExternal : *pProblem;
+    std::unique_ptr<AllKnnResult> pResult;
+    std::unique_ptr<std::vector<point_id_t>> pDiff;
+
+    //the peaks of memory are measured for each algorithm separately
+    MemoryTracker::ResetPeak();
+    size_t trackedBaseline = MemoryTracker::GetAllocatedBytes();
+
+    //a streamed result keeps no neighbors, so it is neither saved nor compared afterwards
+    bool streamResult = options.saveToFile == 3 && algorithm.SupportsResultSink();
+    std::unique_ptr<FileResultSink> pSink;
+
+    if (streamResult)
+    {
+        pSink.reset(new FileResultSink(streamFilename));
+        pSink->Begin(problem.GetInputDatasetSize(), problem.GetNumNeighbors());
+        algorithm.SetResultSink(pSink.get());
+    }
+
+    //the search counters are accumulated for each algorithm separately
+    SearchCounterAccumulators::Reset();
+    //the phases are recorded from the start of the algorithm until its result has been verified
+    PhaseProfiler::Start();
+
+    //process the correct type of problem (external or internal memory)
+    if (algorithm.UsesExternalMemory())
+        pResult = algorithm.Process(*pProblemExternal);
+    else
+        pResult = algorithm.Process(*pProblem);
+
+    SearchCounters counters = SearchCounterAccumulators::Collect();
+
+    if (streamResult)
+    {
+        pSink->End();
+        algorithm.SetResultSink(nullptr);
+    }
+
+    RunMeasurement measurement;
+    measurement.duration = pResult->getDuration().count();
+    measurement.numStripes = pResult->getNumStripes();
+
+    double peakRSS = MemoryTracker::GetPeakRSS()/(1024.0*1024.0);
+    double peakTracked = MemoryTracker::GetPeakAllocatedBytes()/(1024.0*1024.0);
+    //budget utilization is reported only for the algorithms that run under a memory limit, it is the peak of the tracked memory allocated by the algorithm
+    //(the memory held before the algorithm started, e.g. the results of previous algorithms, is not counted, and the process RSS is reported separately)
+    size_t peakAlgorithmBytes = MemoryTracker::GetPeakAllocatedBytes() > trackedBaseline ? MemoryTracker::GetPeakAllocatedBytes() - trackedBaseline : 0;
+    double budgetUtilization = algorithm.UsesExternalMemory() ? (1.0*peakAlgorithmBytes)/pProblemExternal->GetMemoryLimitBytes() : 0.0;
+    //output the performance statistics to the console
+    std::cout << std::fixed << std::setprecision(3) << algorithm.GetTitle() << " duration: " << pResult->getDuration().count()
+        << " sorting " << pResult->getDurationSorting().count() << " seconds "
+        << " totalAdd: " << pResult->getTotalHeapAdditions()
+        <<  " minAdd: " << pResult->getMinHeapAdditions()
+        << " maxAdd: " << pResult->getMaxHeapAdditions()
+        << " avgAdd: " << pResult->getAvgHeapAdditions()
+        << " numStripes: " << pResult->getNumStripes()
+        << " hasAllocationError: " << pResult->HasAllocationError()
+        << " numPendingPoints: " << pResult->getNumPendingPoints()
+        << " numSpilledPoints: " << pResult->getNumSpilledPoints()
+        << " numFirstPassWindows: " << pResult->getNumFirstPassWindows()
+        << " numSecondPassWindows: " << pResult->getNumSecondPassWindows()
+        << " loadedTrainingPoints: " << pResult->getNumLoadedTrainingPoints()
+        << " commitWindow: " << pResult->getDurationCommitWindow().count() << " seconds "
+        << " finalSorting: " << pResult->getDurationFinalSorting().count() << " seconds "
+        << " outputFlush: " << pResult->getDurationOutputFlush().count() << " seconds "
+        << " windowIOWait: " << pResult->getDurationWindowIOWait().count() << " seconds "
+        << " windowLoad: " << pResult->getDurationWindowLoad().count() << " seconds "
+        << " windowCompute: " << pResult->getDurationWindowCompute().count() << " seconds "
+        << " peakRSS: " << peakRSS << " MB "
+        << " peakTracked: " << peakTracked << " MB "
+        << " budgetUtilization: " << budgetUtilization;
+
+    //write the performance statistics to the output file
+    outFile << std::fixed << std::setprecision(3) << algorithm.GetTitle() << ";" << pResult->getDuration().count()
+        << ";" << pResult->getDurationSorting().count()
+        << ";" << pResult->getTotalHeapAdditions()
+        << ";" << pResult->getMinHeapAdditions()
+        << ";" << pResult->getMaxHeapAdditions()
+        << ";" << pResult->getAvgHeapAdditions()
+        << ";" << pResult->getNumStripes()
+        << ";" << pResult->HasAllocationError()
+        << ";" << pResult->getNumPendingPoints()
+        << ";" << pResult->getNumSpilledPoints()
+        << ";" << pResult->getNumFirstPassWindows()
+        << ";" << pResult->getNumSecondPassWindows()
+        << ";" << pResult->getNumLoadedTrainingPoints()
+        << ";" << pResult->getDurationCommitWindow().count()
+        << ";" << pResult->getDurationFinalSorting().count()
+        << ";" << pResult->getDurationOutputFlush().count()
+        << ";" << pResult->getDurationWindowIOWait().count()
+        << ";" << pResult->getDurationWindowLoad().count()
+        << ";" << pResult->getDurationWindowCompute().count()
+        << ";" << peakRSS
+        << ";" << peakTracked
+        << ";" << budgetUtilization;
+
+    //the search counters are empty if they have not been compiled
+    if (SearchCounterAccumulators::IsEnabled())
+    {
+        double stripesPerPoint = problem.GetInputDatasetSize() > 0 ? (1.0*counters.stripesVisited)/problem.GetInputDatasetSize() : 0.0;
+
+        std::cout << " stripesVisited: " << counters.stripesVisited
+            << " stripesPerPoint: " << stripesPerPoint
+            << " candidatesExamined: " << counters.candidatesExamined
+            << " distanceEvaluations: " << counters.distanceEvaluations
+            << " dxTerminations: " << counters.dxTerminations
+            << " dyTerminations: " << counters.dyTerminations
+            << " binarySearchSteps: " << counters.binarySearchSteps;
+
+        outFile << ";" << counters.stripesVisited
+            << ";" << stripesPerPoint
+            << ";" << counters.candidatesExamined
+            << ";" << counters.distanceEvaluations
+            << ";" << counters.dxTerminations
+            << ";" << counters.dyTerminations
+            << ";" << counters.binarySearchSteps;
+    }
+    else
+    {
+        outFile << ";;;;;;;";
+    }
+
+    //save the list of neighbors to a text or binary file, algorithms without a result sink save their result after they finish
+    if (options.saveToFile == 1 && !pResult->HasAllocationError())
+    {
+        pResult->SaveToFile();
+    }
+    else if ((options.saveToFile == 2 || (options.saveToFile == 3 && !streamResult)) && !pResult->HasAllocationError())
+    {
+        pResult->SaveToBinaryFile();
+    }
+
+    //check for differences between distances of neighbors by using the first algorithm as a reference result,
+    //or the exact neighbors of the sample
+    bool canCompare = !streamResult && !pResult->HasAllocationError();
+    SampleMismatches mismatches;
+
+    ProfileSample verificationStart = PhaseProfiler::Now();
+
+    if (options.sampledVerification && canCompare)
+    {
+        mismatches = pSample->Verify(*pResult, options.accuracy);
+        pDiff = std::move(mismatches.pPointIds);
+    }
+    else if (options.findDifferences && pResultReference != nullptr && canCompare)
+    {
+        pDiff = pResult->FindDifferences(*pResultReference, options.accuracy);
+    }
+
+    PhaseProfiler::Record(ProfilePhase::Verification, verificationStart, PhaseProfiler::Now());
+    PhaseProfiler::Stop();
 
-#define NUM_ALGORITHMS 30
+    if (pDiff != nullptr)
+    {
+        std::cout << " " << pDiff->size() << " differences. ";
+        outFile << ";" << pDiff->size();
 
-typedef std::unique_ptr<AbstractAllKnnAlgorithm> algorithm_ptr_t;
+        if (pDiff->size() > 0)
+        {
+            //report the first 5 different neighbor ids
+            std::cout << "First 5 different point ids: ";
+            outFile << ";";
+
+            for (size_t i = 0; i < 5; ++i)
+            {
+                if (pDiff->size() >= i+1)
+                {
+                    std::cout << pDiff->at(i) << " ";
+                    outFile << pDiff->at(i) << " ";
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+        else
+        {
+            outFile << ";";
+        }
+        pDiff.reset();
+    }
+    else
+    {
+        outFile << ";;";
+    }
+
+    //the mismatch rate of the sample bounds the mismatch rate of all input points with 95% confidence
+    if (options.sampledVerification && canCompare)
+    {
+        std::cout << std::setprecision(6) << "Sample mismatch rate: " << mismatches.rate << " upper bound: " << mismatches.upperBound;
+        outFile << std::setprecision(6) << ";" << mismatches.rate << ";" << mismatches.upperBound;
+    }
+    else
+    {
+        outFile << ";;";
+    }
+
+    //the durations of the phases and the load imbalance of the threads that searched the stripes
+    auto events = PhaseProfiler::Collect();
+    ProfileSummary profile = ProfileSummary::Compute(events);
+    trace.AddRun(algorithm.GetTitle(), events);
+
+    std::cout << std::setprecision(3) << " busyThreads: " << profile.numThreads
+        << " minBusy: " << profile.minThreadBusy << " maxBusy: " << profile.maxThreadBusy << " avgBusy: " << profile.avgThreadBusy
+        << " loadImbalance: " << profile.imbalance << " maxStripe: " << profile.maxStripeCompute << " seconds";
+
+    outFile << std::setprecision(3) << ";" << profile.GetDuration(ProfilePhase::Allocation)
+        << ";" << profile.GetDuration(ProfilePhase::SortY)
+        << ";" << profile.GetDuration(ProfilePhase::SplitStripes)
+        << ";" << profile.GetDuration(ProfilePhase::SortX)
+        << ";" << profile.GetDuration(ProfilePhase::Search)
+        << ";" << profile.GetDuration(ProfilePhase::Finalize)
+        << ";" << profile.GetDuration(ProfilePhase::Verification)
+        << ";" << profile.numThreads
+        << ";" << profile.minThreadBusy
+        << ";" << profile.maxThreadBusy
+        << ";" << profile.avgThreadBusy
+        << ";" << profile.imbalance
+        << ";" << profile.numStripeTasks
+        << ";" << profile.maxStripeCompute
+        << ";" << profile.avgStripeCompute;
+
+    //the hardware counters are empty if they have not been compiled or they are not available
+    for (int iPhase = 0; iPhase < NUM_PROFILE_PHASES; ++iPhase)
+    {
+        const HardwareCounterValues& counters = profile.GetCounters(static_cast<ProfilePhase>(iPhase));
+
+        if (HardwareCounters::IsAvailable())
+            outFile << ";" << counters.llcMisses << ";" << counters.dtlbMisses << ";" << counters.branchMisses << ";" << counters.GetIpc();
+        else
+            outFile << ";;;;";
+    }
+
+    if (HardwareCounters::IsAvailable())
+    {
+        const HardwareCounterValues& search = profile.GetCounters(ProfilePhase::StripeTask);
+
+        std::cout << " stripes llcMisses: " << search.llcMisses << " dtlbMisses: " << search.dtlbMisses
+            << " branchMisses: " << search.branchMisses << " ipc: " << search.GetIpc();
+    }
+
+    std::cout << std::endl;
+    outFile << std::endl;
+    outFile.flush();
+
+    //if we need to check for differences, keep the first result to use as a reference for comparing the others with it
+    if (options.findDifferences && pResultReference == nullptr && !streamResult)
+    {
+        pResultReference = std::move(pResult);
+    }
+
+    return measurement;
+}
+
+/** \brief Prints the stripe axis and the change of the distances caused by the transform of the coordinates
+ *
+ * \param pProblem const AllKnnProblem* the problem whose datasets have been transformed
+ * \param accuracy double the accuracy to use for comparing results
+ * \return void
+ *
+ */
+void ReportStripeAxis(const AllKnnProblem* pProblem, double accuracy)
+{
+    const DatasetTransform& transform = pProblem->GetTransform();
+    const BoundingBox_t& boundingBox = pProblem->GetBoundingBox();
+    std::cout << "Stripe axis: " << transform.GetDescription() << std::endl;
+
+    double extent = std::max({std::abs(boundingBox.minX), std::abs(boundingBox.maxX), std::abs(boundingBox.minY), std::abs(boundingBox.maxY)});
+    double tolerance = transform.GetDistanceTolerance(extent);
+
+    //every algorithm runs on the same transformed coordinates, so the results are compared with the given accuracy
+    if (tolerance > 0.0)
+    {
+        std::cout << "The distances of the neighbors are squared distances of the rotated coordinates, they differ from the distances"
+            << " of the original coordinates by up to " << tolerance << std::endl;
+
+        if (tolerance > accuracy)
+            std::cout << "Results of the original coordinates must be compared with an accuracy of at least " << tolerance
+                << " instead of " << accuracy << std::endl;
+    }
+}
+
+/** \brief Runs a job, every combination of the parameters of the job specification is run in this process
+ *          Each dataset is loaded once and each algorithm is created with the parameters of its combination.
+ *          Every combination runs the warmup runs, which are not measured, and then the measured repetitions
+ * \param jobSpec const JobSpec& the job specification
+ * \return int the exit code of the program
+ *
+ */
+int RunJob(const JobSpec& jobSpec)
+{
+    ResultOptions options;
+    options.accuracy = jobSpec.GetAccuracy();
+    options.saveToFile = jobSpec.GetSaveToFile();
+    options.findDifferences = jobSpec.GetCompare() == 1;
+    options.sampledVerification = jobSpec.GetCompare() == 2;
+
+    bool useExternalMemory = false;
+    bool useInternalMemory = false;
+
+    for (auto algorithm : jobSpec.GetAlgorithms())
+    {
+        if (CreateAlgorithm(algorithm, AlgorithmParameters())->UsesExternalMemory())
+            useExternalMemory = true;
+        else
+            useInternalMemory = true;
+    }
+
+    auto runs = jobSpec.GetRuns();
+    StripeAxisMode stripeAxisMode = jobSpec.GetStripeAxisMode();
+
+    //set Greek numeric formatting for decimal and thousand separator
+    std::cout.imbue(std::locale(std::cout.getloc(), new punct_facet<char, ',', '.'>));
+
+    CheckHardwareCounters();
+
+    //create the output file, the parameters of each run are written before its performance statistics
+    auto now = std::chrono::system_clock::now();
+    auto in_time_t = std::chrono::system_clock::to_time_t(now);
+    std::string outFilename = jobSpec.GetOutputFilename();
+
+    if (outFilename.empty())
+    {
+        std::stringstream ss;
+        ss << "job_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << ".csv";
+        outFilename = ss.str();
+    }
+
+    //the summary of the repetitions and the trace of the phases are written to JSON files next to the output file
+    std::string reportFilename = endsWith(outFilename, ".csv") ? outFilename.substr(0, outFilename.length() - 4) : outFilename;
+    std::string traceFilename = reportFilename + ".trace.json";
+    reportFilename += ".json";
+
+    std::ofstream outFile(outFilename, std::ios_base::out);
+    if (!outFile.is_open())
+        throw ApplicationException("Cannot create output file " + outFilename);
+
+    outFile.imbue(std::locale(outFile.getloc(), new punct_facet<char, ',', '.'>));
+    WriteStatisticsHeader(outFile, "Input;Algorithm Name;k;Threads;Stripes;Memory MB;Repetition;");
+
+    std::unique_ptr<AllKnnProblem> pProblem;
+    std::unique_ptr<AllKnnProblemExternal> pProblemExternal;
+    std::unique_ptr<AllKnnResult> pResultReference;
+    std::unique_ptr<SampledVerification> pSample;
+    BenchmarkReport report(jobSpec.GetNumWarmupRuns(), jobSpec.GetNumRepetitions(), jobSpec.IsWeakScaling());
+    ProfileTrace trace;
+
+    for (size_t iRun = 0; iRun < runs.size(); ++iRun)
+    {
+        const JobRun& run = runs[iRun];
+        const auto& dataset = jobSpec.GetDatasets()[run.dataset];
+        bool newDataset = iRun == 0 || run.dataset != runs[iRun - 1].dataset;
+
+        //the runs of the same dataset are consecutive, so each dataset is loaded once
+        if (newDataset)
+        {
+            pProblem.reset();
+            pProblemExternal.reset();
+
+            if (useInternalMemory)
+            {
+                pProblem.reset(new AllKnnProblem(dataset.first, dataset.second, run.numNeighbors, true, stripeAxisMode));
+                std::cout << "Read " << pProblem->GetInputDatasetSize() << " input points and " << pProblem->GetTrainingDatasetSize()
+                    << " training points " << "in " << pProblem->getLoadingTime().count() << " seconds" << std::endl;
+            }
+
+            if (useExternalMemory)
+            {
+                pProblemExternal.reset(new AllKnnProblemExternal(dataset.first, dataset.second, run.numNeighbors, true,
+                                                                 stripeAxisMode, jobSpec.GetMemoryLimitsMB().front()));
+                std::cout << "Read " << pProblemExternal->GetInputDatasetSize() << " input points and " << pProblemExternal->GetTrainingDatasetSize()
+                    << " training points " << "in " << pProblemExternal->getLoadingTime().count() << " seconds" << std::endl;
+            }
+
+            if (stripeAxisMode != StripeAxisMode::Y)
+                ReportStripeAxis(useInternalMemory ? pProblem.get() : pProblemExternal.get(), options.accuracy);
+        }
+
+        //the reference result and the sample are valid until the dataset or k changes
+        if (newDataset || run.numNeighbors != runs[iRun - 1].numNeighbors)
+        {
+            pResultReference.reset();
+            pSample.reset();
+
+            if (pProblem)
+                pProblem->SetNumNeighbors(run.numNeighbors);
+
+            if (pProblemExternal)
+                pProblemExternal->SetNumNeighbors(run.numNeighbors);
+
+            if (options.sampledVerification)
+            {
+                if (useInternalMemory)
+                    pSample.reset(new SampledVerification(pProblem->GetInputDataset(), pProblem->GetTrainingDataset(), run.numNeighbors, jobSpec.GetSampleSize(), SAMPLE_SEED));
+                else
+                    pSample.reset(new SampledVerification(pProblemExternal->GetExtInputDataset(), pProblemExternal->GetExtTrainingDataset(), run.numNeighbors, jobSpec.GetSampleSize(), SAMPLE_SEED));
+
+                std::cout << "Computed exact neighbors of " << pSample->GetSampleSize() << " sampled input points in " << pSample->getDuration().count() << " seconds" << std::endl;
+            }
+        }
+
+        if (pProblemExternal && run.memoryLimitMB > 0)
+            pProblemExternal->SetMemoryLimitMB(run.memoryLimitMB);
+
+        //the algorithms set the number of threads only when it is specified, so the default of the system is restored for the other runs
+        int numThreadsUsed = run.numThreads > 0 ? run.numThreads : omp_get_num_procs();
+        omp_set_num_threads(numThreadsUsed);
+
+        AlgorithmParameters parameters;
+        parameters.numStripes = run.numStripes;
+        parameters.numThreads = run.numThreads;
+        parameters.prefetchWindows = jobSpec.GetPrefetchWindows();
+
+        algorithm_ptr_t algorithm = CreateAlgorithm(run.algorithm, parameters);
+        AllKnnProblem& problem = algorithm->UsesExternalMemory() ? *pProblemExternal : *pProblem;
+
+        std::cout << "Run " << iRun + 1 << "/" << runs.size() << ": " << ALGORITHM_NAMES[run.algorithm] << " k=" << run.numNeighbors
+            << " threads=" << run.numThreads << " stripes=" << run.numStripes << " memory=" << run.memoryLimitMB << " MB"
+            << " input=" << dataset.first << std::endl;
+
+        //warmup runs bring the datasets into the caches and the thread pools up, their results are discarded
+        //every run uses a new algorithm, because the algorithms keep the number of stripes of their last run
+        for (int iWarmup = 0; iWarmup < jobSpec.GetNumWarmupRuns(); ++iWarmup)
+        {
+            algorithm_ptr_t warmupAlgorithm = CreateAlgorithm(run.algorithm, parameters);
+
+            if (warmupAlgorithm->UsesExternalMemory())
+                warmupAlgorithm->Process(*pProblemExternal);
+            else
+                warmupAlgorithm->Process(*pProblem);
+        }
+
+        BenchmarkConfiguration configuration;
+        configuration.algorithmName = ALGORITHM_NAMES[run.algorithm];
+        configuration.algorithmTitle = algorithm->GetTitle();
+        configuration.dataset = run.dataset;
+        configuration.inputFilename = dataset.first;
+        configuration.trainingFilename = dataset.second;
+        configuration.numInputPoints = problem.GetInputDatasetSize();
+        configuration.numTrainingPoints = problem.GetTrainingDatasetSize();
+        configuration.numNeighbors = run.numNeighbors;
+        configuration.numThreads = numThreadsUsed;
+        configuration.numStripes = run.numStripes;
+        configuration.memoryLimitMB = run.memoryLimitMB;
+
+        for (int iRepetition = 1; iRepetition <= jobSpec.GetNumRepetitions(); ++iRepetition)
+        {
+            std::stringstream ssSink;
+            ssSink << "result_stream_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << "_" << iRun << "_" << iRepetition << ".bin";
+
+            outFile << dataset.first << ";" << ALGORITHM_NAMES[run.algorithm] << ";" << run.numNeighbors << ";" << run.numThreads << ";"
+                << run.numStripes << ";" << run.memoryLimitMB << ";" << iRepetition << ";";
+            if (iRepetition > 1)
+                algorithm = CreateAlgorithm(run.algorithm, parameters);
+
+            RunMeasurement measurement = RunAlgorithm(*algorithm, pProblem.get(), pProblemExternal.get(), options, pSample.get(), pResultReference, ssSink.str(), outFile, trace);
+
+            //the statistics of the repetitions are valid only if they have run the same configuration
+            if (iRepetition > 1 && measurement.numStripes != configuration.numStripesUsed)
+                throw ApplicationException("Repetition " + std::to_string(iRepetition) + " of run " + std::to_string(iRun + 1) + " used "
+                    + std::to_string(measurement.numStripes) + " stripes instead of " + std::to_string(configuration.numStripesUsed));
+
+            configuration.durations.push_back(measurement.duration);
+            configuration.numStripesUsed = measurement.numStripes;
+        }
+
+        const DurationStatistics& statistics = report.Add(configuration).statistics;
+
+        std::cout << std::fixed << std::setprecision(3) << "Repetitions: " << configuration.durations.size() << " median: " << statistics.median
+            << " p10: " << statistics.p10 << " p90: " << statistics.p90 << " stddev: " << statistics.stddev << " seconds" << std::endl;
+    }
+
+    outFile.close();
+
+    report.CalcScaling();
+    report.WriteJson(reportFilename);
+    trace.WriteJson(traceFilename);
+
+    std::cout << "Benchmark report written to " << reportFilename << ", trace of the phases written to " << traceFilename << std::endl;
+
+    return 0;
+}
 
 int main(int argc, char* argv[])
 {
-    double accuracy = 1.0E-15;
-    bool saveToFile = true;
-    bool findDifferences = true;
+    ResultOptions options;
+    size_t sampleSize = 10000;
     std::string enableAlgo(NUM_ALGORITHMS, '1');
     bool useExternalMemory = false;
     bool useInternalMemory = false;
     size_t memoryLimitMB = 1024;
+    StripeAxisMode stripeAxisMode = StripeAxisMode::Y;
+    bool prefetchWindows = true;
+
+    //a job specification runs a grid of parameters, it is read from files and settings key=value of the command line
+    if (argc >= 3 && std::string(argv[1]) == "--job")
+    {
+        try
+        {
+            JobSpec jobSpec;
+
+            for (int i = 2; i < argc; ++i)
+            {
+                std::string arg = argv[i];
+
+                if (arg.find('=') != std::string::npos)
+                    jobSpec.ParseSetting(arg);
+                else
+                    jobSpec.ParseFile(arg);
+            }
+
+            jobSpec.Validate();
+
+            return RunJob(jobSpec);
+        }
+        catch(std::exception& ex)
+        {
+            //report any exception
+            std::cout << "Exception: " << ex.what() << std::endl;
+            return 1;
+        }
+    }
 
     //parameters must be specified in the command line
     if (argc < 4)
@@ -46,10 +631,14 @@ int main(int argc, char* argv[])
         std::cout << "Argument 4: The number of threads (optional)\n";
         std::cout << "Argument 5: The accuracy to use for comparing results (optional)\n";
         std::cout << "Argument 6: The number of stripes (optional)\n";
-        std::cout << "Argument 7: Save results of each algorithm to a text file (0/1, optional)\n";
-        std::cout << "Argument 8: Compare results of each algorithm with results of the first algorithm (0/1, optional)\n";
-        std::cout << "Argument 9: Enable/Disable algorithms (bitstream of 30 digits 0 or 1, e.g. 01100110011110, optional)\n";
+        std::cout << "Argument 7: Save results of each algorithm to a file (0=no, 1=text file, 2=binary file, 3=binary file written while the algorithm runs, optional)\n";
+        std::cout << "Argument 8: Compare results of each algorithm with results of the first algorithm (0/1) or with the exact neighbors of a sample of input points (2, optional)\n";
+        std::cout << "Argument 9: Enable/Disable algorithms (bitstream of 42 digits 0 or 1, e.g. 01100110011110, optional)\n";
         std::cout << "Argument 10: Megabytes of physical memory to use for external memory algorithms (int, optional)\n";
+        std::cout << "Argument 11: Stripe axis (0=stripes in y, 1=select axis from data spread, 2=rotate onto principal axes, optional)\n";
+        std::cout << "Argument 12: Load the next window of stripes in the background for external memory algorithms (0/1, optional)\n";
+        std::cout << "Argument 13: The number of sampled input points for argument 8 equal to 2 (optional)\n";
+        std::cout << "Or: --job <job file or setting key=value>... to run every combination of the parameters of a job specification (see JobSpec.h)\n";
         return 1;
     }
 
@@ -74,7 +663,7 @@ int main(int argc, char* argv[])
             double d = atof(argv[5]);
             if (d > 0.0)
             {
-                accuracy = d;
+                options.accuracy = d;
             }
         }
 
@@ -88,13 +677,14 @@ int main(int argc, char* argv[])
             }
         }
 
-        //set if we want to save the list of neighbors in a text file
+        //set if we want to save the list of neighbors in a text or binary file
+        //with 3, the algorithms that support a result sink write the neighbors of each point as soon as its search is completed
         if (argc >= 8)
         {
             int save = atoi(argv[7]);
-            if (save == 0)
+            if (save >= 0 && save <= 3)
             {
-                saveToFile = false;
+                options.saveToFile = save;
             }
         }
 
@@ -104,11 +694,17 @@ int main(int argc, char* argv[])
             int compare = atoi(argv[8]);
             if (compare == 0)
             {
-                findDifferences = false;
+                options.findDifferences = false;
+            }
+            else if (compare == 2)
+            {
+                //the exact neighbors of the sample are computed by brute force, so no reference algorithm is needed
+                options.findDifferences = false;
+                options.sampledVerification = true;
             }
         }
 
-        //the bitstream of algorithms to run, a sequence of 30 digits 0 or 1
+        //the bitstream of algorithms to run, a sequence of 42 digits 0 or 1
         if (argc >= 10)
         {
             std::string bs = argv[9];
@@ -132,139 +728,58 @@ int main(int argc, char* argv[])
             }
         }
 
+        //transform applied to the coordinates of both datasets before splitting them into stripes
+        if (argc >= 12)
+        {
+            int axis = atoi(argv[11]);
+            if (axis == 1)
+            {
+                stripeAxisMode = StripeAxisMode::Auto;
+            }
+            else if (axis == 2)
+            {
+                stripeAxisMode = StripeAxisMode::Pca;
+            }
+        }
+
+        //double buffering of windows for the external memory algorithms, each window takes half of the available memory
+        if (argc >= 13)
+        {
+            int prefetch = atoi(argv[12]);
+            if (prefetch == 0)
+            {
+                prefetchWindows = false;
+            }
+        }
+
+        //number of input points whose neighbors are verified when sampled verification is used
+        if (argc >= 14)
+        {
+            size_t size = std::stoull(argv[13]);
+            if (size > 0)
+            {
+                sampleSize = size;
+            }
+        }
+
         std::vector<algorithm_ptr_t> algorithms;
 
+        AlgorithmParameters parameters;
+        parameters.numStripes = numStripes;
+        parameters.numThreads = numThreads;
+        parameters.prefetchWindows = prefetchWindows;
+
         //insert all algorithms we want to run in a vector
         for (int i=0; i < NUM_ALGORITHMS; ++i)
         {
             if (enableAlgo[i] == '1')
             {
-                switch(i)
-                {
-                    case 0:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new BruteForceAlgorithm));
-                        break;
-                    case 1:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new BruteForceParallelAlgorithm(numThreads)));
-                        break;
-                    case 2:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new BruteForceParallelTBBAlgorithm(numThreads)));
-                        break;
-                    case 3:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepAlgorithm()));
-                        break;
-                    case 4:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepCopyAlgorithm()));
-                        break;
-                    case 5:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepCopyParallelAlgorithm(numThreads, false)));
-                        break;
-                    case 6:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepCopyParallelAlgorithm(numThreads, true)));
-                        break;
-                    case 7:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepCopyParallelTBBAlgorithm(numThreads, false)));
-                        break;
-                    case 8:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepCopyParallelTBBAlgorithm(numThreads, true)));
-                        break;
-                    case 9:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesAlgorithm(numStripes)));
-                        break;
-
-                    case 10:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, false, false)));
-                        break;
-                    case 11:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, true, false)));
-                        break;
-                    case 12:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, false, false)));
-                        break;
-                    case 13:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, true, false)));
-                        break;
-                    case 14:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, false, false)));
-                        break;
-                    case 15:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, true, false)));
-                        break;
-                    case 16:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, false, false)));
-                        break;
-                    case 17:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, true, false)));
-                        break;
-
-                    case 18:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, false, true)));
-                        break;
-                    case 19:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, false, true, true)));
-                        break;
-                    case 20:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, false, true)));
-                        break;
-                    case 21:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelAlgorithm(numStripes, numThreads, true, true, true)));
-                        break;
-                    case 22:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, false, true)));
-                        break;
-                    case 23:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, false, true, true)));
-                        break;
-                    case 24:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, false, true)));
-                        break;
-                    case 25:
-                        useInternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelTBBAlgorithm(numStripes, numThreads, true, true, true)));
-                        break;
-
-                    case 26:
-                        useExternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, false)));
-                        break;
-                    case 27:
-                        useExternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelExternalAlgorithm(numStripes, numThreads, true, true)));
-                        break;
-                    case 28:
-                        useExternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, false)));
-                        break;
-                    case 29:
-                        useExternalMemory = true;
-                        algorithms.push_back(algorithm_ptr_t(new PlaneSweepStripesParallelExternalTBBAlgorithm(numStripes, numThreads, true, true)));
-                        break;
-                }
+                algorithms.push_back(CreateAlgorithm(i, parameters));
+
+                if (algorithms.back()->UsesExternalMemory())
+                    useExternalMemory = true;
+                else
+                    useInternalMemory = true;
             }
         }
 
@@ -276,13 +791,12 @@ int main(int argc, char* argv[])
 
         //allocate the problem object depending on which kind of algorithm we need to run, internal memory or external, may be both of them
         if (useInternalMemory)
-            pProblem.reset(new AllKnnProblem(argv[2], argv[3], numNeighbors, true));
+            pProblem.reset(new AllKnnProblem(argv[2], argv[3], numNeighbors, true, stripeAxisMode));
 
         if (useExternalMemory)
-            pProblemExternal.reset(new AllKnnProblemExternal(argv[2], argv[3], numNeighbors, true, memoryLimitMB));
+            pProblemExternal.reset(new AllKnnProblemExternal(argv[2], argv[3], numNeighbors, true, stripeAxisMode, memoryLimitMB));
 
-        std::unique_ptr<AllKnnResult> pResultReference, pResult;
-        std::unique_ptr<std::vector<unsigned long>> pDiff;
+        std::unique_ptr<AllKnnResult> pResultReference;
 
         //report how much time was required for loading the datasets, input and training
         if (useInternalMemory)
@@ -293,116 +807,52 @@ int main(int argc, char* argv[])
             std::cout << "Read " << pProblemExternal->GetInputDatasetSize() << " input points and " << pProblemExternal->GetTrainingDatasetSize()
                 << " training points " << "in " << pProblemExternal->getLoadingTime().count() << " seconds" << std::endl;
 
+        if (stripeAxisMode != StripeAxisMode::Y)
+            ReportStripeAxis(useInternalMemory ? pProblem.get() : pProblemExternal.get(), options.accuracy);
+
+        //compute the exact neighbors of the sample, by using the datasets of the internal memory problem if they have been loaded
+        std::unique_ptr<SampledVerification> pSample;
+
+        if (options.sampledVerification)
+        {
+            if (useInternalMemory)
+                pSample.reset(new SampledVerification(pProblem->GetInputDataset(), pProblem->GetTrainingDataset(), numNeighbors, sampleSize, SAMPLE_SEED));
+            else
+                pSample.reset(new SampledVerification(pProblemExternal->GetExtInputDataset(), pProblemExternal->GetExtTrainingDataset(), numNeighbors, sampleSize, SAMPLE_SEED));
+
+            std::cout << "Computed exact neighbors of " << pSample->GetSampleSize() << " sampled input points in " << pSample->getDuration().count() << " seconds" << std::endl;
+        }
+
+        CheckHardwareCounters();
+
         //create the output file to record performance statistics
         auto now = std::chrono::system_clock::now();
         auto in_time_t = std::chrono::system_clock::to_time_t(now);
         std::stringstream ss;
-        ss <<  "results_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << ".csv";
+        ss <<  "results_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S");
+        std::string traceFilename = ss.str() + ".trace.json";
+        ss << ".csv";
 
         std::ofstream outFile(ss.str(), std::ios_base::out);
         outFile.imbue(std::locale(outFile.getloc(), new punct_facet<char, ',', '.'>));
 
-        outFile << "Algorithm;Total Duration;Sorting Duration;Total Heap Additions;Min. Heap Additions;Max. Heap Additions;Avg. Heap Additions;NumberOfStripes;HasAllocationError;PendingPoints;NumFirstPassWindows;NumSecondPassWindows;CommitWindow Duration;Final Sorting Duration;Differences;First 5 different point ids" << std::endl;
-        outFile.flush();
+        WriteStatisticsHeader(outFile, "");
+        ProfileTrace trace;
 
         //run each requested algorithm
         for (size_t iAlgo = 0; iAlgo < algorithms.size(); ++iAlgo)
         {
-            //process the correct type of problem (external or internal memory)
-            if (algorithms[iAlgo]->UsesExternalMemory())
-                pResult = algorithms[iAlgo]->Process(*pProblemExternal);
-            else
-                pResult = algorithms[iAlgo]->Process(*pProblem);
-
-            //output the performance statistics to the console
-            std::cout << std::fixed << std::setprecision(3) << algorithms[iAlgo]->GetTitle() << " duration: " << pResult->getDuration().count()
-                << " sorting " << pResult->getDurationSorting().count() << " seconds "
-                << " totalAdd: " << pResult->getTotalHeapAdditions()
-                <<  " minAdd: " << pResult->getMinHeapAdditions()
-                << " maxAdd: " << pResult->getMaxHeapAdditions()
-                << " avgAdd: " << pResult->getAvgHeapAdditions()
-                << " numStripes: " << pResult->getNumStripes()
-                << " hasAllocationError: " << pResult->HasAllocationError()
-                << " numPendingPoints: " << pResult->getNumPendingPoints()
-                << " numFirstPassWindows: " << pResult->getNumFirstPassWindows()
-                << " numSecondPassWindows: " << pResult->getNumSecondPassWindows()
-                << " commitWindow: " << pResult->getDurationCommitWindow().count() << " seconds "
-                << " finalSorting: " << pResult->getDurationFinalSorting().count() << " seconds ";
-
-            //write the performance statistics to the output file
-            outFile << std::fixed << std::setprecision(3) << algorithms[iAlgo]->GetTitle() << ";" << pResult->getDuration().count()
-                << ";" << pResult->getDurationSorting().count()
-                << ";" << pResult->getTotalHeapAdditions()
-                << ";" << pResult->getMinHeapAdditions()
-                << ";" << pResult->getMaxHeapAdditions()
-                << ";" << pResult->getAvgHeapAdditions()
-                << ";" << pResult->getNumStripes()
-                << ";" << pResult->HasAllocationError()
-                << ";" << pResult->getNumPendingPoints()
-                << ";" << pResult->getNumFirstPassWindows()
-                << ";" << pResult->getNumSecondPassWindows()
-                << ";" << pResult->getDurationCommitWindow().count()
-                << ";" << pResult->getDurationFinalSorting().count();
-
-            //save the list of neighbors to a text file
-            if (saveToFile && !pResult->HasAllocationError())
-            {
-                pResult->SaveToFile();
-            }
+            std::stringstream ssSink;
+            ssSink << "result_stream_" << std::put_time(localtime(&in_time_t), "%Y%m%d%H%M%S") << "_" << iAlgo << ".bin";
 
-            //check for differences between distances of neighbors by using the first algorithm as a reference result
-            if (findDifferences && iAlgo > 0 && !pResult->HasAllocationError())
-            {
-                pDiff = pResult->FindDifferences(*pResultReference, accuracy);
-                std::cout << " " << pDiff->size() << " differences. ";
-                outFile << ";" << pDiff->size();
-
-                if (pDiff->size() > 0)
-                {
-                    //report the first 5 different neighbor ids
-                    std::cout << "First 5 different point ids: ";
-                    outFile << ";";
-
-                    for (size_t i = 0; i < 5; ++i)
-                    {
-                        if (pDiff->size() >= i+1)
-                        {
-                            std::cout << pDiff->at(i) << " ";
-                            outFile << pDiff->at(i) << " ";
-                        }
-                        else
-                        {
-                            break;
-                        }
-                    }
-                }
-                else
-                {
-                    outFile << ";";
-                }
-                pDiff.reset();
-            }
-            else
-            {
-                outFile << ";;";
-            }
-
-            std::cout << std::endl;
-            outFile << std::endl;
-            outFile.flush();
-
-            //if we need to check for differences, keep the first result to use as a reference for comparing the others with it
-            if (findDifferences && iAlgo == 0)
-            {
-                pResultReference = std::move(pResult);
-            }
-
-            //free the memory allocated for the result
-            pResult.reset();
+            RunAlgorithm(*algorithms[iAlgo], pProblem.get(), pProblemExternal.get(), options, pSample.get(), pResultReference, ssSink.str(), outFile, trace);
         }
 
         outFile.close();
 
+        //the trace of the phases of all algorithms is opened by chrome://tracing
+        trace.WriteJson(traceFilename);
+
         //we are exiting, free the reference result
         if (pResultReference)
         {
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "ResultFile.h"
+
+//number of neighbors read from the binary file at once
+const size_t CHUNK_NEIGHBORS = 1024*1024;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cout << "Argument error. Please enter:\n";
+        std::cout << "Argument 1: The binary result file (saved by PlaneSweepParallel with argument 7 equal to 2)\n";
+        std::cout << "Argument 2: The text file to create, in the format of the text result files\n";
+
+        return 1;
+    }
+
+    std::string sourceFilename(argv[1]), targetFilename(argv[2]);
+
+    std::ifstream fsSource(sourceFilename, std::ios::in | std::ios::binary);
+    if ( !fsSource.is_open() )
+    {
+        std::cout << "Cannot open input file" << std::endl;
+        return 1;
+    }
+
+    ResultFileHeader header;
+    if (!ReadResultFileHeader(fsSource, header))
+    {
+        std::cout << "Input file is not a binary result file of a supported version" << std::endl;
+        return 1;
+    }
+
+    std::ofstream fsTarget(targetFilename, std::ios::out);
+    if ( !fsTarget.is_open() )
+    {
+        std::cout << "Cannot create output file" << std::endl;
+        return 1;
+    }
+
+    size_t numNeighbors = header.numNeighbors;
+    size_t recordSize = header.idBytes + sizeof(double);
+    size_t chunkPoints = std::max(CHUNK_NEIGHBORS/std::max(numNeighbors, size_t(1)), size_t(1));
+    std::vector<char> buffer;
+
+    for (size_t startPoint = 0; startPoint < header.numPoints; startPoint += chunkPoints)
+    {
+        size_t numPoints = std::min(chunkPoints, size_t(header.numPoints) - startPoint);
+        buffer.resize(numPoints*numNeighbors*recordSize);
+        fsSource.read(buffer.data(), std::streamsize(buffer.size()));
+
+        if (size_t(fsSource.gcount()) != buffer.size())
+        {
+            std::cout << "Input file is truncated" << std::endl;
+            return 1;
+        }
+
+        for (size_t iPoint = 0; iPoint < numPoints; ++iPoint)
+        {
+            fsTarget << startPoint + iPoint + 1;
+
+            //the text files list the neighbors from the farthest to the nearest, the binary files from the nearest to the farthest
+            for (size_t iNeighbor = numNeighbors; iNeighbor > 0; --iNeighbor)
+            {
+                uint64_t id = 0;
+                double distanceSquared = 0.0;
+                DecodeResultNeighbor(buffer.data() + (iPoint*numNeighbors + iNeighbor - 1)*recordSize, header.idBytes, id, distanceSquared);
+
+                if (id > 0)
+                {
+                    fsTarget << "\t(" << id << " " << distanceSquared << ")";
+                }
+                else
+                {
+                    fsTarget << "\t(" << "NULL" << " " << distanceSquared << ")";
+                }
+            }
+
+            fsTarget << '\n';
+        }
+    }
+
+    fsSource.close();
+    fsTarget.close();
+
+    return 0;
+}